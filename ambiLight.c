@@ -33,8 +33,11 @@
 #include "IRdecoder.h"
 
 
-// rgbImage is a scaled imgae of the raw video image blocks. It can be sized from 1x1 to 64x40
-rgbIcontroller_t	rgbImage [2*SLOTS_X + 2*SLOTS_Y];
+// rgbImage holds the integrated colour of every physical LED. The virtual block image in between slots and LEDs can
+// be sized from 1x1 to 64x40; it is part of the sampling matrix (see ambiLightBuildMatrix)
+rgbIcontroller_t	rgbImage [LEDS_MAXTOTAL];
+static uint32_t		recipQ16 [SLOTS_X+1];				// 65536 / n (set by ambiLightInit, used by the matrix compiler)
+edgeKernel_t		edgeKernel [LED_EDGES];				// sampling depth/kernel of right, top, left, bottom (0 = frameWidth, exponential)
 short				rgbImageWid = SLOTS_X;
 short				rgbImageHigh = SLOTS_Y;
 
@@ -59,9 +62,8 @@ long				dynWhiteLevelInt;
 
 int 				frameWidth = 4;			// number of slots to aggregate for LED stripe
 
-rgbValue_t 			tvprocRGBDelayFifo[DELAY_LINE_SIZE][LEDS_MAXTOTAL];			// for TV picture proc delays; up to 1 second
-short  				tvprocDelayW;			// delay FIFO write pointer
-short  				tvprocDelayTime;		// difference between write an read pointr
+short  				tvprocDelayMs = 0;		// LED delay (ms) for the picture processing of the TV; see ambiLightImage2LedRGB
+static short		delayLeds = 0;			// ledsPhysical the delay line is laid out for (0 = empty)
 
 //----------------------------------------------------------------------------------------------------------
 
@@ -70,32 +72,24 @@ short  				tvprocDelayTime;		// difference between write an read pointr
 
 void ambiLightInit (void)
 {
-	int i, j;
+	int i;
 
 	dynLeft 	= 0;
 	dynRight 	= SLOTS_X-1;
 	dynTop 		= 0;
 	dynBottom 	= SLOTS_Y-1;
-	memset ((char*)&dynColumns[0], sizeof(dynColumns), 0);
-	memset ((char*)&dynRows[0], sizeof(dynRows), 0);
+	memset ((char*)&dynColumns[0], 0, sizeof(dynColumns));
+	memset ((char*)&dynRows[0], 0, sizeof(dynRows));
 	dynBlackLevel = INT16_MAX;
 	dynBlackLevelInt = 0;;
 	dynWhiteLevel = 0;
 	dynWhiteLevelInt = 0;
 	dynFrames = 0;
 
-	for (j = 0; j < DELAY_LINE_SIZE; j++)
-	{
-		for (i = 0; i < LEDS_MAXTOTAL; i++)
-		{
-			tvprocRGBDelayFifo[j][i].B = 0;
-			tvprocRGBDelayFifo[j][i].G = 0;
-			tvprocRGBDelayFifo[j][i].R = 0;
-		}
-	}
+	delayLeds = 0;				// empty delay line; tvprocDelayMs is a user setting and kept
 
-	tvprocDelayTime = 0;		// no delay
-	tvprocDelayW = 0;
+	for (i = 1; i <= SLOTS_X; i++)
+		recipQ16[i] = (65536 + i/2) / i;
 
 }
 
@@ -272,7 +266,12 @@ void ambiLightSlots2Dyn (void)
 	int i, j, k;
 	int x, y;
 	short blackLevl = INT16_MAX;
+	short bandX = captureBandX;			// edge bands captured in this frame (0 = whole picture)
+	short bandY = captureBandY;
+	short depthL = ambiLightEdgeDepth (LED_EDGE_LEFT), depthR = ambiLightEdgeDepth (LED_EDGE_RIGHT);
+	short depthT = ambiLightEdgeDepth (LED_EDGE_TOP), depthB = ambiLightEdgeDepth (LED_EDGE_BOTTOM);
 
+	TVP5150setEdgeBands (DYN_WIN_X + (depthL > depthR ? depthL : depthR), DYN_WIN_Y + (depthT > depthB ? depthT : depthB));
 
 	if (dynFramesLimit == 0)			// dynamic border detect is OFF (used while setting screen boundaries)
 	{
@@ -293,6 +292,7 @@ void ambiLightSlots2Dyn (void)
 	for (y = 0; y < SLOTS_Y; y++)
 	{
 		long minRGB, maxRGB, sumRGB;
+		short used = 0;
 
 		minRGB = 0xffff;
 		maxRGB = 0;
@@ -300,13 +300,18 @@ void ambiLightSlots2Dyn (void)
 
 		for (x = 0; x < SLOTS_X; x++)
 		{
+			if (bandX && y >= bandY && y < SLOTS_Y-bandY && x >= bandX && x < SLOTS_X-bandX)
+				x = SLOTS_X-bandX;			// center of this row is not captured (edge band mode)
+
 			int s = rgbSlots[y][x].R + rgbSlots[y][x].G + rgbSlots[y][x].B;
 			if ( s < minRGB)
 				minRGB = s;
 			if (s > maxRGB)
 				maxRGB = s;
 			sumRGB += s;
+			used++;
 		}
+		sumRGB = (sumRGB * SLOTS_X) / used;		// scale to full row
 		dynRows[y].intContrast  += (maxRGB - minRGB);
 		dynRows[y].intAvg += (sumRGB / SLOTS_X);
 
@@ -377,6 +382,7 @@ void ambiLightSlots2Dyn (void)
 	for (x = 0; x < SLOTS_X; x++)
 	{
 		long minRGB, maxRGB, sumRGB;
+		short used = 0;
 
 		minRGB = 0xffff;
 		maxRGB = 0;
@@ -384,13 +390,18 @@ void ambiLightSlots2Dyn (void)
 
 		for (y = 0; y < SLOTS_Y; y++)
 		{
+			if (bandX && x >= bandX && x < SLOTS_X-bandX && y >= bandY && y < SLOTS_Y-bandY)
+				y = SLOTS_Y-bandY;			// center of this column is not captured (edge band mode)
+
 			int s = rgbSlots[y][x].R + rgbSlots[y][x].G + rgbSlots[y][x].B;
 			if ( s < minRGB)
 				minRGB = s;
 			if (s > maxRGB)
 				maxRGB = s;
 			sumRGB += s;
+			used++;
 		}
+		sumRGB = (sumRGB * SLOTS_Y) / used;		// scale to full column
 
 		dynColumns[x].intContrast  += (maxRGB - minRGB);
 		dynColumns[x].intAvg += (sumRGB / SLOTS_X);
@@ -452,314 +463,512 @@ void ambiLightSlots2Dyn (void)
 
 
 
-void ambiLightDyn2Image (void)
+/*
+ * Slot to LED sampling matrix. Every physical LED gets a list of terms (slot index, weight) which combines the
+ * weighted edge zones of the virtual rgbImageWid x rgbImageHigh block image with the scaling of the blocks to the
+ * LED strip. It is compiled by ambiLightBuildMatrix() whenever the geometry, the LED layout, the edge kernels or the
+ * dyn borders change; per frame ambiLightDyn2Image() only runs one multiply-accumulate pass over the terms.
+ *
+ * A term is (weight << MATRIX_SLOT_BITS) | slot, the weight is Q20 and the weights of an LED sum up to less than 1,
+ * so the accumulators stay below 255 << 20. LEDs sharing one block (more LEDs than blocks) share its terms. The term
+ * list (MATRIX_TERMS * 4 bytes) is placed in the CCM RAM, which is not used by the linker script; only the CPU
+ * accesses it.
+ *
+ * The compiler has no divisions per term either: the depth weights of each edge are Q32 table values (see
+ * ambiLightBuildKernels) and the averaging over cnt rows/columns and zones multiplies with Q16 reciprocals.
+ *
+ * The integrators (computeI) run per LED on the sampled colour; the former block image integrated every block and
+ * averaged the truncated block values to the LEDs. So the output is not bit exact to the code before the matrix:
+ * mostly within 1, in fades single LEDs step one frame earlier and differ by 2 (replay of the synthetic scenes:
+ * one value in 456000, "pillarbox"). Golden files written before the matrix need "replay -t 2"; rounding the
+ * weights down or biasing the sums only moves the differences from +1 to -1.
+ */
+#define		MATRIX_SLOT_BITS	12
+#define		MATRIX_SLOT_MASK	((1 << MATRIX_SLOT_BITS) - 1)
+#define		MATRIX_Q			20
+#define		MATRIX_TERMS		(LED_SEGMENTS * SLOTS_X * EDGE_DEPTH_MAX)		// each segment at most one full edge
+
+typedef struct {
+	short			ledsX, ledsY, imageWid, imageHigh, frameWidth;
+	short			dynLeft, dynRight, dynTop, dynBottom;
+	ledSegment_t	layout [LED_SEGMENTS];
+	edgeKernel_t	kernel [LED_EDGES];
+} matrixKey_t;
+
+static uint32_t		* const matrixTerms = (uint32_t *) CCMDATARAM_BASE;
+static uint16_t		matrixFirst [LEDS_MAXTOTAL];		// terms of LED n are matrixFirst[n] .. matrixEnd[n]-1
+static uint16_t		matrixEnd [LEDS_MAXTOTAL];
+static uint16_t		matrixUsed;
+static matrixKey_t	matrixKey;							// settings the matrix was built for
+static uint32_t		kernelQ32 [LED_EDGES][EDGE_DEPTH_MAX];	// Q32 weight of depth j of each edge
+
+unsigned long		matrixBuilds = 0;
+unsigned long		matrixBuildCycles = 0;				// last compile
+unsigned long		matrixPassCycles = 0;				// last pass over the terms
+
+
+// sampling depth of an edge in slots
+short ambiLightEdgeDepth (uint8_t edge)
 {
-	int i;
-	int j;
-	long  rVal, gVal, bVal;
-	short curImage;
-	short cntVal;
-	short dv;
-
-	/*
-	 * right edge
-	 */
-	curImage = 0;			// = bottom right
-	cntVal = 0;
-	rVal = gVal = bVal = 0;
-	dv = 0;
-
-	int d = (2<<frameWidth) - 1;
-
-	for (i = SLOTS_Y-1; i >= 0; i--)
+	short d = edgeKernel[edge].depth ? edgeKernel[edge].depth : frameWidth;
+
+	return (d < EDGE_DEPTH_MAX ? d : EDGE_DEPTH_MAX);
+}
+
+
+/*
+ * Depth weights of the edges. EDGE_KERNEL_EXP is the original weighting 2^(d-j) / (2^(d+1)-1) of depth j of d.
+ * The others are integer kernels k[j], scaled to a sum of 1023/1024 so the rounding of the terms can not push an
+ * LED over 255:
+ *	box			1, 1, ... 1
+ *	gauss		upper half of the binomial row 2d-2: C(2d-2, d-1+j); a Gaussian falling off from the dyn border
+ *	center		min (j+1, d-j); most weight in the middle of the band
+ */
+static void ambiLightBuildKernels (void)
+{
+	uint8_t edge;
+
+	for (edge = 0; edge < LED_EDGES; edge++)
 	{
-		if (i <= dynBottom && i >= dynTop)	// else do not change R/G/B vals because blocks should be black (avoids black flickering of LEDs)
+		uint32_t k [EDGE_DEPTH_MAX];
+		uint32_t sum = 0;
+		short d = ambiLightEdgeDepth (edge);
+		short j;
+
+		for (j = d-1; j >= 0; j--)
 		{
-			for (j = 0; j < frameWidth; j++)
+			switch (edgeKernel[edge].kernel)
 			{
-				long n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[i][dynRight-j].R;
-				rVal += (n / d);
-
-				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[i][dynRight-j].G;
-				gVal += (n / d);
-
-				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[i][dynRight-j].B;
-				bVal += (n / d);
+			case EDGE_KERNEL_BOX:
+				k[j] = 1;
+				break;
+			case EDGE_KERNEL_GAUSS:			// C(n, m) = C(n, m+1) * (m+1) / (n-m) with n = 2d-2, m = d-1+j
+				k[j] = (j == d-1) ? 1 : k[j+1] * (d+j) / (d-1-j);
+				break;
+			case EDGE_KERNEL_CENTER:
+				k[j] = (j+1 < d-j) ? j+1 : d-j;
+				break;
+			default:
+				k[j] = 2 << (d-1-j);
+				break;
 			}
+			sum += k[j];
 		}
-		cntVal++;
 
-		dv += rgbImageHigh;
-		if (dv >= SLOTS_Y)
+		for (j = 0; j < d; j++)
 		{
-			while (dv >= SLOTS_Y)
-			{
-				dv -= SLOTS_Y;
-				computeI (&rgbImage [curImage], rVal / 100 / cntVal, gVal / 100 / cntVal, bVal / 100 / cntVal);
-				curImage++;
-			}
-			rVal = gVal = bVal = 0;
-			cntVal = 0;
+			if (edgeKernel[edge].kernel == EDGE_KERNEL_EXP || edgeKernel[edge].kernel >= EDGE_KERNELS)
+				kernelQ32[edge][j] = (((uint64_t)k[j] << 32) + (sum+1) / 2) / (sum+1);
+			else
+				kernelQ32[edge][j] = ((uint64_t)k[j] * 1023 << 22) / sum;
 		}
 	}
+}
 
-	// left edge
-	curImage = rgbImageHigh + rgbImageWid;			// top left starts at <right edge leds> + <top edge leds>
-	cntVal = 0;
-	rVal = gVal = bVal = 0;
-	dv = 0;
 
-	for (i = 0; i < SLOTS_Y; i++)
+// slot index of row/column <cell> of an edge (0 = top/left) <depth> slots from the dyn border towards the center
+static short edgeSlot (uint8_t edge, short cell, short depth)
+{
+	switch (edge)
 	{
-		if (i <= dynBottom && i >= dynTop)	// else do not change R/G/B vals because blocks should be black (avoids black flickering of LEDs)
-		{
-			for (j = 0; j < frameWidth; j++)
-			{
-				long n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[i][dynLeft+j].R;
-				rVal += (n / d);
+	case LED_EDGE_RIGHT:	return cell * SLOTS_X + dynRight - depth;
+	case LED_EDGE_TOP:		return (dynTop + depth) * SLOTS_X + cell;
+	case LED_EDGE_LEFT:		return cell * SLOTS_X + dynLeft + depth;
+	default:				return (dynBottom - depth) * SLOTS_X + cell;
+	}
+}
 
-				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[i][dynLeft+j].G;
-				gVal += (n / d);
 
-				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[i][dynLeft+j].B;
-				bVal += (n / d);
-			}
-		}
+// is row/column <cell> of an edge inside the dyn area (else its slots should be black and are skipped)
+static uint8_t edgeInDyn (uint8_t edge, short cell)
+{
+	if (edge == LED_EDGE_RIGHT || edge == LED_EDGE_LEFT)
+		return (cell >= dynTop && cell <= dynBottom);
+	return (cell >= dynLeft && cell <= dynRight);
+}
+
+
+/*
+ * Compile <leds> LEDs from <led> on, sampling <len> rows/columns of an edge from <first> on in direction <step>
+ * (+1 or -1). The rows/columns are split into <blocks> zones and the zones into LEDs with the same Bresenham steps
+ * as the former block image. A slot at depth j of a zone with cnt rows/columns gets the weight kernelQ32[edge][j] / cnt,
+ * divided by the number of zones averaged into the LED.
+ */
+static void ambiLightBuildEdge (uint8_t edge, short led, short leds, short blocks, short first, short len, short step)
+{
+	uint8_t blockFirst [SLOTS_X];
+	uint8_t blockCnt [SLOTS_X];
+	short depth = ambiLightEdgeDepth (edge);
+	short pos, cnt, b, start, dv;
 
-		cntVal++;
+	if (leds <= 0)
+		return;
 
-		dv += rgbImageHigh;
-		if (dv >= SLOTS_Y)
+	start = cnt = dv = b = 0;
+	for (pos = 0; pos < len; pos++)			// rows/columns of each block
+	{
+		cnt++;
+		dv += blocks;
+		if (dv >= len)
 		{
-			while (dv >= SLOTS_Y)
+			while (dv >= len)
 			{
-				dv -= SLOTS_Y;
-				computeI (&rgbImage [curImage], rVal / 100 / cntVal, gVal / 100 / cntVal, bVal / 100 / cntVal);
-				curImage++;
+				dv -= len;
+				blockFirst[b] = start;
+				blockCnt[b] = cnt;
+				b++;
 			}
-			rVal = gVal = bVal = 0;
-			cntVal = 0;
+			start = pos + 1;
+			cnt = 0;
 		}
 	}
 
-	// top edge
-	curImage = rgbImageHigh;			// top right starts at <right edge leds>
-	cntVal = 0;
-	rVal = gVal = bVal = 0;
-	dv = 0;
-
-	for (i = SLOTS_X-1; i >= 0; i--)
+	start = cnt = dv = 0;
+	for (b = 0; b < blocks; b++)			// blocks of each LED
 	{
-		if (i <= dynRight && i >= dynLeft)	// else do not change R/G/B vals because blocks should be black (avoids black flickering of LEDs)
+		cnt++;
+		dv += leds;
+		if (dv >= blocks)
 		{
-			for (j = 0; j < frameWidth; j++)
+			uint16_t termFirst = matrixUsed;
+			short i, j;
+
+			for (i = start; i <= b; i++)
 			{
-				long n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[dynTop+j][i].R;
-				rVal += (n / d);
+				uint32_t scale = ((uint64_t)recipQ16[blockCnt[i]] * recipQ16[cnt] + (1 << 11)) >> 12;		// Q20
+
+				for (pos = blockFirst[i]; pos < blockFirst[i] + blockCnt[i]; pos++)
+				{
+					short cell = first + pos * step;
 
-				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[dynTop+j][i].G;
-				gVal += (n / d);
+					if (!edgeInDyn (edge, cell))
+						continue;
+
+					for (j = 0; j < depth && matrixUsed < MATRIX_TERMS; j++)
+					{
+						uint32_t w = ((uint64_t)kernelQ32[edge][j] * scale + 0x80000000UL) >> 32;
 
-				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[dynTop+j][i].B;
-				bVal += (n / d);
+						matrixTerms[matrixUsed++] = (w << MATRIX_SLOT_BITS) | edgeSlot (edge, cell, j);
+					}
+				}
 			}
-		}
-		cntVal++;
 
-		dv += rgbImageWid;
-		if (dv >= SLOTS_X)
-		{
-			while (dv >= SLOTS_X)
+			while (dv >= blocks)
 			{
-				dv -= SLOTS_X;
-				computeI (&rgbImage [curImage], rVal / 100 / cntVal, gVal / 100 / cntVal, bVal / 100 / cntVal);
-				curImage++;
+				dv -= blocks;
+				if (led < LEDS_MAXTOTAL)		// LEDs behind LEDS_MAXTOTAL are not driven
+				{
+					matrixFirst[led] = termFirst;
+					matrixEnd[led] = matrixUsed;
+				}
+				led++;
 			}
-			rVal = gVal = bVal = 0;
-			cntVal = 0;
+			start = b + 1;
+			cnt = 0;
 		}
 	}
+}
 
-	// bottom edge
-	curImage = 2*rgbImageHigh + rgbImageWid;			// bottom left starts at <2*Y leds> + <top leds>
-	cntVal = 0;
-	rVal = gVal = bVal = 0;
-	dv = 0;
 
-	for (i = 0; i < SLOTS_X; i++)
-	{
-		if (i <= dynRight && i >= dynLeft)	// else do not change R/G/B vals because blocks should be black (avoids black flickering of LEDs)
-		{
-			for (j = 0; j < frameWidth; j++)
-			{
-				long n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[dynBottom-j][i].R;
-				rVal += (n / d);
+static void ambiLightGetMatrixKey (matrixKey_t *key)
+{
+	memset (key, 0, sizeof (matrixKey_t));		// no random padding bytes for memcmp
+	key->ledsX = ledsX;
+	key->ledsY = ledsY;
+	key->imageWid = rgbImageWid;
+	key->imageHigh = rgbImageHigh;
+	key->frameWidth = frameWidth;
+	key->dynLeft = dynLeft;
+	key->dynRight = dynRight;
+	key->dynTop = dynTop;
+	key->dynBottom = dynBottom;
+	memcpy (key->layout, ledLayout, sizeof (ledLayout));
+	memcpy (key->kernel, edgeKernel, sizeof (edgeKernel));
+}
 
-				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[dynBottom-j][i].G;
-				gVal += (n / d);
 
-				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[dynBottom-j][i].B;
-				bVal += (n / d);
-			}
-		}
-		cntVal++;
+/*
+ * Compile the matrix for all segments of the LED layout, or for the ring of ledsX/ledsY LEDs (starting bottom right,
+ * counter-clockwise) if there is no layout. The block image size applies to a full edge; a segment covering part of
+ * an edge gets the same share of the blocks.
+ */
+void ambiLightBuildMatrix (void)
+{
+	ledSegment_t ring [4] = {
+			{LED_EDGE_RIGHT,	100, 0,		ledsY, 0},		// = bottom right
+			{LED_EDGE_TOP,		100, 0,		ledsX, 0},		// = top right
+			{LED_EDGE_LEFT,		0, 100,		ledsY, 0},		// = top left
+			{LED_EDGE_BOTTOM,	0, 100,		ledsX, 0},		// = bottom left
+	};
+	const ledSegment_t *layout = (ledLayout[0].leds != 0) ? ledLayout : ring;
+	short segs = (ledLayout[0].leds != 0) ? LED_SEGMENTS : 4;
+	short led = 0;
+	short s;
+
+	ambiLightBuildKernels ();
+
+	matrixUsed = 0;
+
+	for (s = 0; s < segs && layout[s].leds != 0 && led < LEDS_MAXTOTAL; s++)
+	{
+		const ledSegment_t *seg = &layout[s];
+		uint8_t vertical = (seg->edge == LED_EDGE_RIGHT || seg->edge == LED_EDGE_LEFT);
+		short len = vertical ? SLOTS_Y : SLOTS_X;
+		short from = (seg->from > 100 ? 100 : seg->from) * len / 100;
+		short to = (seg->to > 100 ? 100 : seg->to) * len / 100;
+		short blocks, k;
+
+		for (k = 0; k < seg->skip && led < LEDS_MAXTOTAL; k++, led++)	// gap: LEDs stay black
+			matrixFirst[led] = matrixEnd[led] = matrixUsed;
 
-		dv += rgbImageWid;
-		if (dv >= SLOTS_X)
+		if (from == to)					// at least one row/column
 		{
-			while (dv >= SLOTS_X)
-			{
-				dv -= SLOTS_X;
-				computeI (&rgbImage [curImage], rVal / 100 / cntVal, gVal / 100 / cntVal, bVal / 100 / cntVal);
-				curImage++;
-			}
-			rVal = gVal = bVal = 0;
-			cntVal = 0;
+			if (from == len)
+				from--;
+			to = from + 1;
 		}
+		blocks = (vertical ? rgbImageHigh : rgbImageWid) * abs (to - from) / len;
+		if (blocks < 1)
+			blocks = 1;
+
+		if (from < to)
+			ambiLightBuildEdge (seg->edge, led, seg->leds, blocks, from, to - from, 1);
+		else
+			ambiLightBuildEdge (seg->edge, led, seg->leds, blocks, from - 1, from - to, -1);
+		led += seg->leds;
 	}
+
+	for (; led < LEDS_MAXTOTAL; led++)			// not on the strip
+		matrixFirst[led] = matrixEnd[led] = matrixUsed;
+
+	ambiLightGetMatrixKey (&matrixKey);
+	matrixBuilds++;
 }
 
 
 /*
- * Scale the virtual X*Y block image to the physical LED frame an push it into the delay FIFO
+ * Zone query: the R/G/B sums of any slot rectangle of the current frame in four lookups of a summed-area table
+ * (integral image) of rgbSlots. Entry [y][x] holds the sum of all slots above and left of slot (x, y); row 0 and
+ * column 0 are zero. R, G and B are packed into 21 bit lanes of one uint64_t (a whole picture sums up to
+ * 64*40*255 < 2^20), so one add handles all channels. The LEDs do not need it (the matrix terms of an edge zone are
+ * no more than its rectangles would be), so the table is only built by the first query after a new frame and costs
+ * nothing otherwise. tools/zonebench compares edge zones taken from it with the matrix and the former loops.
  */
-void ambiLightImage2LedRGB (void)
-{
-	int i;
-	long  rVal, gVal, bVal;
-	short ledIdx;
-	short cntVal;
-	short dv;
+static uint64_t		zoneSAT [SLOTS_Y+1][SLOTS_X+1];		// 21 KB
+static rgbValue_t	(*zoneSATSlots)[SLOTS_X];			// frame the table was built for; NULL after a new frame
 
-	masterBrightness = 100;		// always 100% in ambi mode. Brightness can be set in TVP5150
 
-	// distribute the scaled virtual image to the led buffer
+static void ambiLightSlots2SAT (void)
+{
+	short x, y;
 
-	ledIdx = 0;			// = bottom right
-	cntVal = 0;
-	rVal = gVal = bVal = 0;
-	dv = 0;
+	for (x = 0; x <= SLOTS_X; x++)
+		zoneSAT[0][x] = 0;
 
-	for (i = 0; i < rgbImageHigh; i++)	// expand the image blocks to the physical LED strip
+	for (y = 0; y < SLOTS_Y; y++)
 	{
-		rVal += rgbImage[i].R;
-		gVal += rgbImage[i].G;
-		bVal += rgbImage[i].B;
-		cntVal++;
+		const rgbValue_t *slot = rgbSlots[y];
+		const uint64_t *above = zoneSAT[y];
+		uint64_t *sat = zoneSAT[y+1];
+		uint64_t rowSum = 0;
 
-		dv += ledsY;
-		if (dv >= rgbImageHigh)
+		sat[0] = 0;
+		for (x = 1; x <= SLOTS_X; x++, slot++)
 		{
-			while (dv >= rgbImageHigh)
-			{
-				dv -= rgbImageHigh;
-				tvprocRGBDelayFifo[tvprocDelayW][ledIdx].R = rVal / cntVal;
-				tvprocRGBDelayFifo[tvprocDelayW][ledIdx].G = gVal / cntVal;
-				tvprocRGBDelayFifo[tvprocDelayW][ledIdx].B = bVal / cntVal;
-				ledIdx++;
-			}
-			rVal = gVal = bVal = 0;
-			cntVal = 0;
+			rowSum += (slot->R | ((uint32_t)slot->G << ZONE_LANE_BITS)) | ((uint64_t)slot->B << (2*ZONE_LANE_BITS));
+			sat[x] = above[x] + rowSum;
 		}
 	}
+	zoneSATSlots = rgbSlots;
+}
 
-	ledIdx = ledsY;			// = top right
-	cntVal = 0;
-	rVal = gVal = bVal = 0;
-	dv = 0;
 
-	for (i = rgbImageHigh; i < rgbImageWid + rgbImageHigh; i++)
+// packed R/G/B sums of the slots x0..x1, y0..y1 (inclusive, inside the slots) of the current frame; unpack with ZONE_R/G/B
+uint64_t ambiLightZoneSum (short x0, short y0, short x1, short y1)
+{
+	if (zoneSATSlots != rgbSlots)
+		ambiLightSlots2SAT ();
+
+	// (A + D) - (B + C): no lane can get negative, so there is no borrow between the lanes
+	return (zoneSAT[y1+1][x1+1] + zoneSAT[y0][x0]) - (zoneSAT[y0][x1+1] + zoneSAT[y1+1][x0]);
+}
+
+
+/*
+ * Sample the non-black area of the current frame into the integrated colours of the physical LEDs
+ */
+void ambiLightDyn2Image (void)
+{
+	const rgbValue_t *slots = &rgbSlots[0][0];
+	uint32_t rVal = 0, gVal = 0, bVal = 0;
+	matrixKey_t key;
+	uint32_t t;
+	short led;
+
+	zoneSATSlots = NULL;				// new frame (rgbSlots may point to a buffer used before)
+
+	ambiLightGetMatrixKey (&key);
+	if (memcmp (&key, &matrixKey, sizeof (matrixKey_t)) != 0)
 	{
-		rVal += rgbImage[i].R;
-		gVal += rgbImage[i].G;
-		bVal += rgbImage[i].B;
-		cntVal++;
+		t = CORE_GetCycleCount ();
+		ambiLightBuildMatrix ();
+		matrixBuildCycles = CORE_GetCycleCount () - t;
+	}
+
+	t = CORE_GetCycleCount ();
 
-		dv += ledsX;
-		if (dv >= rgbImageWid)
+	for (led = 0; led < ledsPhysical; led++)
+	{
+		if (led == 0 || matrixFirst[led] != matrixFirst[led-1] || matrixEnd[led] != matrixEnd[led-1])	// else same terms
 		{
-			while (dv >= rgbImageWid)
+			const uint32_t *term = &matrixTerms[matrixFirst[led]];
+			const uint32_t *end = &matrixTerms[matrixEnd[led]];
+
+			rVal = gVal = bVal = 0;
+			for (; term < end; term++)
 			{
-				dv -= rgbImageWid;
-				tvprocRGBDelayFifo[tvprocDelayW][ledIdx].R = rVal / cntVal;
-				tvprocRGBDelayFifo[tvprocDelayW][ledIdx].G = gVal / cntVal;
-				tvprocRGBDelayFifo[tvprocDelayW][ledIdx].B = bVal / cntVal;
-				ledIdx++;
+				const rgbValue_t *s = &slots[*term & MATRIX_SLOT_MASK];
+				uint32_t w = *term >> MATRIX_SLOT_BITS;
+
+				rVal += w * s->R;
+				gVal += w * s->G;
+				bVal += w * s->B;
 			}
-			rVal = gVal = bVal = 0;
-			cntVal = 0;
 		}
+		computeI (&rgbImage [led], rVal >> MATRIX_Q, gVal >> MATRIX_Q, bVal >> MATRIX_Q);
 	}
+	matrixPassCycles = CORE_GetCycleCount () - t;
+}
 
-	ledIdx = ledsY + ledsX;			// = top left
-	cntVal = 0;
-	rVal = gVal = bVal = 0;
-	dv = 0;
 
-	for (i = rgbImageWid + rgbImageHigh; i < rgbImageHigh + rgbImageWid + rgbImageHigh; i++)
-	{
-		rVal += rgbImage[i].R;
-		gVal += rgbImage[i].G;
-		bVal += rgbImage[i].B;
-		cntVal++;
+// cycles of the slot to LED sampling (DWT cycle counter)
+void ambiLightBenchmark (void)
+{
+	uint32_t t;
+
+	printf ("\nLED sampling: %d LEDs, %d matrix terms; last pass %d cycles, last compile %d cycles (%d compiles)\n",
+			(int)ledsPhysical, (int)matrixUsed, (int)matrixPassCycles, (int)matrixBuildCycles, (int)matrixBuilds);
+
+	CORE_CycleCounEn();
+	t = CORE_GetCycleCount ();
+	ambiLightBuildMatrix ();
+	t = CORE_GetCycleCount () - t;
+	printf ("  compile now: %d cycles for frame width %d\n", (int)t, frameWidth);
+
+	zoneSATSlots = NULL;
+	t = CORE_GetCycleCount ();
+	ambiLightZoneSum (dynLeft, dynTop, dynRight, dynBottom);
+	t = CORE_GetCycleCount () - t;
+	printf ("  zone query: %d cycles with the summed-area table build, 4 lookups after that\n", (int)t);
+}
 
-		dv += ledsY;
-		if (dv >= rgbImageHigh)
-		{
-			while (dv >= rgbImageHigh)
-			{
-				dv -= rgbImageHigh;
-				tvprocRGBDelayFifo[tvprocDelayW][ledIdx].R = rVal / cntVal;
-				tvprocRGBDelayFifo[tvprocDelayW][ledIdx].G = gVal / cntVal;
-				tvprocRGBDelayFifo[tvprocDelayW][ledIdx].B = bVal / cntVal;
-				ledIdx++;
-			}
-			rVal = gVal = bVal = 0;
-			cntVal = 0;
-		}
+
+/*
+ * Delay line. The LED colours of every picture are stored with their time stamp (ms) in a ring of entries in the CCM
+ * RAM behind the sampling matrix. The LEDs show the colours of tvprocDelayMs ago, interpolated between the two
+ * entries around that time. An entry is a time stamp word followed by the full 8 bit R, G, B of the LEDs
+ * (DELAY_ENTRY_WORDS), so dark gradients do not band: the ring holds 45 pictures at LEDS_MAXTOTAL, 94 at 150 LEDs.
+ * For long delays only one picture per tvprocDelayMs / (entries - 2) ms is stored, so the ring always spans the delay.
+ */
+#define		DELAY_POOL_BYTES	(0x10000 - MATRIX_TERMS * 4)
+
+static uint32_t		* const delayPool = (uint32_t *) (CCMDATARAM_BASE + MATRIX_TERMS * 4);
+static short		delayStride;			// words per entry
+static short		delayEntries;			// entries in the pool
+static short		delayNewest;			// index of the newest entry
+static short		delayCount;				// valid entries
+
+
+// number of pictures the delay line holds for the current LED count
+short ambiLightDelayEntries (void)
+{
+	return DELAY_POOL_BYTES / 4 / DELAY_ENTRY_WORDS (ledsPhysical);
+}
+
+
+static void ambiLightDelayStore (uint32_t ms)
+{
+	uint8_t *p;
+	short led;
+
+	if (delayLeds != ledsPhysical)
+	{
+		delayLeds = ledsPhysical;
+		delayStride = DELAY_ENTRY_WORDS (delayLeds);
+		delayEntries = ambiLightDelayEntries ();
+		delayNewest = delayCount = 0;
 	}
+	if (delayCount > 0 && ms - delayPool[delayNewest * delayStride] < (uint32_t)tvprocDelayMs / (delayEntries - 2))
+		return;					// long delay: keep the older pictures
 
-	ledIdx = ledsY + ledsX + ledsY;			// = bottom left
-	cntVal = 0;
-	rVal = gVal = bVal = 0;
-	dv = 0;
+	if (delayCount > 0 && ++delayNewest >= delayEntries)
+		delayNewest = 0;
+	if (delayCount < delayEntries)
+		delayCount++;
 
-	for (i = rgbImageHigh + rgbImageWid + rgbImageHigh; i < rgbImageHigh + rgbImageWid + rgbImageHigh + rgbImageWid; i++)
+	delayPool[delayNewest * delayStride] = ms;
+	p = (uint8_t *)&delayPool[delayNewest * delayStride + 1];
+	for (led = 0; led < delayLeds; led++, p += 3)
 	{
-		rVal += rgbImage[i].R;
-		gVal += rgbImage[i].G;
-		bVal += rgbImage[i].B;
-		cntVal++;
+		p[0] = rgbImage[led].R;
+		p[1] = rgbImage[led].G;
+		p[2] = rgbImage[led].B;
+	}
+}
+
 
-		dv += ledsX;
-		if (dv >= rgbImageWid)
+/*
+ * Store the LED colours of the picture taken at <ms> and output the delayed ones
+ */
+void ambiLightImage2LedRGB (uint32_t ms)
+{
+	uint32_t target = ms - tvprocDelayMs;
+	const uint8_t *p0, *p1;
+	short i, older, newer, n;
+	short ledIdx;
+	uint32_t f;
+
+	masterBrightness = 100;		// always 100% in ambi mode. Brightness can be set in TVP5150
+
+	ambiLightDelayStore (ms);
+
+	if (tvprocDelayMs == 0)		// no delay: current colours at full resolution
+	{
+		for (ledIdx = 0; ledIdx < ledsPhysical; ledIdx++)
 		{
-			while (dv >= rgbImageWid)
-			{
-				dv -= rgbImageWid;
-				tvprocRGBDelayFifo[tvprocDelayW][ledIdx].R = rVal / cntVal;
-				tvprocRGBDelayFifo[tvprocDelayW][ledIdx].G = gVal / cntVal;
-				tvprocRGBDelayFifo[tvprocDelayW][ledIdx].B = bVal / cntVal;
-				ledIdx++;
-			}
-			rVal = gVal = bVal = 0;
-			cntVal = 0;
+			ws2812ledRGB[ledIdx].R = rgbImage[ledIdx].R;
+			ws2812ledRGB[ledIdx].G = rgbImage[ledIdx].G;
+			ws2812ledRGB[ledIdx].B = rgbImage[ledIdx].B;
 		}
+		return;
 	}
 
-	i = tvprocDelayW - tvprocDelayTime;	// calculate read index within delay line
-	if (i < 0)
-		i += DELAY_LINE_SIZE;
-
-	for (ledIdx = 0; ledIdx < ledsPhysical; ledIdx++)		// copy delay entry to physical LED
+	older = newer = delayNewest;		// newest entry not after target and the one after it
+	for (n = 0, i = delayNewest; n < delayCount; n++)
 	{
-		ws2812ledRGB[ledIdx].R = tvprocRGBDelayFifo[i][ledIdx].R;
-		ws2812ledRGB[ledIdx].G = tvprocRGBDelayFifo[i][ledIdx].G;
-		ws2812ledRGB[ledIdx].B = tvprocRGBDelayFifo[i][ledIdx].B;
+		older = i;
+		if ((int32_t)(target - delayPool[i * delayStride]) >= 0)
+			break;
+		newer = i;
+		if (--i < 0)
+			i = delayEntries - 1;
 	}
+	if (n == delayCount)				// delay longer than the line: oldest picture
+		newer = older;
+
+	f = 0;								// weight of the newer entry (Q8)
+	if (newer != older)
+		f = ((target - delayPool[older * delayStride]) << 8)
+				/ (delayPool[newer * delayStride] - delayPool[older * delayStride]);
 
-	if (++tvprocDelayW >= DELAY_LINE_SIZE)		// prepare for next frame
-		tvprocDelayW = 0;
+	p0 = (const uint8_t *)&delayPool[older * delayStride + 1];
+	p1 = (const uint8_t *)&delayPool[newer * delayStride + 1];
+	for (ledIdx = 0; ledIdx < ledsPhysical; ledIdx++, p0 += 3, p1 += 3)
+	{
+		ws2812ledRGB[ledIdx].R = p0[0] + (((p1[0] - p0[0]) * (int32_t)f + 128) >> 8);
+		ws2812ledRGB[ledIdx].G = p0[1] + (((p1[1] - p0[1]) * (int32_t)f + 128) >> 8);
+		ws2812ledRGB[ledIdx].B = p0[2] + (((p1[2] - p0[2]) * (int32_t)f + 128) >> 8);
+	}
 }
 
 
@@ -25,6 +25,25 @@
 #define DYN_WIN_Y			10			// max +/- in Y
 #define DYN_WIN_X			10			// max +/- in X
 #define BLACK_LEVEL_SHIFT	10
+#define EDGE_DEPTH_MAX		11			// max slots sampled from the dyn border towards the center
+#define DELAY_MS_MAX		3000		// max LED delay (ms)
+#define DELAY_MS_STEP		20			// delay change per key press
+#define DELAY_ENTRY_WORDS(leds)	(1 + (3 * (leds) + 3) / 4)	// delay line entry: time stamp and 8 bit R, G, B per LED
+
+// lanes of the packed zone sums of ambiLightZoneSum (R bits 0..20, G 21..41, B 42..62)
+#define ZONE_LANE_BITS		21
+#define ZONE_LANE_MASK		((1UL << ZONE_LANE_BITS) - 1)
+#define ZONE_R(sum)			((long)((sum) & ZONE_LANE_MASK))
+#define ZONE_G(sum)			((long)(((sum) >> ZONE_LANE_BITS) & ZONE_LANE_MASK))
+#define ZONE_B(sum)			((long)((sum) >> (2*ZONE_LANE_BITS)))
+
+enum {
+	EDGE_KERNEL_EXP = 0,				// 2^(d-j): halves with every slot towards the center (original weighting)
+	EDGE_KERNEL_BOX,					// all slots the same
+	EDGE_KERNEL_GAUSS,					// Gaussian falling off from the dyn border
+	EDGE_KERNEL_CENTER,					// triangle, most weight in the middle of the band
+	EDGE_KERNELS
+};
 
 
 typedef struct {
@@ -40,12 +59,22 @@ typedef struct {
 	short			rgbConChange, rgbAvgChange;
 } dynRGBsum_t;
 
+typedef struct {
+	uint8_t		depth;				// slots sampled from the dyn border on (1..EDGE_DEPTH_MAX); 0 = frameWidth
+	uint8_t		kernel;				// EDGE_KERNEL_xxx
+} edgeKernel_t;
+
 extern void ambiLightInit (void);
 extern void ambiLightClearImage (void);
 extern void ambiLightSlots2Dyn (void);
 extern void ambiLightPrintDynInfos (void);
 extern void ambiLightDyn2Image (void);
-extern void ambiLightImage2LedRGB (void);
+extern void ambiLightBuildMatrix (void);
+extern uint64_t ambiLightZoneSum (short x0, short y0, short x1, short y1);
+extern void ambiLightBenchmark (void);
+extern short ambiLightEdgeDepth (uint8_t edge);
+extern void ambiLightImage2LedRGB (uint32_t ms);
+extern short ambiLightDelayEntries (void);
 extern int  ambiLightHandleIRcode ();
 
 void computeI (rgbIcontroller_t *pid, uint8_t r, uint8_t g, uint8_t b);
@@ -56,10 +85,12 @@ extern unsigned short		dynFramesLimit;	// pitschu v1.2: Added limit value
 
 extern short 	factorI;			// 128 = 1.0
 extern rgbIcontroller_t	rgbImage [];
+extern edgeKernel_t		edgeKernel [LED_EDGES];		// indexed by LED_EDGE_xxx
+extern unsigned long	matrixBuilds;			// number of sampling matrix compilations
+extern unsigned long	matrixBuildCycles;		// last compile
+extern unsigned long	matrixPassCycles;		// last pass over the matrix
 
-extern rgbValue_t 	tvprocRGBDelayFifo[DELAY_LINE_SIZE][LEDS_MAXTOTAL];			// for TV picture proc delays; up to 1 second
-extern short  	tvprocDelayW;				// delay FIFO write pointer
-extern short  	tvprocDelayTime;			// difference between write an read pointr
+extern short  	tvprocDelayMs;				// LED delay for the picture processing of the TV (0..DELAY_MS_MAX)
 
 
 #endif /* AMBILIGHT_H_ */
@@ -0,0 +1,161 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+
+#include <stdio.h>
+#include "string.h"
+#include "stm32f4xx.h"
+#include "apa102.h"
+#include "main.h"
+
+#if WS2812_APA102				// else WS2812 output of ws2812.c
+
+static uint8_t	apa102frame[APA102_MAXFRAME];				// SPI frame (start frame, LEDs, reset and end frame)
+
+
+
+// LED frame of 16 bit colours: global brightness << 24 | blue << 16 | green << 8 | red (without the 111 bits)
+uint32_t APA102ledFrame(uint16_t r, uint16_t g, uint16_t b)
+{
+	uint32_t max = (r > g ? r : g);
+	uint32_t bright, div;
+
+	if (b > max)
+		max = b;
+#if APA102_GLOBAL_DIM
+	bright = (max * 31 + 65534) / 65535;		// smallest brightness reaching the brightest channel
+	if (bright == 0)
+		return 0;
+#else
+	bright = 31;
+#endif
+	div = 65535 * bright;						// colour = c * 255 * 31 / (65535 * brightness), rounded
+
+	return (bright << 24)
+			| (((b * (255 * 31) + div / 2) / div) << 16)
+			| (((g * (255 * 31) + div / 2) / div) << 8)
+			| ((r * (255 * 31) + div / 2) / div);
+}
+
+
+
+
+// write the LED frame of one LED into the SPI frame
+void APA102encode(short led, uint32_t frame)
+{
+	uint8_t *p = &apa102frame[APA102_START_LEN + led * 4];
+
+	p[0] = 0xe0 | (frame >> 24);
+	p[1] = frame >> 16;				// blue
+	p[2] = frame >> 8;				// green
+	p[3] = frame;					// red
+}
+
+
+
+
+// send the frame of <leds> LEDs; the caller has set ledBusy
+void APA102start(short leds)
+{
+	DMA_InitTypeDef dma_init =
+	{
+			.DMA_BufferSize 		= APA102_FRAME_LEN(leds),
+			.DMA_Channel 			= APA102_DMA_CHANNEL,
+			.DMA_DIR 				= DMA_DIR_MemoryToPeripheral,
+			.DMA_FIFOMode 			= DMA_FIFOMode_Disable,
+			.DMA_FIFOThreshold 		= DMA_FIFOThreshold_HalfFull,
+			.DMA_Memory0BaseAddr 	= (uint32_t) &apa102frame[0],
+			.DMA_MemoryBurst 		= DMA_MemoryBurst_Single,
+			.DMA_MemoryDataSize 	= DMA_MemoryDataSize_Byte,
+			.DMA_MemoryInc 			= DMA_MemoryInc_Enable,
+			.DMA_Mode 				= DMA_Mode_Normal,
+			.DMA_PeripheralBaseAddr = (uint32_t) &APA102_SPI->DR,
+			.DMA_PeripheralBurst 	= DMA_PeripheralBurst_Single,
+			.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte,
+			.DMA_PeripheralInc 		= DMA_PeripheralInc_Disable,
+			.DMA_Priority 			= DMA_Priority_Medium
+	};
+
+	// reset and end frame behind the last LED (the strip may have been longer before)
+	memset(&apa102frame[APA102_START_LEN + leds * 4], 0, APA102_RESET_LEN + APA102_END_LEN(leds));
+
+	DMA_Cmd(APA102_DMA_STREAM, DISABLE);
+	while (DMA_GetCmdStatus(APA102_DMA_STREAM) == ENABLE)
+		; //wait
+	DMA_Init(APA102_DMA_STREAM, &dma_init);
+	DMA_Cmd(APA102_DMA_STREAM, ENABLE);
+	APA102_SPI->CR2 |= SPI_CR2_TXDMAEN;
+}
+
+
+
+
+// gets called when the last byte was written to the SPI
+void DMA1_Stream4_IRQHandler(void)
+{
+	DMA_ClearITPendingBit(APA102_DMA_STREAM, DMA_IT_TCIF4);
+	DMA_Cmd(APA102_DMA_STREAM, DISABLE);
+	APA102_SPI->CR2 &= ~SPI_CR2_TXDMAEN;
+
+	ledBusy = 0;			// get ready for next transfer
+}
+
+
+
+
+void APA102init(void)
+{
+	GPIO_InitTypeDef GPIO_InitStructure;
+	NVIC_InitTypeDef nvic_init;
+	int i;
+
+	for (i = 0; i < LEDS_MAXTOTAL; i++)			// all LEDs black
+		APA102encode(i, 0);
+
+	// GPIO
+	RCC_AHB1PeriphClockCmd(APA102_RCC_GPIO, ENABLE);
+	GPIO_InitStructure.GPIO_Pin = APA102_PINS;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;
+	GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
+	GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
+	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+	GPIO_Init(APA102_GPIO, &GPIO_InitStructure);
+	GPIO_PinAFConfig(APA102_GPIO, GPIO_PinSource13, APA102_GPIO_AF);
+	GPIO_PinAFConfig(APA102_GPIO, GPIO_PinSource15, APA102_GPIO_AF);
+
+	// SPI: master, transmit only, 8 bit, MSB first, clock low when idle, data on the rising edge
+	RCC_APB1PeriphClockCmd(APA102_RCC_SPI, ENABLE);
+	APA102_SPI->CR1 = SPI_CR1_BIDIMODE | SPI_CR1_BIDIOE | SPI_CR1_SSM | SPI_CR1_SSI | SPI_CR1_MSTR | APA102_PRESCALER;
+	APA102_SPI->CR2 = 0;
+	APA102_SPI->CR1 |= SPI_CR1_SPE;
+
+	// DMA
+	RCC_AHB1PeriphClockCmd(APA102_RCC_DMA, ENABLE);
+	DMA_ITConfig(APA102_DMA_STREAM, DMA_IT_TC, ENABLE);
+
+	// NVIC for DMA
+	nvic_init.NVIC_IRQChannel = DMA1_Stream4_IRQn;
+	nvic_init.NVIC_IRQChannelPreemptionPriority = 1;
+	nvic_init.NVIC_IRQChannelSubPriority = 1;
+	nvic_init.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&nvic_init);
+
+	printf("LED output: APA102 / SK9822 on SPI at %d kHz, frame %d bytes for %d LEDs\n", APA102_CLOCK_KHZ,
+			(int)sizeof (apa102frame), LEDS_MAXTOTAL);
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+
+#ifndef APA102_H
+#define APA102_H
+
+#include "ws2812.h"
+
+/*
+ * Output to APA102 / SK9822 LEDs (WS2812_APA102 = 1 in ws2812.h) instead of WS2812. The LEDs get the same colours
+ * (ws2812ledRGB, overlays, gamma, masterBrightness) as a WS2812 strip; the SPI clock makes the timing uncritical and
+ * a frame of 312 LEDs takes 1.9 ms at 5.25 MHz instead of 9.4 ms.
+ *
+ * SPI frame (MSB first, data valid on the rising clock edge):
+ *	start frame		32 bits 0
+ *	LED frame		111 + 5 bit global brightness, blue, green, red; one per LED
+ *	reset frame		32 bits 0 (SK9822 latches the colours with it; an APA102 ignores it)
+ *	end frame		at least n/2 bits 0 for n LEDs: each LED delays the data by half a clock
+ *
+ * The colours are computed with 16 bits. With APA102_GLOBAL_DIM the 5 bit brightness of every LED is the smallest
+ * one which reaches its brightest channel, and the 8 bit colours are scaled up by 31 / brightness: dark LEDs get up
+ * to 31 times finer steps than with 8 bit colours at full brightness.
+ */
+#define APA102_GLOBAL_DIM		1					// 0 = brightness always 31 (8 bit colours only)
+
+#define APA102_SPI				SPI2				// SCK = PB13, MOSI = PB15
+#define APA102_RCC_SPI			RCC_APB1Periph_SPI2
+#define APA102_PRESCALER		SPI_CR1_BR_1		// APB1 42 MHz / 8 = 5.25 MHz
+#define APA102_CLOCK_KHZ		5250
+#define APA102_GPIO				GPIOB
+#define APA102_RCC_GPIO			RCC_AHB1Periph_GPIOB
+#define APA102_PINS				(GPIO_Pin_13 | GPIO_Pin_15)
+#define APA102_GPIO_AF			GPIO_AF_SPI2
+
+#define APA102_RCC_DMA			RCC_AHB1Periph_DMA1
+#define APA102_DMA_STREAM		DMA1_Stream4		// SPI2_TX
+#define APA102_DMA_CHANNEL		DMA_Channel_0
+
+#define APA102_START_LEN		4									// bytes
+#define APA102_RESET_LEN		4
+#define APA102_END_LEN(n)		(((n) + 15) / 16)
+#define APA102_FRAME_LEN(n)		(APA102_START_LEN + (n) * 4 + APA102_RESET_LEN + APA102_END_LEN(n))
+#define APA102_MAXFRAME			APA102_FRAME_LEN(LEDS_MAXTOTAL)
+
+// ----------------------------- functions -----------------------------
+void APA102init(void);
+uint32_t APA102ledFrame(uint16_t r, uint16_t g, uint16_t b);
+void APA102encode(short led, uint32_t frame);
+void APA102start(short leds);
+
+#endif
@@ -85,6 +85,23 @@ void SysTick_Handler(void)		// runs 100Hz systemm ticker and checks blue user bu
 
 
 
+// milliseconds since start: system_time plus the elapsed part of the current SysTick period
+
+uint32_t system_millis(void)
+{
+	uint32_t t, v;
+
+	do {
+		t = system_time;
+		v = SysTick->VAL;
+	} while (t != system_time);			// ticked in between: VAL may belong to the next period
+
+	return t * 10 + (SysTick->LOAD - v) * 10 / (SysTick->LOAD + 1);
+}
+
+
+
+
 // TIM4 is used for delay_ms() or delay_us() functions.
 
 void DelayCountInit(void)
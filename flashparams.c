@@ -44,7 +44,7 @@ static uint8_t		*blockAddr = (uint8_t*)PARAM_FLASH_START;
 static uint16_t		blockSize;			// # of bytes in parameter flash block (without CRC bytes)
 
 #define	FLASH_SIGNATURE			((long)('P'<<24) |	(long)('.'<<16) | (long)('S'<<8) | (long)('.'<<0) )
-#define FLASH_VERSION			135
+#define FLASH_VERSION			144
 
 
 const flashParam_t flashParams[] = {
@@ -52,7 +52,7 @@ const flashParam_t flashParams[] = {
 		{(uint8_t*)&rgbImageHigh		, sizeof (rgbImageHigh)},
 		{(uint8_t*)&factorI				, sizeof (factorI)},
 		{(uint8_t*)&frameWidth			, sizeof (frameWidth)},
-		{(uint8_t*)&tvprocDelayTime		, sizeof (tvprocDelayTime)},
+		{(uint8_t*)&tvprocDelayMs		, sizeof (tvprocDelayMs)},
 		{(uint8_t*)&Hue_control			, sizeof (Hue_control)},
 		{(uint8_t*)&Brightness			, sizeof (Brightness)},
 		{(uint8_t*)&Color_saturation	, sizeof (Color_saturation)},
@@ -70,6 +70,15 @@ const flashParam_t flashParams[] = {
 		{(uint8_t*)&moodLightDIYcolor[0], sizeof (moodLightDIYcolor)},
 		{(uint8_t*)&moodLightSinusDIY[0], sizeof (moodLightSinusDIY)},
 		{(uint8_t*)&dynFramesLimit 		, sizeof (dynFramesLimit)},
+		{(uint8_t*)&captureMode			, sizeof (captureMode)},
+		{(uint8_t*)&colorMatrix			, sizeof (colorMatrix)},
+		{(uint8_t*)&slotProfile			, sizeof (slotProfile)},
+		{(uint8_t*)&captureEdgeBands	, sizeof (captureEdgeBands)},
+		{(uint8_t*)&videoSystem			, sizeof (videoSystem)},
+		{(uint8_t*)&cropProfiles[0]		, sizeof (cropProfiles)},
+		{(uint8_t*)&ledLayout[0]		, sizeof (ledLayout)},
+		{(uint8_t*)&edgeKernel[0]		, sizeof (edgeKernel)},
+		{(uint8_t*)&ws2812gamma			, sizeof (ws2812gamma)},
 
 // Add what ever parameter you want to be saved to flash
 		{(uint8_t*)0, 0},
@@ -0,0 +1,258 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+
+#include <stdio.h>
+#include "stm32f4xx.h"
+#include "hardware.h"
+#include "ws2812.h"
+#include "stm32_ub_usb_cdc.h"
+#include "tvp5150_dcmi.h"
+#include "framestream.h"
+
+/*
+ * Recording of the captured frames to the host over the USB CDC port (see framestream.h for the format).
+ *
+ * framestreamSend() is called by main() after the LEDs of a frame were updated and writes the frame acquired by
+ * main() into the CDC transmit buffer. The capture and conversion IRQs are never touched: if the host reads too
+ * slowly, main() simply skips the frames published meanwhile (counted in framesDropped). A record that cannot be
+ * written within FS_TX_TIMEOUT is cut off; the host detects it by the CRC and resyncs on the next sync bytes.
+ *
+ * The payload is encoded twice, first only counting bytes to get its length for the header, then sending it.
+ * This needs no output buffer; the delta bytes are computed on the fly from the frame.
+ */
+
+#define		FS_TX_TIMEOUT		5				// system_time ticks (10 ms) to wait for free TX space
+
+unsigned char		framestreamMode = FS_OFF;	// not stored in flash; recording is switched on per session
+unsigned long		framestreamFrames = 0;
+unsigned long		framestreamAborts = 0;
+
+static const uint8_t	*fsSrc;					// RGB bytes of the frame being sent
+static uint16_t			fsCount;				// bytes counted in sizing pass
+static uint8_t			fsSizing;				// 1 = only count bytes
+static uint8_t			fsFailed;				// TX timed out; drop rest of record
+
+static uint8_t			rawBuf [RAW_ROW_BYTES];
+static short			rawNext = 0;			// next raw row to request
+static uint8_t			rawPending = 0;
+
+
+
+// write one byte to the CDC TX buffer; waits for space
+static void fsPutRaw (uint8_t b)
+{
+	if (fsFailed)
+		return;
+
+	if (UB_VCP_TxFree() == 0)
+	{
+		uint32_t t0 = system_time;
+
+		while (UB_VCP_TxFree() == 0)
+		{
+			if (system_time - t0 > FS_TX_TIMEOUT)
+			{
+				fsFailed = 1;
+				return;
+			}
+		}
+	}
+	UB_VCP_DataTx (b);
+}
+
+
+// record byte covered by the CRC (or only counted in sizing pass)
+static void fsPut (uint8_t b)
+{
+	if (fsSizing)
+	{
+		fsCount++;
+		return;
+	}
+	CRC_CalcCRC ((uint32_t)b);
+	fsPutRaw (b);
+}
+
+
+static void fsPut16 (uint16_t v)
+{
+	fsPut (v & 0xff);
+	fsPut (v >> 8);
+}
+
+
+static void fsPut32 (uint32_t v)
+{
+	fsPut16 (v & 0xffff);
+	fsPut16 (v >> 16);
+}
+
+
+// byte <i> of the planar row stream as difference to the same colour of the left slot
+static inline uint8_t fsDelta (uint16_t i)
+{
+	uint16_t row = i / (SLOTS_X * 3);
+	uint16_t c = (i / SLOTS_X) % 3;
+	uint16_t x = i % SLOTS_X;
+	const uint8_t *p = &fsSrc[(row * SLOTS_X + x) * 3 + c];
+
+	if (x == 0)
+		return p[0];
+	return p[0] - p[-3];
+}
+
+
+static void fsLiterals (uint16_t start, uint16_t cnt)
+{
+	while (cnt > 0)
+	{
+		uint16_t k = (cnt > FS_RLE_MAXLIT ? FS_RLE_MAXLIT : cnt);
+
+		fsPut (k - 1);
+		cnt -= k;
+		while (k-- > 0)
+			fsPut (fsDelta (start++));
+	}
+}
+
+
+// PackBits coding of the <n> delta bytes of the frame
+static void fsRle (uint16_t n)
+{
+	uint16_t i = 0;
+	uint16_t litStart = 0;
+
+	while (i < n)
+	{
+		uint8_t b = fsDelta (i);
+		uint16_t run = 1;
+
+		while (i + run < n && run < FS_RLE_MAXRUN && fsDelta (i + run) == b)
+			run++;
+
+		if (run >= FS_RLE_MINRUN)
+		{
+			fsLiterals (litStart, i - litStart);
+			fsPut (run + 0x7d);
+			fsPut (b);
+			litStart = i + run;
+		}
+		i += run;
+	}
+	fsLiterals (litStart, n - litStart);
+}
+
+
+static void fsBegin (uint8_t type, uint8_t flags, uint32_t seq, uint16_t len)
+{
+	fsSizing = 0;
+	fsFailed = 0;
+
+	fsPutRaw (FS_SYNC0);
+	fsPutRaw (FS_SYNC1);
+	CRC_ResetDR();
+	fsPut (type);
+	fsPut (flags);
+	fsPut32 (seq);
+	fsPut16 (len);
+}
+
+
+static void fsEnd (void)
+{
+	uint32_t crc = CRC_GetCRC();
+
+	fsPutRaw (crc & 0xff);
+	fsPutRaw ((crc >> 8) & 0xff);
+	fsPutRaw ((crc >> 16) & 0xff);
+	fsPutRaw (crc >> 24);
+
+	if (fsFailed)
+		framestreamAborts++;
+	else
+		framestreamFrames++;
+}
+
+
+static void fsSendRGB (void)
+{
+	uint16_t n = SLOTS_X * SLOTS_Y * 3;
+	uint16_t i;
+	uint8_t flags = FS_FLAG_DELTA;
+
+	fsSrc = (const uint8_t *)rgbSlots;
+
+	fsSizing = 1;
+	fsCount = 0;
+	fsRle (n);
+	if (fsCount < n)
+		flags |= FS_FLAG_RLE;
+	else
+		fsCount = n;
+
+	fsBegin (FS_TYPE_RGB, flags, rgbFrameSeq, fsCount + 2);
+	fsPut (SLOTS_X);
+	fsPut (SLOTS_Y);
+	if (flags & FS_FLAG_RLE)
+		fsRle (n);
+	else
+		for (i = 0; i < n; i++)
+			fsPut (fsDelta (i));
+	fsEnd ();
+}
+
+
+// one row of raw slot sums per frame; rows are requested round robin
+static void fsSendRawRow (void)
+{
+	short row;
+	uint16_t i;
+
+	if (!rawPending)
+	{
+		TVP5150requestRawRow (rawNext);
+		rawPending = 1;
+		return;
+	}
+
+	row = TVP5150getRawRow (rawBuf);
+	if (row < 0)
+		return;
+
+	rawPending = 0;
+	rawNext = (row + 1) % SLOTS_Y;
+
+	fsBegin (FS_TYPE_RAWROW, 0, rgbFrameSeq, RAW_ROW_BYTES + 2);
+	fsPut (row);
+	fsPut (SLOTS_X);
+	for (i = 0; i < RAW_ROW_BYTES; i++)
+		fsPut (rawBuf[i]);
+	fsEnd ();
+}
+
+
+// send the frame acquired by main() (and a raw row) if recording is on; main loop only
+void framestreamSend (void)
+{
+	if (framestreamMode == FS_OFF || UB_USB_CDC_GetStatus() != USB_CDC_CONNECTED)
+		return;
+
+	fsSendRGB ();
+	if (framestreamMode == FS_RGB_RAW)
+		fsSendRawRow ();
+}
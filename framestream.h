@@ -0,0 +1,74 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+
+#ifndef FRAMESTREAM_H_
+#define FRAMESTREAM_H_
+
+#include <stdint.h>
+
+/*
+ * Record layout on the wire (all numbers little endian). This file is also included by tools/ambitool.c,
+ * so keep it free of MCU headers.
+ *
+ *	0xA5 0x5A		sync
+ *	type			FS_TYPE_...
+ *	flags			FS_FLAG_...
+ *	seq				4 bytes; frame id (rgbFrameSeq)
+ *	len				2 bytes; payload length
+ *	payload			<len> bytes
+ *	crc				4 bytes; CRC-32 of type..payload as computed by the STM32 CRC unit when every byte is
+ *					fed as one 32 bit word (poly 0x04C11DB7, init 0xFFFFFFFF, no reflection, no final xor)
+ *
+ * FS_TYPE_RGB payload: width, height, then the slots row by row; each row as width red, width green and width
+ * blue bytes. With FS_FLAG_DELTA each byte holds the difference (mod 256) to the left neighbour slot (0 for the
+ * first slot of a row), so flat areas and smooth gradients give runs of equal bytes. With
+ * FS_FLAG_RLE the bytes are PackBits coded: control byte c < 0x80 is followed by c+1 literal bytes, c >= 0x80 by
+ * one byte repeated c-0x7D times (3..130).
+ *
+ * FS_TYPE_RAWROW payload: slot row index, width, then width slot sums (CbCr u32, Y u16, cnt u16) of that row.
+ * One row is sent per frame; the host gets all rows of a still picture after SLOTS_Y frames.
+ */
+#define		FS_SYNC0			0xA5
+#define		FS_SYNC1			0x5A
+#define		FS_HEADER_SIZE		10					// sync .. len
+#define		FS_CRC_SIZE			4
+
+#define		FS_TYPE_RGB			1
+#define		FS_TYPE_RAWROW		2
+
+#define		FS_FLAG_DELTA		0x01
+#define		FS_FLAG_RLE			0x02
+
+#define		FS_RLE_MAXLIT		128
+#define		FS_RLE_MINRUN		3
+#define		FS_RLE_MAXRUN		130
+
+typedef enum {
+	FS_OFF = 0,
+	FS_RGB,					// RGB frames only
+	FS_RGB_RAW,				// RGB frames plus one row of raw slot sums per frame
+	FS_MODES
+} framestreamMode_e;
+
+extern unsigned char		framestreamMode;
+extern unsigned long		framestreamFrames;		// records sent
+extern unsigned long		framestreamAborts;		// records cut off because the host did not read
+
+void framestreamSend (void);
+
+#endif /* FRAMESTREAM_H_ */
@@ -30,7 +30,7 @@
 #include "i2c1.h"
 #include "stdio.h"
 
-#define CORE_CycleCounEn()    ((*((u32*)0xE0001000)) |= 1)
+#define CORE_CycleCounEn()    (CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk, (*((u32*)0xE0001000)) |= 1)
 #define CORE_CycleCounDis()   ((*((u32*)0xE0001000)) &= ~1)
 #define CORE_GetCycleCount()   (*((u32*)0xE0001004))
 
@@ -141,6 +141,14 @@ typedef enum
 #define AUDIO_RESET_PIN                GPIO_Pin_4
 #define AUDIO_RESET_GPIO               GPIOD
 
+/* Pins used on the Discovery board and by this firmware, per port: for compile time checks of optional outputs
+ * (ws2812par.h). None of the ports A..E has a free byte. */
+#define BOARD_PINS_A                   0x7EF1		// PA0 button, PA4/6 DCMI, PA5/7 MEMS SPI, PA9..12 USB, PA13/14 SWD
+#define BOARD_PINS_B                   0xA7CA		// PB1 debug, PB3 SWO, PB6/7 DCMI, PB8/9 I2C1, PB10 mic, PB13/15 APA102
+#define BOARD_PINS_C                   0xD7C9		// PC0 USB power, PC3 mic, PC6..9 DCMI, PC10/12 I2S3, PC14/15 LSE
+#define BOARD_PINS_D                   0xF330		// PD4 audio reset, PD5 USB over-current, PD8/9 USART3, PD12..15 LEDs
+#define BOARD_PINS_E                   0xFA7B		// PE0/1/3 MEMS, PE4..6 DCMI, PE9 IR, PE11..15 TVP5150
+
 
 void STM_EVAL_LEDInit(Led_TypeDef Led);
 void STM_EVAL_LEDOn(Led_TypeDef Led);
@@ -164,6 +172,7 @@ void BoardHardwareInit(void);
 // externs in delay.c
 extern volatile uint32_t system_time;
 void init_systick(void);
+uint32_t system_millis(void);
 void DelayCountInit(void);
 void delay_us(uint32_t time_us);
 void delay_ms(uint16_t time_ms);
@@ -36,6 +36,7 @@
 #include "moodLight.h"
 #include "stm32_ub_usb_cdc.h"
 #include "flashparams.h"
+#include "framestream.h"
 
 
 extern void IRdecoderInit(void);
@@ -125,6 +126,7 @@ int main(void)
 	ambiLightInit();
 
 	initFlashParamBlock();			// check for valid flash parameter block
+	WS2812layoutUpdate();			// LED count of the layout read from flash
 
 	checkForParamChanges ();		// calc param CRC for later checks
 	flashUpdateTimer = UINT32_MAX;	// no need to update now
@@ -180,7 +182,11 @@ int main(void)
 					}
 				}
 				else
+				{
 					videoOffCount = 5;
+					if (TVP5150checkStandard() != 0)		// PAL <-> NTSC: crop values changed
+						ambiLightInit();					// flush dyn arrays
+				}
 
 				if (checkForParamChanges() != 0)		// some parameter was changed -> delay flash write; maybe other changes follow
 					flashUpdateTimer = system_time + 800;
@@ -314,18 +320,19 @@ int main(void)
 		/*
 		 * A new frame has been captured. Transform raw RGB values to scaled image
 		 */
+		captureReady = 0;
+		TVP5150acquireFrame();			// take latest frame; rgbSlots points to it
+
 		STM_EVAL_LEDOn(LED_BLU);
 		ambiLightSlots2Dyn();			// update dyn matrix and find the non-black area
 		STM_EVAL_LEDToggle (LED_BLU);
 		ambiLightDyn2Image();			// transform the non-black area to the virtual X * Y image
 		STM_EVAL_LEDToggle (LED_BLU);
 
-		captureReady = 0;
-
 		if (mainMode == MODE_AMBILIGHT)
 		{
 			if (videoOffCount >= 5)			// we have a good video signal
-				ambiLightImage2LedRGB();	// expand the virtual image to the physical LED image
+				ambiLightImage2LedRGB(system_millis());	// delayed LED colours to the physical LEDs
 
 			STM_EVAL_LEDToggle (LED_BLU);
 
@@ -334,6 +341,8 @@ int main(void)
 			WS2812update();
 		}
 		STM_EVAL_LEDOff    (LED_BLU);
+
+		framestreamSend();				// record frame to host if enabled (after LED update; may wait for USB)
 	}
 
 }
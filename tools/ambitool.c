@@ -0,0 +1,201 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+/*
+ * Host side of the frame recording (see ../framestream.h for the record format).
+ *
+ *	ambitool rec <tty> <file> [records]		read records from the CDC port and append the valid ones to <file>
+ *	ambitool dump <file>					list the records of a recording and check that they decode
+ *
+ * Build on Linux:	make -C tools build/ambitool	(see tools/Makefile)
+ *
+ * Without a board, a pty pair stands in for the USB link:
+ *	socat -d -d pty,raw,echo=0 pty,raw,echo=0		(prints two /dev/pts/N names)
+ * then run "ambitool rec" on one end and write records (e.g. an earlier recording) to the other.
+ */
+
+#ifndef __arm__				// host program, empty in the firmware build (see tools/Makefile)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "../framestream.h"
+#include "recfile.h"
+
+
+static volatile sig_atomic_t	stop = 0;
+
+
+static void onSignal (int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+
+static int cmdRec (const char *tty, const char *file, unsigned long maxRecords)
+{
+	static uint8_t buf[2 * MAX_RECORD];
+	size_t fill = 0;
+	unsigned long records = 0, crcErrors = 0, skipped = 0;
+	struct termios tio;
+	FILE *out;
+	int fd;
+
+	fd = open (tty, O_RDWR | O_NOCTTY);
+	if (fd < 0)
+	{
+		perror (tty);
+		return 1;
+	}
+	if (tcgetattr (fd, &tio) == 0)			// not a tty (e.g. a fifo) is fine too
+	{
+		cfmakeraw (&tio);
+		tio.c_cc[VMIN] = 1;
+		tio.c_cc[VTIME] = 0;
+		tcsetattr (fd, TCSANOW, &tio);
+	}
+	out = fopen (file, "ab");
+	if (out == NULL)
+	{
+		perror (file);
+		close (fd);
+		return 1;
+	}
+
+	signal (SIGINT, onSignal);
+	signal (SIGTERM, onSignal);
+
+	while (!stop && (maxRecords == 0 || records < maxRecords))
+	{
+		ssize_t r = read (fd, buf + fill, sizeof (buf) - fill);
+		size_t used;
+
+		if (r <= 0)
+			break;
+		fill += r;
+
+		for (;;)
+		{
+			record_t rec;
+			size_t start = 0;
+
+			used = parseRecord (buf, fill, &rec, &start, &crcErrors);
+			if (used == 0)
+				break;
+			if (rec.payload != NULL)
+			{
+				skipped += start;
+				fwrite (buf + start, 1, used - start, out);
+				records++;
+			}
+			else
+				skipped += used;
+			memmove (buf, buf + used, fill - used);
+			fill -= used;
+			if (rec.payload == NULL || (maxRecords != 0 && records >= maxRecords))
+				break;
+		}
+		if (fill == sizeof (buf))		// cannot happen with valid lengths; drop garbage
+		{
+			skipped += fill;
+			fill = 0;
+		}
+	}
+
+	fclose (out);
+	close (fd);
+	fprintf (stderr, "%lu records, %lu CRC errors, %lu bytes skipped\n", records, crcErrors, skipped);
+	return 0;
+}
+
+
+static int cmdDump (const char *file)
+{
+	static recReader_t in;
+	static uint8_t rgb[MAX_SLOTS * 3];
+	unsigned long records = 0, bad = 0;
+	uint32_t lastSeq = 0;
+	record_t rec;
+
+	if (!recOpen (&in, file))
+		return 1;
+
+	while (recRead (&in, &rec))
+	{
+		records++;
+		if (rec.type == FS_TYPE_RGB)
+		{
+			int w, h, i;
+			unsigned long sum[3] = {0, 0, 0};
+
+			if (decodeRGB (&rec, rgb, &w, &h))
+			{
+				for (i = 0; i < w * h * 3; i++)
+					sum[i % 3] += rgb[i];
+				printf ("%8u RGB   %2dx%-2d %5u bytes%s%s  avg %3lu %3lu %3lu%s\n", rec.seq, w, h, rec.len,
+						rec.flags & FS_FLAG_DELTA ? " delta" : "", rec.flags & FS_FLAG_RLE ? " rle" : "",
+						sum[0] / (w*h), sum[1] / (w*h), sum[2] / (w*h),
+						(lastSeq != 0 && rec.seq != lastSeq + 1) ? "  (gap)" : "");
+			}
+			else
+			{
+				printf ("%8u RGB   decode error\n", rec.seq);
+				bad++;
+			}
+			lastSeq = rec.seq;
+		}
+		else if (rec.type == FS_TYPE_RAWROW && rec.len >= 2 && rec.len == 2 + rec.payload[1] * 8)
+		{
+			int i;
+			unsigned long cnt = 0;
+
+			for (i = 0; i < rec.payload[1]; i++)
+				cnt += rec.payload[2 + i*8 + 6] | (rec.payload[2 + i*8 + 7] << 8);
+			printf ("%8u RAW   row %2d, %lu pixel pairs\n", rec.seq, rec.payload[0], cnt);
+		}
+		else
+		{
+			printf ("%8u type %d, %u bytes (unknown)\n", rec.seq, rec.type, rec.len);
+			bad++;
+		}
+	}
+
+	recClose (&in);
+	printf ("%lu records, %lu bad, %lu CRC errors\n", records, bad, in.crcErrors);
+	return (bad != 0 || in.crcErrors != 0);
+}
+
+
+int main (int argc, char **argv)
+{
+	if (argc >= 4 && strcmp (argv[1], "rec") == 0)
+		return cmdRec (argv[2], argv[3], argc > 4 ? strtoul (argv[4], NULL, 0) : 0);
+	if (argc == 3 && strcmp (argv[1], "dump") == 0)
+		return cmdDump (argv[2]);
+
+	fprintf (stderr, "usage: ambitool rec <tty> <file> [records]\n"
+					 "       ambitool dump <file>\n");
+	return 2;
+}
+
+#endif
@@ -0,0 +1,490 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+/*
+ * Runs the capture path of tvp5150_dcmi.c unmodified on a Linux host: synthetic video is written into the DCMI
+ * DMA line buffers exactly as DMA2 stream 1 would deliver them, and the line IRQ (DMA2_Stream1_IRQHandler), the
+ * VSYNC IRQ (DCMI_IRQHandler) and the deferred conversion (PendSV_Handler) are called as the NVIC would.
+ *
+ *	capsim [options] bars|gradient|letterbox|flash|noise
+ *		-n			NTSC geometry (262 lines per field; TVP5150 reports NTSC) instead of PAL
+ *		-f <n>		fields to simulate (default 200)
+ *		-m <mode>	capture mode split|full|auto (default auto)
+ *		-b			edge band capture with the bands set by ambiLight for frameWidth 4
+ *		-u			slot widths finer at the edges (slotProfile)
+ *		-o <file>	write the captured RGB frames as frame records (see ../framestream.h; for replay)
+ *
+ * Every captured picture is compared bit by bit with a reference that sums the same pixels in plain C (without
+ * DMA buffers, SIMD kernel, edge bands or the IRQ row stepping); the time per line IRQ, VSYNC IRQ and picture
+ * conversion is measured on the host.
+ *
+ * The peripheral and Cortex-M system address ranges are mapped as plain memory at their real addresses, so the
+ * StdPeriph driver and the IRQ handlers run unchanged on these "registers". Instead of hardware, this program
+ * reads the crop window from the DCMI registers, fills the buffer selected by the CT bit, counts down NDTR,
+ * switches buffers and sets the TC flag. The buffer addresses in M0AR/M1AR are truncated on a 64 bit host and
+ * not used. The cycle counter does not run, so the AUTO mode never falls back to split mode.
+ *
+ * Build on Linux:	make -C tools build/capsim	(see tools/Makefile)
+ */
+
+#ifndef __arm__				// host program, empty in the firmware build (see tools/Makefile)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../tvp5150_dcmi.c"			// the capture module itself, including its static data
+#include "ambiLight.h"
+#include "recfile.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE		0x100000
+#endif
+
+#define		HOST_PERIPH_SIZE	(DCMI_BASE + 0x400 - PERIPH_BASE)
+#define		HOST_CORE_BASE		0xE0000000UL
+#define		HOST_CORE_SIZE		0x00100000UL
+
+#define		ACT_X0				160				// first byte of active video after HSYNC (= minimum cropLeft)
+#define		ACT_PIXELS			720
+
+enum { PAT_BARS = 0, PAT_GRADIENT, PAT_LETTERBOX, PAT_FLASH, PAT_NOISE, PATTERNS };
+
+typedef struct {
+	uint8_t		Y, Cb, Cr;
+} ycc_t;
+
+static const char *patternNames[PATTERNS] = {"bars", "gradient", "letterbox", "flash", "noise"};
+
+// 75% colour bars: white, yellow, cyan, green, magenta, red, blue, black
+static const ycc_t colorBars[8] = {
+		{180, 128, 128}, {162, 44, 142}, {131, 156, 44}, {112, 72, 58},
+		{84, 184, 198}, {65, 100, 212}, {35, 212, 114}, {16, 128, 128}
+};
+
+static const ycc_t black = {16, 128, 128};
+
+uint32_t		hostPrimask = 0;
+uint32_t		SystemCoreClock = 168000000;
+
+static int		pattern;
+static uint8_t	statusR8C = 0x03;				// TVP5150 autoswitch result: PAL
+static short	fieldLines = 312;
+static short	activeTop = 23;					// first line of active video in a field
+static short	activeLines = 288;
+
+// reference sums of the running picture
+static uint32_t	refY[SLOTS_Y][SLOTS_X], refCb[SLOTS_Y][SLOTS_X], refCr[SLOTS_Y][SLOTS_X], refCnt[SLOTS_Y][SLOTS_X];
+static rgbValue_t	expected[SLOTS_Y][SLOTS_X];
+static uint32_t	expectedCnt[SLOTS_Y][SLOTS_X];
+static short	expectedValid = 0;
+static short	wordSlot[LINE_WIDTH];			// slot of each DMA word of the running field; -1 = none
+
+static double	timeLine, timeVsync, timeConv;
+static unsigned long	lineIrqs, vsyncIrqs, pendSVs;
+
+
+
+/*
+ * Stubs of the modules tvp5150_dcmi.c calls but which are not simulated
+ */
+int16_t I2C_ReadByte (uint8_t slave_adr, uint8_t adr)
+{
+	(void)slave_adr;
+	if (adr == R8C_Status_register_5)
+		return statusR8C;
+	if (adr == R88_Status_register_1)
+		return 0x0e;			// locked
+	return 0;
+}
+
+int16_t I2C_WriteByte (uint8_t slave_adr, uint8_t adr, uint8_t wert)
+{
+	(void)slave_adr;
+	(void)adr;
+	(void)wert;
+	return 0;
+}
+
+void STM_EVAL_LEDOn (Led_TypeDef Led) { (void)Led; }
+void STM_EVAL_LEDOff (Led_TypeDef Led) { (void)Led; }
+void delay_ms (uint16_t time_ms) { (void)time_ms; }
+
+int put_c2Host (char c)
+{
+	putchar (c);
+	return 0;
+}
+
+
+static double now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static int mapRegion (unsigned long base, unsigned long size)
+{
+	void *p = mmap ((void*)base, size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE | MAP_NORESERVE, -1, 0);
+
+	if (p != (void*)base)
+	{
+		fprintf (stderr, "cannot map register space at 0x%08lx\n", base);
+		return 0;
+	}
+	return 1;
+}
+
+
+static uint32_t hash (uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+
+// colour of pixel <px> (0 = first active pixel) in field line <line>
+static ycc_t patternPixel (unsigned long field, short line, int px)
+{
+	int vy = line - activeTop;
+	ycc_t c;
+
+	if (px < 0 || px >= ACT_PIXELS || vy < 0 || vy >= activeLines)
+		return black;
+
+	switch (pattern)
+	{
+	case PAT_LETTERBOX:
+		if (vy < activeLines / 8 || vy >= activeLines * 7 / 8)
+			return black;
+		return colorBars[px * 8 / ACT_PIXELS];
+
+	case PAT_GRADIENT:
+		c.Y = 16 + ((px + field * 4) % ACT_PIXELS) * 219 / (ACT_PIXELS - 1);
+		c.Cb = 16 + vy * 224 / (activeLines - 1);
+		c.Cr = 240 - px * 224 / (ACT_PIXELS - 1);
+		return c;
+
+	case PAT_FLASH:
+		if ((field / 3) & 1)
+		{
+			c.Y = 235;
+			c.Cb = c.Cr = 128;
+			return c;
+		}
+		return black;
+
+	case PAT_NOISE:
+	{
+		uint32_t h = hash ((field << 20) ^ (line << 10) ^ px);
+
+		c.Y = 16 + (h & 0xff) * 219 / 255;
+		c.Cb = 16 + ((h >> 8) & 0xff) * 224 / 255;
+		c.Cr = 16 + ((h >> 16) & 0xff) * 224 / 255;
+		return c;
+	}
+
+	default:
+		return colorBars[px * 8 / ACT_PIXELS];
+	}
+}
+
+
+// DMA word for byte offset <b> (from HSYNC) of a line: Cb Y0 Cr Y1 of two pixels
+static YCbCr_t patternWord (unsigned long field, short line, int b)
+{
+	int px = (b - ACT_X0) / 2;
+	ycc_t p0 = patternPixel (field, line, px);
+	ycc_t p1 = patternPixel (field, line, px + 1);
+	YCbCr_t w;
+
+	w.Cb = p0.Cb;
+	w.Y0 = p0.Y;
+	w.Cr = p0.Cr;
+	w.Y1 = p1.Y;
+	return w;
+}
+
+
+static void runPendSV (void)
+{
+	if (SCB->ICSR & SCB_ICSR_PENDSVSET_Msk)
+	{
+		double t0 = now ();
+
+		SCB->ICSR = 0;
+		PendSV_Handler ();
+		timeConv += now () - t0;
+		pendSVs++;
+	}
+}
+
+
+static void vsync (void)
+{
+	double t0 = now ();
+
+	DCMI->MISR = DCMI_IT_VSYNC;
+	DCMI_IRQHandler ();
+	DCMI->MISR = 0;
+	timeVsync += now () - t0;
+	vsyncIrqs++;
+
+	runPendSV ();
+}
+
+
+// one DMA word; on a full buffer switch to the other one and raise the transfer complete IRQ
+static void dmaWord (YCbCr_t w, uint32_t reload)
+{
+	volatile YCbCr_t *buf = (DMA2_Stream1->CR & DMA_SxCR_CT) ? YCbCr_buf1 : YCbCr_buf0;
+
+	buf[reload - DMA2_Stream1->NDTR] = w;
+	if (--DMA2_Stream1->NDTR == 0)
+	{
+		double t0;
+
+		DMA2_Stream1->CR ^= DMA_SxCR_CT;
+		DMA2_Stream1->NDTR = reload;
+		DMA2->LISR |= DMA_LISR_TCIF1;
+
+		t0 = now ();
+		DMA2_Stream1_IRQHandler ();
+		timeLine += now () - t0;
+		lineIrqs++;
+
+		DMA2->LISR &= ~DMA_LISR_TCIF1;
+		runPendSV ();
+	}
+}
+
+
+// deliver one field through DCMI crop window and DMA into the capture IRQs; sums the reference
+static void deliverField (unsigned long field)
+{
+	short hoff = DCMI->CWSTRTR & 0x3fff;
+	short vst = (DCMI->CWSTRTR >> 16) & 0x1fff;
+	short words = ((DCMI->CWSIZER & 0x3fff) + 1) / 4;
+	short lines = ((DCMI->CWSIZER >> 16) & 0x3fff) + 1;
+	short first = (captureFull || captureLeftRight == 0 ? 0 : SLOTS_X/2);
+	short slots = (captureFull ? SLOTS_X : SLOTS_X/2);
+	uint32_t reload = DMA2_Stream1->NDTR;
+	short l, w, k, j, pos;
+
+	if (first == 0)							// picture starts
+	{
+		memset (refY, 0, sizeof (refY));
+		memset (refCb, 0, sizeof (refCb));
+		memset (refCr, 0, sizeof (refCr));
+		memset (refCnt, 0, sizeof (refCnt));
+	}
+
+	for (k = 0, pos = 0; k < slots; k++)
+		for (j = 0; j < slotRuns[first + k] && pos < LINE_WIDTH; j++)
+			wordSlot[pos++] = first + k;
+	while (pos < LINE_WIDTH)
+		wordSlot[pos++] = -1;
+
+	if (vst + lines > fieldLines)			// VSYNC comes first
+		lines = fieldLines - vst;
+
+	for (l = 0; l < lines; l++)
+	{
+		short row = l * SLOTS_Y / cropHeight;
+
+		if (row > SLOTS_Y - 1)
+			row = SLOTS_Y - 1;
+
+		for (w = 0; w < words; w++)
+		{
+			YCbCr_t v = patternWord (field, vst + l, hoff + 4 * w);
+
+			if (!(DMA2_Stream1->CR & DMA_SxCR_EN))
+				return;
+			dmaWord (v, reload);
+
+			if (row < SLOTS_Y && w < LINE_WIDTH && wordSlot[w] >= 0)
+			{
+				k = wordSlot[w];
+				refY[row][k] += v.Y0 + v.Y1;
+				refCb[row][k] += v.Cb;
+				refCr[row][k] += v.Cr;
+				refCnt[row][k]++;
+			}
+		}
+	}
+}
+
+
+// reference picture complete: convert it like convertRow does
+static void referencePicture (void)
+{
+	short x, y;
+
+	for (y = 0; y < SLOTS_Y; y++)
+		for (x = 0; x < SLOTS_X; x++)
+		{
+			uint32_t cnt = refCnt[y][x];
+
+			expectedCnt[y][x] = cnt;
+			if (cnt > 0)
+				yuv2rgbLUT (&expected[y][x], (refY[y][x] / cnt) / 2, refCb[y][x] / cnt, refCr[y][x] / cnt);
+		}
+	expectedValid = 1;
+}
+
+
+// compare the frame published by the capture module with the reference; returns number of different slots
+static unsigned long comparePicture (unsigned long picture)
+{
+	unsigned long diffs = 0;
+	short x, y;
+
+	for (y = 0; y < SLOTS_Y; y++)
+		for (x = 0; x < SLOTS_X; x++)
+		{
+			if (expectedCnt[y][x] == 0)
+				continue;				// not converted; keeps old frame content
+			if (captureBandY > 0 && y >= captureBandY && y < SLOTS_Y - captureBandY
+					&& x >= captureBandX && x < SLOTS_X - captureBandX)
+				continue;				// center not captured in edge band mode
+
+			if (rgbSlots[y][x].R != expected[y][x].R || rgbSlots[y][x].G != expected[y][x].G
+					|| rgbSlots[y][x].B != expected[y][x].B)
+			{
+				if (diffs < 5)
+					printf ("picture %lu slot %d/%d: got %d %d %d, expected %d %d %d\n", picture, x, y,
+							rgbSlots[y][x].R, rgbSlots[y][x].G, rgbSlots[y][x].B,
+							expected[y][x].R, expected[y][x].G, expected[y][x].B);
+				diffs++;
+			}
+		}
+	return diffs;
+}
+
+
+int main (int argc, char **argv)
+{
+	unsigned long fields = 200;
+	unsigned long field, pictures = 0, badPictures = 0, diffSlots = 0;
+	const char *outFile = NULL;
+	FILE *out = NULL;
+	int mode = CAPTURE_AUTO;
+	int bands = 0, opt;
+
+	while ((opt = getopt (argc, argv, "nf:m:buo:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': statusR8C = 0x01; fieldLines = 262; activeTop = 20; activeLines = 243; break;
+		case 'f': fields = strtoul (optarg, NULL, 0); break;
+		case 'm': mode = (strcmp (optarg, "split") == 0 ? CAPTURE_SPLIT :
+						  strcmp (optarg, "full") == 0 ? CAPTURE_FULL :
+						  strcmp (optarg, "auto") == 0 ? CAPTURE_AUTO : CAPTURE_MODES); break;
+		case 'b': bands = 1; break;
+		case 'u': slotProfile = SLOT_PROFILE_EDGE; break;
+		case 'o': outFile = optarg; break;
+		default: optind = argc + 1; break;
+		}
+	}
+	for (pattern = 0; optind == argc - 1 && pattern < PATTERNS; pattern++)
+		if (strcmp (argv[optind], patternNames[pattern]) == 0)
+			break;
+	if (optind != argc - 1 || pattern >= PATTERNS || mode >= CAPTURE_MODES)
+	{
+		fprintf (stderr, "usage: capsim [-n] [-f fields] [-m split|full|auto] [-b] [-u] [-o file]\n"
+						 "              bars|gradient|letterbox|flash|noise\n");
+		return 2;
+	}
+
+	if (!mapRegion (PERIPH_BASE, HOST_PERIPH_SIZE) || !mapRegion (HOST_CORE_BASE, HOST_CORE_SIZE))
+		return 1;
+	if (outFile != NULL && (out = fopen (outFile, "wb")) == NULL)
+	{
+		perror (outFile);
+		return 1;
+	}
+
+	captureMode = mode;
+	captureEdgeBands = bands;
+	TVP5150setEdgeBands (DYN_WIN_X + 4, DYN_WIN_Y + 4);
+	TVP5150checkStandard ();				// takes the crop profile of the simulated line system
+	TVP5150initDCMI ();
+	TVP5150initDMA ();
+
+	vsync ();								// arms the first field
+	for (field = 0; field < fields; field++)
+	{
+		short pictureEnd;
+
+		deliverField (field);
+		pictureEnd = (captureFull || captureLeftRight == 1);
+		vsync ();
+
+		if (pictureEnd)
+			referencePicture ();
+
+		if (captureReady)
+		{
+			unsigned long d;
+
+			captureReady = 0;
+			TVP5150acquireFrame ();
+			pictures++;
+
+			if (expectedValid)
+			{
+				d = comparePicture (pictures);
+				diffSlots += d;
+				badPictures += (d != 0);
+				expectedValid = 0;
+			}
+			if (out != NULL)
+				recWriteRGB (out, rgbFrameSeq, (const uint8_t *)rgbSlots, SLOTS_X, SLOTS_Y);
+		}
+	}
+	if (out != NULL)
+		fclose (out);
+
+	printf ("%s, %s, %lu fields, %s mode (%s width), crop %lu/%lu %lux%lu, edge bands %s, slot profile %s\n",
+			patternNames[pattern], TVP5150standardName (videoStandard), fields,
+			mode == CAPTURE_SPLIT ? "split" : mode == CAPTURE_FULL ? "full" : "auto", captureFull ? "full" : "half",
+			cropLeft, cropTop, captureWidth, cropHeight, bands ? "on" : "off",
+			slotProfile == SLOT_PROFILE_EDGE ? "edge" : "uniform");
+	printf ("line IRQ   %8.1f ns per line (%d lines per IRQ; model %lu cycles at 168 MHz)\n",
+			lineIrqs ? timeLine * 1e9 / (lineIrqs * DMA_LINES) : 0.0, DMA_LINES,
+			TVP5150lineCyclesEstimate (captureFull ? captureWidth / 2 : captureWidth / 4, captureFull ? SLOTS_X : SLOTS_X/2));
+	printf ("VSYNC IRQ  %8.1f ns per field\n", vsyncIrqs ? timeVsync * 1e9 / vsyncIrqs : 0.0);
+	printf ("conversion %8.1f ns per picture\n", pictures ? timeConv * 1e9 / pictures : 0.0);
+	printf ("%lu pictures, %lu differ from reference (%lu slots), %lu dropped, %lu conversion jobs lost\n",
+			pictures, badPictures, diffSlots, framesDropped, convJobsDropped);
+
+	return (badPictures != 0 || pictures == 0 || convJobsDropped != 0) ? 1 : 0;
+}
+
+#endif
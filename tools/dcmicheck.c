@@ -0,0 +1,855 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+/*
+ * Host checks of the computing parts of tvp5150_dcmi.c. The module is included unmodified; as in tools/capsim.c
+ * the peripheral and Cortex-M system address ranges are mapped as plain memory, but no video is delivered.
+ *
+ *	dcmicheck [-n rounds] [recording ...]
+ *		-n <n>		rounds of random DMA lines (default 32)
+ *
+ * Accumulation kernels: lineAddSlots() is run with slotAddRunC() and with slotAddRunSIMD() on the same DMA lines for
+ * every capture width selectable by the user (200..740 in steps of 4) in split and full mode and with both slot
+ * profiles. The LINES_PER_ROW lines of a slot row are summed before the sums are compared, as during a field. The
+ * lines are random bytes, all 0, all 255 and the RGB frames of the recordings given (see ../framestream.h; written
+ * by ambitool or capsim -o) turned back into YCbCr pixels. __UXTAB16 and __UADD16 are the C versions of
+ * hostperiph.h, so the host times only compare the two loops; the Cortex-M4 cycles are printed by '#' on target.
+ *
+ * Slot runs: for both line systems, every capture width (200..740 in steps of 4), split and full mode and both slot
+ * profiles, captureSetWindow() sets up the fields of a picture and captureLine() gets cropHeight lines of 255 bytes,
+ * for the smallest, the default and the largest crop height the user interface allows (all heights at the default
+ * width). Every pixel pair of the crop window must land in exactly one slot: the DCMI crop window has the capture
+ * width, every slot of the field gets pairs, none outside it, the pair counts add up to the window and the 16 bit
+ * sums do not overflow.
+ *
+ * Video standard: TVP5150standardFromStatus() gets all 256 values of status register 5 (R8C), and
+ * TVP5150checkStandard() a sequence of simulated autoswitch results (PAL, NTSC, PAL-M, PAL-N, SECAM, NTSC 4.43 and
+ * unknown) after the user changed the crop. It must report a change only for a new standard, swap the crop values
+ * with the profile of the other line system only when the line system changes and keep the user's values; the
+ * crop window must stay within TVP5150fieldLines() and a field with the new crop must cover all slots.
+ *
+ * Colour conversion: yuv2rgbLUT() of every matrix is compared over all 2^24 YCbCr inputs with a double precision
+ * reference of the same coefficients (at most COLOR_TOLERANCE off per channel) and, for BT.601 full range, with
+ * the former integer conversion yuv2rgbInt() (deviation printed only; it truncates instead of rounding).
+ *
+ * Capture mode: captureSelectMode() in AUTO mode gets sequences of fields with DCMI overflows and line IRQs over
+ * budget. It must fall back to split mode, retry full width after FALLBACK_RETRY_FIELDS clean split fields (an
+ * overflow in split mode restarts the wait), double the wait for a fallback soon after the retry up to
+ * FALLBACK_RETRY_MAX, start again with the short wait after stable full width, retry at once after a change of
+ * captureWidth or captureMode, and stay in split mode when the timing model says full width does not fit.
+ *
+ * Frame store: framePublish() (PendSV) and TVP5150acquireFrame() (main) run in two threads with random pauses;
+ * LDREX/STREX are the compare and swap versions of hostperiph.h. The producer fills every slot of the write frame
+ * with its frame id; the consumer checks that the ids it gets never decrease, that all slots of a frame carry its
+ * id, also after a pause (no torn or overwritten frame), and that framesDropped and framesDuplicated match the
+ * gaps and repeats of the ids it has seen.
+ *
+ * Build on Linux:	make -C tools build/dcmicheck	(see tools/Makefile)
+ */
+
+#ifndef __arm__				// host program, empty in the firmware build (see tools/Makefile)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "../tvp5150_dcmi.c"			// the capture module itself, including its static data
+#include "recfile.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE		0x100000
+#endif
+
+#define		HOST_PERIPH_SIZE	(DCMI_BASE + 0x400 - PERIPH_BASE)
+#define		HOST_CORE_BASE		0xE0000000UL
+#define		HOST_CORE_SIZE		0x00100000UL
+
+#define		LINES_PER_ROW		10				// lines summed into one slot row (at most 8: crop height 307 / 40 rows)
+#define		PAIRS				(LINE_WIDTH/2)
+#define		COLOR_TOLERANCE		1				// levels per channel between LUT and float conversion
+#define		STRESS_FRAMES		20000			// frames published by the frame store producer
+
+uint32_t		hostPrimask = 0;
+uint32_t		SystemCoreClock = 168000000;
+
+static uint8_t	statusR8C = 0x00;				// simulated TVP5150 status register 5
+
+static YCbCr_t		lines [LINES_PER_ROW][PAIRS];
+static videoData_t	sumsC [SLOTS_X], sumsSIMD [SLOTS_X];
+static double		timeC, timeSIMD;
+static unsigned long	kernelLines, kernelRows, kernelErrors;
+static volatile uint8_t	colourSink;
+static volatile int		stressDone;
+
+
+
+/*
+ * Stubs of the modules tvp5150_dcmi.c calls but which are not needed here
+ */
+int16_t I2C_ReadByte (uint8_t slave_adr, uint8_t adr)
+{
+	(void)slave_adr;
+	if (adr == R8C_Status_register_5)
+		return statusR8C;
+	return 0;
+}
+
+int16_t I2C_WriteByte (uint8_t slave_adr, uint8_t adr, uint8_t wert)
+{
+	(void)slave_adr;
+	(void)adr;
+	(void)wert;
+	return 0;
+}
+
+void STM_EVAL_LEDOn (Led_TypeDef Led) { (void)Led; }
+void STM_EVAL_LEDOff (Led_TypeDef Led) { (void)Led; }
+void delay_ms (uint16_t time_ms) { (void)time_ms; }
+
+int put_c2Host (char c)
+{
+	putchar (c);
+	return 0;
+}
+
+
+static double now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static uint32_t hash (uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+
+static int mapRegion (unsigned long base, unsigned long size)
+{
+	void *p = mmap ((void*)base, size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE | MAP_NORESERVE, -1, 0);
+
+	if (p != (void*)base)
+	{
+		fprintf (stderr, "cannot map register space at 0x%08lx\n", base);
+		return 0;
+	}
+	return 1;
+}
+
+
+static uint8_t clampByte (int v)
+{
+	return (v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+
+//------------------------------------------------------------------------------------------------------------
+
+/*
+ * Sum the lines of one slot row of a field part (<width> pixel pairs into <slots> slots starting at picture slot
+ * <first>) with both kernels and compare the slot sums.
+ */
+static void kernelRow (short width, short first, short slots, uint8_t profile, const char *source)
+{
+	uint8_t		runs[SLOTS_X];
+	double		t0;
+	short		l, i;
+
+	slotRunsBuild (runs, width, first, slots, profile);
+	memset (sumsC, 0, sizeof (sumsC));
+	memset (sumsSIMD, 0, sizeof (sumsSIMD));
+
+	t0 = now ();
+	for (l = 0; l < LINES_PER_ROW; l++)
+		lineAddSlots (sumsC, lines[l], runs, slots, 0);
+	timeC += now () - t0;
+
+	t0 = now ();
+	for (l = 0; l < LINES_PER_ROW; l++)
+		lineAddSlots (sumsSIMD, lines[l], runs, slots, 1);
+	timeSIMD += now () - t0;
+
+	kernelLines += LINES_PER_ROW;
+	kernelRows++;
+
+	for (i = 0; i < slots; i++)
+	{
+		if (sumsC[i].CbCr != sumsSIMD[i].CbCr || sumsC[i].Y != sumsSIMD[i].Y || sumsC[i].cnt != sumsSIMD[i].cnt)
+		{
+			if (kernelErrors++ < 5)
+				printf ("kernels differ (%s): %d pairs, profile %d, slot %d: C = %08X/%d/%d, SIMD = %08X/%d/%d\n",
+						source, (int)width, (int)profile, first + i,
+						(unsigned int)sumsC[i].CbCr, (int)sumsC[i].Y, (int)sumsC[i].cnt,
+						(unsigned int)sumsSIMD[i].CbCr, (int)sumsSIMD[i].Y, (int)sumsSIMD[i].cnt);
+			break;
+		}
+	}
+}
+
+
+// run the lines in <lines> through both kernels for all capture widths, both modes and both slot profiles
+static void kernelAllWidths (const char *source)
+{
+	short		cw, full, profile, p;
+
+	for (cw = 200; cw <= 740; cw += 4)
+		for (full = 0; full < 2; full++)
+			for (profile = 0; profile < SLOT_PROFILES; profile++)
+			{
+				short width = (full ? cw / 2 : cw / 4);
+				short parts = (full ? 1 : 2);
+				short slots = SLOTS_X / parts;
+
+				for (p = 0; p < parts; p++)
+					kernelRow (width, p * slots, slots, profile, source);
+			}
+}
+
+
+// RGB (0..255) -> YCbCr (BT.601 full range; inverse of the default conversion matrix)
+static void rgb2ycc (const uint8_t *rgb, int *y, int *cb, int *cr)
+{
+	*y  = ( 19595 * rgb[0] + 38470 * rgb[1] +  7471 * rgb[2] + 32768) >> 16;
+	*cb = ((-11059 * rgb[0] - 21709 * rgb[1] + 32768 * rgb[2] + 32768) >> 16) + 128;
+	*cr = (( 32768 * rgb[0] - 27439 * rgb[1] -  5329 * rgb[2] + 32768) >> 16) + 128;
+}
+
+
+/*
+ * DMA lines from the slot rows of recorded RGB frames: every record gives the lines of one slot row (rows in
+ * turn); the slots are spread over the full line and a little pixel noise is added, so the sums are not uniform.
+ */
+static int kernelRecording (const char *file)
+{
+	static uint8_t	rgb [MAX_SLOTS * 3];
+	recReader_t		in;
+	record_t		rec;
+	unsigned long	frames = 0;
+	int				w, h;
+
+	if (!recOpen (&in, file))
+		return 0;
+
+	while (recRead (&in, &rec))
+	{
+		short l, k;
+
+		if (rec.type != FS_TYPE_RGB || !decodeRGB (&rec, rgb, &w, &h) || w == 0 || h == 0)
+			continue;
+
+		for (l = 0; l < LINES_PER_ROW; l++)
+			for (k = 0; k < PAIRS; k++)
+			{
+				const uint8_t *s = &rgb[(((frames % h) * w) + k * w / PAIRS) * 3];
+				uint32_t n = hash (frames * PAIRS * LINES_PER_ROW + l * PAIRS + k);
+				int y, cb, cr;
+
+				rgb2ycc (s, &y, &cb, &cr);
+				lines[l][k].Y0 = clampByte (y + (int)(n & 7) - 4);
+				lines[l][k].Y1 = clampByte (y + (int)((n >> 3) & 7) - 4);
+				lines[l][k].Cb = clampByte (cb + (int)((n >> 6) & 3) - 2);
+				lines[l][k].Cr = clampByte (cr + (int)((n >> 8) & 3) - 2);
+			}
+		kernelAllWidths (file);
+		frames++;
+	}
+	recClose (&in);
+
+	printf ("kernels: %lu frames of %s\n", frames, file);
+	return 1;
+}
+
+
+/*
+ * One field of the current crop through captureSetWindow() and captureLine(); <lines> holds lines of 255 bytes.
+ * Returns the number of errors.
+ */
+static int slotRunsField (short full, short leftRight)
+{
+	short		first = (full || leftRight == 0 ? 0 : SLOTS_X/2);
+	unsigned long pairs = 0, l;
+	int			errors = 0, x, y;
+
+	captureFull = full;
+	captureLeftRight = leftRight;
+	memset ((void *)YCbCrSlots, 0, sizeof (YCbCrSlots));
+	captureSetWindow ();
+
+	for (l = 0; l < cropHeight; l++)
+	{
+		captureLine (lines[0]);
+		convTail = convHead;				// nothing is converted here
+	}
+
+	if ((DCMI->CWSIZER & 0x3fff) + 1 != (full ? 2 : 1) * captureWidth)
+		errors++;
+
+	for (y = 0; y < SLOTS_Y; y++)
+		for (x = 0; x < SLOTS_X; x++)
+		{
+			const videoData_t *p = (const videoData_t *)&YCbCrSlots[y * SLOTS_X + x];
+			short inField = (x >= first && x < first + arrSlots);
+
+			if (inField ? (p->cnt == 0 || p->Y != 510 * p->cnt || p->CbCr != 255 * p->cnt * 0x10001) : p->cnt != 0)
+				errors++;
+			pairs += p->cnt;
+		}
+	if (pairs != cropHeight * dmaWidth)
+		errors++;
+
+	return errors;
+}
+
+
+// all fields of a picture at the current crop; returns the number of failing fields
+static int slotRunsPicture (short full, const char *system)
+{
+	int errors = 0, p;
+
+	for (p = 0; p < (full ? 1 : 2); p++)
+		if (slotRunsField (full, p) != 0 && errors++ == 0)
+			printf ("slot runs wrong: %s, width %lu, height %lu, %s, profile %d, part %d\n", system,
+					captureWidth, cropHeight, full ? "full" : "split", (int)slotProfile, p);
+	return errors;
+}
+
+
+// returns the number of failing pictures
+static int checkSlotRuns (void)
+{
+	unsigned char	sys;
+	unsigned long	pictures = 0;
+	int				errors = 0;
+
+	memset (lines[0], 0xff, sizeof (lines[0]));
+	captureEdgeBands = 0;
+
+	for (sys = 0; sys < VIDEO_SYSTEMS; sys++)
+	{
+		const char		*system = (sys == VIDEO_625 ? "625 lines" : "525 lines");
+		unsigned long	heights[3], cw;
+		short			full, h;
+
+		videoSystem = sys;
+		cropTop = 4;								// smallest top leaves the largest height
+		heights[0] = 40;
+		heights[1] = TVP5150fieldLines () - 24;
+		heights[2] = TVP5150fieldLines () - 1 - cropTop;
+
+		for (slotProfile = 0; slotProfile < SLOT_PROFILES; slotProfile++)
+			for (full = 0; full < 2; full++)
+			{
+				for (cw = 200; cw <= 740; cw += 4)
+					for (h = 0; h < 3; h++)
+					{
+						captureWidth = cw;
+						cropHeight = heights[h];
+						errors += slotRunsPicture (full, system);
+						pictures++;
+					}
+
+				captureWidth = 696;
+				for (cropHeight = heights[0]; cropHeight <= heights[2]; cropHeight++)
+				{
+					errors += slotRunsPicture (full, system);
+					pictures++;
+				}
+			}
+	}
+
+	// back to the defaults
+	slotProfile = SLOT_PROFILE_UNIFORM;
+	videoSystem = VIDEO_625;
+	captureWidth = 696;
+	cropTop = 16;
+	cropHeight = 274;
+	captureFull = captureLeftRight = 0;
+
+	printf ("slot runs: %lu crop windows of both line systems, %d fields wrong\n", pictures, errors);
+	return errors;
+}
+
+
+/*
+ * Standard detection. R8C bits 0..3 hold the autoswitch result (coding of the Linux tvp5150 driver); the other bits
+ * must not matter.
+ */
+static const struct {
+	uint8_t		r8c;
+	videoStd_e	std;
+} statusCodes[] = {
+		{0x01, STD_NTSC}, {0x03, STD_PAL}, {0x05, STD_PAL_M}, {0x07, STD_PAL_N}, {0x09, STD_NTSC443}, {0x0b, STD_SECAM},
+};
+
+static const struct {
+	uint8_t		r8c;
+	short		changed;			// expected return value of TVP5150checkStandard()
+	unsigned char system;			// line system afterwards
+} standardSteps[] = {
+		{0x03, 1, VIDEO_625},		// PAL (first standard seen)
+		{0x03, 0, VIDEO_625},
+		{0x01, 1, VIDEO_525},		// NTSC: profiles swapped
+		{0x00, 0, VIDEO_525},		// no result yet: nothing changes
+		{0x01, 0, VIDEO_525},
+		{0x05, 1, VIDEO_525},		// PAL-M: same line system
+		{0x07, 1, VIDEO_625},		// PAL-N: back to 625 lines
+		{0x0b, 1, VIDEO_625},		// SECAM
+		{0x09, 1, VIDEO_525},		// NTSC 4.43
+		{0x03, 1, VIDEO_625},		// PAL
+};
+
+// returns the number of errors
+static int checkStandards (void)
+{
+	const cropProfile_t user625 = {152, 640, 20, 270};		// crop the user set while a 625 line source was shown
+	const cropProfile_t user525 = {168, 600, 14, 230};
+	int		errors = 0, i, k;
+
+	for (i = 0; i < 256; i++)
+	{
+		videoStd_e expected = STD_UNKNOWN;
+
+		for (k = 0; k < (int)(sizeof (statusCodes) / sizeof (statusCodes[0])); k++)
+			if ((i & 0x0f) == statusCodes[k].r8c)
+				expected = statusCodes[k].std;
+		if (TVP5150standardFromStatus (i) != expected)
+		{
+			if (errors++ < 5)
+				printf ("standard of R8C 0x%02x: %s, expected %s\n", i,
+						TVP5150standardName (TVP5150standardFromStatus (i)), TVP5150standardName (expected));
+		}
+	}
+
+	memset (lines[0], 0xff, sizeof (lines[0]));
+	captureEdgeBands = 0;
+	videoStandard = STD_UNKNOWN;
+	videoSystem = VIDEO_625;
+	cropLeft = user625.cropLeft;
+	captureWidth = user625.captureWidth;
+	cropTop = user625.cropTop;
+	cropHeight = user625.cropHeight;
+	cropProfiles[VIDEO_525] = user525;
+
+	for (i = 0; i < (int)(sizeof (standardSteps) / sizeof (standardSteps[0])); i++)
+	{
+		const cropProfile_t *crop = (standardSteps[i].system == VIDEO_625 ? &user625 : &user525);
+		short changed;
+
+		statusR8C = standardSteps[i].r8c | 0xa0;			// other status bits set
+		changed = TVP5150checkStandard ();
+
+		if (changed != standardSteps[i].changed || videoSystem != standardSteps[i].system
+				|| cropLeft != crop->cropLeft || captureWidth != crop->captureWidth
+				|| cropTop != crop->cropTop || cropHeight != crop->cropHeight
+				|| cropTop + cropHeight >= TVP5150fieldLines ()
+				|| TVP5150fieldLines () != (videoSystem == VIDEO_525 ? 262 : 312)
+				|| slotRunsPicture (0, "standard change") != 0)
+		{
+			errors++;
+			printf ("standard step %d (R8C 0x%02x): changed %d, %s, crop %lu/%lu %lux%lu\n", i, standardSteps[i].r8c,
+					changed, videoSystem == VIDEO_525 ? "525 lines" : "625 lines", cropLeft, cropTop, captureWidth, cropHeight);
+		}
+	}
+
+	// back to the defaults
+	videoStandard = STD_UNKNOWN;
+	videoSystem = VIDEO_625;
+	cropLeft = 160;
+	captureWidth = 696;
+	cropTop = 16;
+	cropHeight = 274;
+	cropProfiles[VIDEO_525] = (cropProfile_t){160, 696, 12, 236};
+
+	printf ("video standard: 256 status values, %d detection steps, %d errors\n",
+			(int)(sizeof (standardSteps) / sizeof (standardSteps[0])), errors);
+	return errors;
+}
+
+
+// double precision reference of the matrix the tables were built for
+static void yuv2rgbFloat (rgbValue_t *rgb, long Y, long Cb, long Cr)
+{
+	const colorCoeffs_t *c = &colorCoeffs[colorTablesMatrix];
+	double y = (double)(Y - c->yOffset) * c->yGain / 65536.0;
+	double cb = (double)(Cb - 128) / 65536.0;
+	double cr = (double)(Cr - 128) / 65536.0;
+
+	rgb->R = colorClamp ((int32_t)floor (y + cr * c->crR + 0.5));
+	rgb->G = colorClamp ((int32_t)floor (y - cr * c->crG - cb * c->cbG + 0.5));
+	rgb->B = colorClamp ((int32_t)floor (y + cb * c->cbB + 0.5));
+}
+
+
+static int maxDiff (const rgbValue_t *a, const rgbValue_t *b)
+{
+	int d = abs (a->R - b->R);
+
+	if (abs (a->G - b->G) > d) d = abs (a->G - b->G);
+	if (abs (a->B - b->B) > d) d = abs (a->B - b->B);
+	return d;
+}
+
+
+// all 2^24 inputs of every matrix; returns the number of matrices out of tolerance
+static int checkColour (void)
+{
+	int			errors = 0;
+	unsigned char m;
+
+	for (m = 0; m < COLOR_MATRICES; m++)
+	{
+		rgbValue_t	rgbL, rgbI, rgbF;
+		uint32_t	Y, Cb, Cr;
+		int			devFloat = 0, devInt = 0;
+		unsigned long cntFloat = 0;
+		double		t0, tLUT = 0;
+
+		colorMatrix = m;
+		colorBuildTables ();
+
+		for (Y = 0; Y < 256; Y++)
+		{
+			t0 = now ();
+			for (Cb = 0; Cb < 256; Cb++)
+				for (Cr = 0; Cr < 256; Cr++)
+				{
+					yuv2rgbLUT (&rgbL, Y, Cb, Cr);
+					colourSink ^= rgbL.R ^ rgbL.G ^ rgbL.B;		// keeps the loop from being optimized away
+				}
+			tLUT += now () - t0;
+
+			for (Cb = 0; Cb < 256; Cb++)
+				for (Cr = 0; Cr < 256; Cr++)
+				{
+					int d;
+
+					yuv2rgbLUT (&rgbL, Y, Cb, Cr);
+					yuv2rgbFloat (&rgbF, Y, Cb, Cr);
+					d = maxDiff (&rgbL, &rgbF);
+					if (d > devFloat) devFloat = d;
+					if (d > 0) cntFloat++;
+
+					if (m == COLOR_BT601_FULL)
+					{
+						yuv2rgbInt (&rgbI, Y, Cb, Cr);
+						d = maxDiff (&rgbL, &rgbI);
+						if (d > devInt) devInt = d;
+					}
+				}
+		}
+
+		printf ("colour %-20s max deviation from float %d (%lu inputs differ)", TVP5150colorMatrixName (m), devFloat, cntFloat);
+		if (m == COLOR_BT601_FULL)
+			printf (", from integer %d", devInt);
+		printf ("; host %.1f ns per pixel\n", tLUT * 1e9 / (1 << 24));
+
+		if (devFloat > COLOR_TOLERANCE)
+			errors++;
+	}
+	colorMatrix = COLOR_BT601_FULL;
+
+	return errors;
+}
+
+
+// busy wait of random length; now and then give the other thread the CPU
+static void stressPause (uint32_t *seed)
+{
+	uint32_t n = hash ((*seed)++);
+	volatile uint32_t i;
+
+	if ((n & 15) == 0)
+		sched_yield ();
+	for (i = 0; i < ((n >> 4) & 1023); i++)
+		;
+}
+
+
+// fill all slots of frame <f> with frame id <seq>
+static void stressFill (rgbFrame_t *f, uint32_t seq)
+{
+	rgbValue_t *s = &f->slots[0][0];
+	int i;
+
+	for (i = 0; i < SLOTS_Y * SLOTS_X; i++)
+	{
+		s[i].R = seq;
+		s[i].G = seq >> 8;
+		s[i].B = seq >> 16;
+	}
+}
+
+
+// returns the number of slots of frame <slots> that do not carry frame id <seq>
+static int stressTorn (rgbValue_t (*slots)[SLOTS_X], uint32_t seq)
+{
+	const rgbValue_t *s = &slots[0][0];
+	int i, torn = 0;
+
+	for (i = 0; i < SLOTS_Y * SLOTS_X; i++)
+		if (s[i].R != (uint8_t)seq || s[i].G != (uint8_t)(seq >> 8) || s[i].B != (uint8_t)(seq >> 16))
+			torn++;
+	return torn;
+}
+
+
+// producer: writes and publishes frames as PendSV does
+static void *stressProducer (void *arg)
+{
+	uint32_t seed = 0x5eed;
+	int n;
+
+	(void)arg;
+	for (n = 0; n < STRESS_FRAMES; n++)
+	{
+		stressFill (&rgbFrames[frameWrite], frameSeq + 1);
+		framePublish ();
+		stressPause (&seed);
+	}
+	stressDone = 1;
+	return NULL;
+}
+
+
+// consumer (main); returns the number of errors
+static int checkFrameStore (void)
+{
+	pthread_t	producer;
+	uint32_t	seed = 0xface, last = 0, seq;
+	unsigned long acquires = 0, taken = 0, repeats = 0, gaps = 0;
+	int			errors = 0, torn = 0, back = 0, done;
+
+	if (pthread_create (&producer, NULL, stressProducer, NULL) != 0)
+	{
+		perror ("pthread_create");
+		return 1;
+	}
+
+	do
+	{
+		done = stressDone;				// the acquire after the producer has ended takes its last frame
+		seq = TVP5150acquireFrame ();
+		acquires++;
+
+		if (seq < last)
+			back++;
+		else if (seq == last)
+			repeats++;
+		else
+		{
+			taken++;
+			gaps += seq - last - 1;
+		}
+		last = seq;
+
+		if (stressTorn (rgbSlots, seq))
+			torn++;
+		stressPause (&seed);
+		if (stressTorn (rgbSlots, seq))			// still ours while held
+			torn++;
+	} while (!done);
+	pthread_join (producer, NULL);
+
+	printf ("frame store: %d published, %lu acquires: %lu taken, %lu dropped (%lu id gaps), %lu duplicated (%lu repeats)\n",
+			STRESS_FRAMES, acquires, taken, framesDropped, gaps, framesDuplicated, repeats);
+
+	if (back || torn)
+	{
+		printf ("frame store: %d ids went backwards, %d torn frames\n", back, torn);
+		errors++;
+	}
+	if (last != STRESS_FRAMES || taken + framesDropped != STRESS_FRAMES || gaps != framesDropped || repeats != framesDuplicated)
+	{
+		printf ("frame store: counters do not add up (last id %lu)\n", (unsigned long)last);
+		errors++;
+	}
+	return errors;
+}
+
+
+/*
+ * Capture mode. <fields> fields with <overflow> and the line IRQ cycles <cycles>; captureFull must be <full> after
+ * each (-1: after the last only, the others are split). Returns 1 on a mismatch.
+ */
+static int autoFields (int fields, short overflow, unsigned long cycles, short full, const char *step)
+{
+	int i;
+
+	for (i = 0; i < fields; i++)
+	{
+		short expected = (full >= 0 ? full : (i == fields - 1));
+
+		lineCyclesLast = cycles;
+		captureSelectMode (overflow);
+		if (captureFull != expected)
+		{
+			printf ("capture mode, %s: field %d of %d %s, expected %s\n", step, i + 1, fields,
+					captureFull ? "full" : "split", expected ? "full" : "split");
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// returns the number of errors
+static int checkAutoMode (void)
+{
+	unsigned long over = lineCyclesBudget + 1, fallbacks = captureFallbacks;
+	int errors = 0, wait, i;
+
+	captureMode = CAPTURE_AUTO;
+	captureFull = 0;
+	errors += autoFields (1, 0, 0, 1, "start");							// default width fits the model
+	errors += autoFields (10, 0, 0, 1, "clean full fields");
+	errors += autoFields (1, 1, 0, 0, "overflow");
+	errors += autoFields (FALLBACK_RETRY_FIELDS + 1, 0, 0, -1, "retry after clean split fields");
+	errors += autoFields (5, 0, 0, 1, "after retry");
+	errors += autoFields (1, 0, over, 0, "line IRQ over budget soon after the retry");
+	errors += autoFields (100, 0, 0, 0, "doubled wait");
+	errors += autoFields (1, 1, 0, 0, "overflow in split mode");
+	errors += autoFields (2 * FALLBACK_RETRY_FIELDS + 1, 0, 0, -1, "wait restarted by the overflow");
+	errors += autoFields (FALLBACK_RETRY_FIELDS, 0, 0, 1, "stable full width");
+	errors += autoFields (1, 1, 0, 0, "overflow after stable full width");
+	errors += autoFields (FALLBACK_RETRY_FIELDS + 1, 0, 0, -1, "short wait again");
+
+	for (wait = FALLBACK_RETRY_FIELDS, i = 0; i < 8; i++)				// fails at every retry
+	{
+		errors += autoFields (1, 1, 0, 0, "repeated fallback");
+		wait = (wait < FALLBACK_RETRY_MAX ? 2 * wait : wait);
+		errors += autoFields (wait + 1, 0, 0, -1, "repeated fallback, wait");
+	}
+	if (wait != FALLBACK_RETRY_MAX)
+		errors++;
+
+	errors += autoFields (1, 1, 0, 0, "overflow before width change");
+	captureWidth -= 4;
+	errors += autoFields (1, 0, 0, 1, "new capture width");
+	errors += autoFields (1, 1, 0, 0, "overflow before mode change");
+	captureMode = CAPTURE_SPLIT;
+	errors += autoFields (3, 0, 0, 0, "split mode");
+	captureMode = CAPTURE_FULL;
+	errors += autoFields (3, 1, over, 1, "full mode");
+	captureMode = CAPTURE_AUTO;
+	errors += autoFields (1, 0, 0, 1, "auto mode again");
+
+	lineCyclesBudget = TVP5150lineCyclesEstimate (captureWidth / 2, SLOTS_X) - 1;	// full width does not fit
+	errors += autoFields (1, 1, 0, 0, "overflow, model over budget");
+	errors += autoFields (8 * FALLBACK_RETRY_MAX, 0, 0, 0, "model over budget");
+	lineCyclesBudget = over - 1;
+
+	if (captureFallbacks - fallbacks != 14)
+	{
+		printf ("capture mode: %lu fallbacks counted, expected 14\n", captureFallbacks - fallbacks);
+		errors++;
+	}
+
+	captureWidth += 4;
+	captureMode = CAPTURE_AUTO;
+	captureFull = 0;
+	lineCyclesLast = 0;
+
+	printf ("capture mode: AUTO fallback and retry, %d errors\n", errors);
+	return errors;
+}
+
+
+static void kernelRandom (int rounds)
+{
+	uint32_t	seed = 1;
+	int			r;
+
+	for (r = 0; r < rounds; r++)
+	{
+		uint8_t *b = (uint8_t *)lines;
+		size_t i;
+
+		for (i = 0; i < sizeof (lines); i++)
+			b[i] = hash (seed++);
+		kernelAllWidths ("random");
+	}
+
+	memset (lines, 0, sizeof (lines));
+	kernelAllWidths ("all 0");
+	memset (lines, 0xff, sizeof (lines));
+	kernelAllWidths ("all 255");
+}
+
+
+
+int main (int argc, char **argv)
+{
+	int		rounds = 32;
+	int		opt, i, runErrors, stdErrors, modeErrors, colourErrors, frameErrors;
+
+	while ((opt = getopt (argc, argv, "n:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': rounds = atoi (optarg); break;
+		default:
+			fprintf (stderr, "usage: dcmicheck [-n rounds] [recording ...]\n");
+			return 2;
+		}
+	}
+
+	if (!mapRegion (PERIPH_BASE, HOST_PERIPH_SIZE) || !mapRegion (HOST_CORE_BASE, HOST_CORE_SIZE))
+		return 1;
+
+	kernelRandom (rounds);
+	for (i = optind; i < argc; i++)
+		if (!kernelRecording (argv[i]))
+			return 1;
+
+	printf ("kernels: %lu lines in %lu slot rows, %lu differ; host time per line C %.1f ns, SIMD %.1f ns\n",
+			kernelLines, kernelRows, kernelErrors, timeC * 1e9 / kernelLines, timeSIMD * 1e9 / kernelLines);
+
+	runErrors = checkSlotRuns ();
+	stdErrors = checkStandards ();
+	modeErrors = checkAutoMode ();
+	colourErrors = checkColour ();
+	frameErrors = checkFrameStore ();
+
+	if (kernelErrors || runErrors || stdErrors || modeErrors || colourErrors || frameErrors)
+	{
+		printf ("FAIL: %lu slot rows with different sums, %d slot run fields wrong, %d standard detection errors, "
+				"%d capture mode errors, %d colour matrices out of tolerance, %d frame store errors\n",
+				kernelErrors, runErrors, stdErrors, modeErrors, colourErrors, frameErrors);
+		return 1;
+	}
+	printf ("OK: C and SIMD kernels give identical slot sums, slot runs cover all crop windows, standards detected, "
+			"AUTO mode falls back and retries, colour conversion within %d level, frame store consistent\n",
+			COLOR_TOLERANCE);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,187 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+/*
+ * Checks the delay line of ambiLight.c: LED colours are written to rgbImage at picture times with jitter and
+ * dropped pictures, as main() would, and the delayed output of ambiLightImage2LedRGB() is compared with the
+ * colours of <delay> ms before. The test colours are slow triangle ramps (RAMP_MS per level), so a level error
+ * of the output is a timing error; the mean over all LEDs and pictures is the delay actually reached. Blue runs
+ * against red and green, so swapped channels show as level errors.
+ *	- measured delay within DELAY_TOLERANCE ms of the setting
+ *	- no output level more than LEVEL_TOLERANCE off (rounding of the interpolation only)
+ * It also prints the memory of the delay line and the former frame FIFO.
+ *
+ *	delaycheck [-v]		(-v prints every run)
+ *
+ * Build on Linux:	make -C tools build/delaycheck	(see tools/Makefile)
+ */
+
+#ifndef __arm__				// host program, empty in the firmware build (see tools/Makefile)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "main.h"
+#include "ambiLight.h"
+
+#define		RAMP_MS				4			// ms per colour level of the test ramps
+#define		RAMP_PERIOD			(2 * 255 * RAMP_MS)
+#define		FOLD_GUARD			250			// ms around the turning points of the ramps that are not measured
+#define		START_MS			10000		// picture time of the first picture
+#define		RUN_MS				8000		// measured time per run after the line is filled
+#define		DELAY_TOLERANCE		1.0			// ms
+#define		LEVEL_TOLERANCE		1
+#define		OLD_FIFO_PICTURES	20			// former tvprocRGBDelayFifo[20][LEDS_MAXTOTAL] of rgbValue_t
+
+static const short	ringSizes[][2] = {{48, 27}, {64, 36}, {LEDS_XMAX, LEDS_YMAX}};		// ledsX, ledsY
+static const short	delays[] = {0, 20, 130, 500, 1000, 2000, DELAY_MS_MAX};
+static const short	picturePeriods[] = {40, 20};	// ms: split capture (25/s), full capture (50/s)
+
+static int			verbose = 0;
+static unsigned long	genSeed = 1;
+
+
+
+static int genRand (int n)
+{
+	genSeed = genSeed * 1103515245 + 12345;
+	return (genSeed >> 16) % n;
+}
+
+
+// test colour of LED <led> at <t> ms; <slope> is +1/-1 on the ramps and 0 near the turning points
+static double ramp (short led, uint32_t t, int *slope)
+{
+	uint32_t x = (t + led * 37) % RAMP_PERIOD;
+	uint32_t fold = (x < RAMP_PERIOD / 2) ? x : RAMP_PERIOD - x;		// distance to the bottom turning point
+
+	*slope = (fold < FOLD_GUARD || RAMP_PERIOD / 2 - fold < FOLD_GUARD) ? 0 : (x < RAMP_PERIOD / 2 ? 1 : -1);
+	return (double)fold / RAMP_MS;
+}
+
+
+// one run; returns 1 if the delay or the levels are out of tolerance
+static int runDelay (short period, short delay)
+{
+	uint32_t t, end = START_MS + delay + RUN_MS;
+	double sumErr = 0;
+	long samples = 0;
+	int maxErr = 0;
+	short led;
+
+	ambiLightInit ();
+	tvprocDelayMs = delay;
+
+	for (t = START_MS; t < end; t += period + genRand (7) - 3)			// +-3 ms jitter
+	{
+		if (genRand (17) == 0)			// dropped picture
+			continue;
+
+		for (led = 0; led < ledsPhysical; led++)
+		{
+			int slope;
+			uint8_t v = (uint8_t)(ramp (led, t, &slope) + 0.5);
+
+			rgbImage[led].R = rgbImage[led].G = v;
+			rgbImage[led].B = 255 - v;
+		}
+		ambiLightImage2LedRGB (t);
+
+		if (t < START_MS + delay + 500)		// line not yet filled
+			continue;
+
+		for (led = 0; led < ledsPhysical; led++)
+		{
+			int slope, e, c;
+			double want = ramp (led, t - delay, &slope);
+
+			if (slope == 0)
+				continue;
+			for (c = 0; c < 3; c++)
+			{
+				uint8_t out = (c == 0) ? ws2812ledRGB[led].R : (c == 1) ? ws2812ledRGB[led].G : ws2812ledRGB[led].B;
+
+				e = abs (out - (c == 2 ? 255 - (int)(want + 0.5) : (int)(want + 0.5)));
+				if (e > maxErr)
+					maxErr = e;
+			}
+			sumErr += (want - ws2812ledRGB[led].G) * slope * RAMP_MS;		// later than wanted: positive
+			samples++;
+		}
+	}
+
+	sumErr /= samples;
+	if (verbose || maxErr > LEVEL_TOLERANCE || sumErr > DELAY_TOLERANCE || sumErr < -DELAY_TOLERANCE)
+		printf ("  %2d/s %3d LEDs %4d ms: measured %7.1f ms, max level error %d  %s\n", 1000 / period, ledsPhysical,
+				delay, delay + sumErr, maxErr,
+				(maxErr > LEVEL_TOLERANCE || sumErr > DELAY_TOLERANCE || sumErr < -DELAY_TOLERANCE) ? "FAIL" : "OK");
+
+	return (maxErr > LEVEL_TOLERANCE || sumErr > DELAY_TOLERANCE || sumErr < -DELAY_TOLERANCE);
+}
+
+
+int main (int argc, char **argv)
+{
+	int opt, r, d, p, failed = 0, runs = 0;
+
+	while ((opt = getopt (argc, argv, "v")) != -1)
+	{
+		switch (opt)
+		{
+		case 'v': verbose = 1; break;
+		default:
+			optind = argc + 1;
+			break;
+		}
+	}
+	if (optind != argc)
+	{
+		fprintf (stderr, "usage: delaycheck [-v]\n");
+		return 2;
+	}
+
+	printf ("former frame FIFO: %d bytes SRAM, %d pictures (%d ms at 25/s)\n",
+			(int)(OLD_FIFO_PICTURES * LEDS_MAXTOTAL * sizeof (rgbValue_t)), OLD_FIFO_PICTURES, OLD_FIFO_PICTURES * 40);
+	for (r = 0; r < (int)(sizeof (ringSizes) / sizeof (ringSizes[0])); r++)
+	{
+		ledsX = ringSizes[r][0];
+		ledsY = ringSizes[r][1];
+		printf ("delay line at %3d LEDs: %d bytes CCM RAM, %d pictures (%d ms at 25/s, %d ms at 50/s)\n",
+				ledsPhysical, ambiLightDelayEntries () * 4 * DELAY_ENTRY_WORDS (ledsPhysical), ambiLightDelayEntries (),
+				ambiLightDelayEntries () * 40, ambiLightDelayEntries () * 20);
+	}
+
+	for (r = 0; r < (int)(sizeof (ringSizes) / sizeof (ringSizes[0])); r++)
+	{
+		ledsX = ringSizes[r][0];
+		ledsY = ringSizes[r][1];
+		for (p = 0; p < (int)(sizeof (picturePeriods) / sizeof (picturePeriods[0])); p++)
+			for (d = 0; d < (int)(sizeof (delays) / sizeof (delays[0])); d++, runs++)
+				failed += runDelay (picturePeriods[p], delays[d]);
+	}
+
+	if (failed)
+	{
+		printf ("FAIL: %d of %d runs out of tolerance\n", failed, runs);
+		return 1;
+	}
+	printf ("OK: %d runs within %.1f ms and %d levels\n", runs, DELAY_TOLERANCE, LEVEL_TOLERANCE);
+	return 0;
+}
+
+#endif
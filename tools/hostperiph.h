@@ -0,0 +1,90 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+/*
+ * Forced include (gcc -include tools/hostperiph.h) for host builds of firmware modules that use Cortex-M
+ * instructions. It takes the place of the CMSIS instruction, core function and SIMD headers with plain C
+ * versions of the intrinsics used by the firmware; the peripheral registers stay at their real addresses and are
+ * backed by memory mapped there by the host program (see tools/capsim.c). Interrupts are not preempted on the
+ * host, so the IRQ enable/disable functions only keep the PRIMASK value.
+ *
+ * LDREX/STREX keep their reservation per thread; STREX stores only when the word still holds the value loaded by
+ * LDREX (compare and swap) and fails otherwise, so firmware code run in several threads (tools/dcmicheck.c) takes
+ * the same retry path as on the Cortex-M4. Unlike the hardware monitor, a write of the same value in between is
+ * not noticed; the exchange loops of the firmware only depend on the value.
+ */
+
+#ifndef HOSTPERIPH_H_
+#define HOSTPERIPH_H_
+
+#include <stdint.h>
+
+#define __CORE_CMINSTR_H
+#define __CORE_CMFUNC_H
+#define __CORE_CM4_SIMD_H
+
+extern uint32_t hostPrimask;
+
+static __thread volatile uint32_t	*hostExclAddr;		// reservation of the last LDREX
+static __thread uint32_t			hostExclValue;
+
+static inline void __NOP (void) { }
+static inline void __ISB (void) { __sync_synchronize(); }
+static inline void __DSB (void) { __sync_synchronize(); }
+static inline void __DMB (void) { __sync_synchronize(); }
+static inline void __CLREX (void) { hostExclAddr = 0; }
+
+static inline uint32_t __LDREXW (volatile uint32_t *addr)
+{
+	hostExclAddr = addr;
+	hostExclValue = __atomic_load_n (addr, __ATOMIC_SEQ_CST);
+	return hostExclValue;
+}
+
+// returns 0 when stored, 1 when the reservation was lost (as STREX)
+static inline uint32_t __STREXW (uint32_t value, volatile uint32_t *addr)
+{
+	int stored = (addr == hostExclAddr && __sync_bool_compare_and_swap (addr, hostExclValue, value));
+
+	hostExclAddr = 0;
+	return !stored;
+}
+
+static inline uint32_t __REV (uint32_t value)
+{
+	return __builtin_bswap32 (value);
+}
+
+static inline void __enable_irq (void) { hostPrimask = 0; }
+static inline void __disable_irq (void) { hostPrimask = 1; }
+static inline uint32_t __get_PRIMASK (void) { return hostPrimask; }
+static inline void __set_PRIMASK (uint32_t priMask) { hostPrimask = priMask; }
+
+
+// dual 16 bit add: op1.h + op2.h (mod 2^16 per half word)
+static inline uint32_t __UADD16 (uint32_t op1, uint32_t op2)
+{
+	return ((op1 + op2) & 0x0000ffff) | (((op1 >> 16) + (op2 >> 16)) << 16);
+}
+
+// dual 16 bit add of the zero extended bytes 0 and 2 of op2
+static inline uint32_t __UXTAB16 (uint32_t op1, uint32_t op2)
+{
+	return __UADD16 (op1, op2 & 0x00ff00ff);
+}
+
+#endif /* HOSTPERIPH_H_ */
@@ -0,0 +1,123 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+/*
+ * Thin replacement of the hardware modules (capture, LED driver, IR, serial, USB) so that ambiLight.c can be
+ * compiled and run on a Linux host by tools/replay.c. Only the globals and functions referenced by ambiLight.c
+ * are provided; they have the types declared in the firmware headers. The CCM RAM used by ambiLight.c for its
+ * sampling matrix and the core debug registers (DWT cycle counter, reads 0 here) are mapped at their target
+ * addresses before main() runs.
+ */
+
+#ifndef __arm__				// host program, empty in the firmware build (see tools/Makefile)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "main.h"
+#include "ambiLight.h"
+#include "IRdecoder.h"
+
+
+int					ledsX = 48;
+int					ledsY = 28;
+ledSegment_t		ledLayout[LED_SEGMENTS];		// empty = ring of ledsX/ledsY
+int					ledsLayoutTotal = 0;
+rgbValue_t			ws2812ledRGB[LEDS_MAXTOTAL];
+int					masterBrightness = 100;
+short				videoOffCount = 5;				// good video signal
+
+volatile uint32_t	system_time = 0;
+volatile irCode_t	irCode;
+
+unsigned char		videoSourceSelect = 0;
+unsigned char		videoCurrentSource = 1;
+rgbValue_t			(*rgbSlots)[SLOTS_X];			// set by replay for each frame
+volatile short		captureBandX = 0;				// replayed frames are always fully captured
+volatile short		captureBandY = 0;
+
+uint8_t				fifoFromHostFifo[FIFOLEN_FROMHOST + sizeof(AvrXFifo) - 1];
+
+
+int16_t AvrXPutFifo (pAvrXFifo p, uint8_t c)
+{
+	(void)p;
+	(void)c;
+	return FIFO_OK;
+}
+
+
+// same as in ws2812.c
+void WS2812layoutUpdate (void)
+{
+	int i;
+
+	ledsLayoutTotal = 0;
+	for (i = 0; i < LED_SEGMENTS && ledLayout[i].leds != 0; i++)
+		ledsLayoutTotal += ledLayout[i].skip + ledLayout[i].leds;
+
+	if (ledsLayoutTotal > LEDS_MAXTOTAL)
+		ledsLayoutTotal = LEDS_MAXTOTAL;
+}
+
+
+unsigned char TVP5150hasVideoSignal ()
+{
+	return 1;
+}
+
+
+void TVP5150selectVideoSource (unsigned char src)
+{
+	videoCurrentSource = src;
+}
+
+
+void TVP5150setEdgeBands (short x, short y)
+{
+	(void)x;
+	(void)y;
+}
+
+
+void displayOverlayPercents (int percent, int duration)
+{
+	(void)percent;
+	(void)duration;
+}
+
+
+static void hostMapRegion (unsigned long base, unsigned long size)
+{
+	void *p = mmap ((void*)base, size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE | MAP_NORESERVE, -1, 0);
+
+	if (p != (void*)base)
+	{
+		fprintf (stderr, "cannot map target memory at 0x%08lx\n", base);
+		exit (2);
+	}
+}
+
+
+__attribute__ ((constructor)) static void hostMapTarget (void)
+{
+	hostMapRegion (CCMDATARAM_BASE, 0x10000);
+	hostMapRegion (0xE0000000, 0x100000);			// private peripheral bus (DWT, CoreDebug)
+}
+
+#endif
@@ -0,0 +1,328 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+/*
+ * Checks the slot to LED mapping of ambiLight.c for several LED layouts (see ledSegment_t in ../ws2812.h):
+ *	- a layout describing the default ring gives exactly the same LEDs as the ring of ledsX/ledsY
+ *	- probes: all slots are black except the frameWidth slots at one row/column of one edge. Only the LEDs of
+ *	  segments on that edge whose share of the edge contains the probe may light up (+-1 row/column), at least one
+ *	  of them must; LEDs on the neighbour edges only near the corners; gaps and LEDs behind the strip never
+ *	- the strip length (ledsPhysical) is the sum of LEDs and gaps, at most LEDS_MAXTOTAL
+ *
+ *	layoutcheck [-v]		(-v lists every failed probe)
+ *
+ * Build on Linux:	make -C tools build/layoutcheck	(see tools/Makefile)
+ */
+
+#ifndef __arm__				// host program, empty in the firmware build (see tools/Makefile)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "main.h"
+#include "ambiLight.h"
+
+#define		LAYOUTS			7
+#define		RING_FRAMES		50			// random frames for the ring comparison
+
+extern int		frameWidth;
+
+typedef struct {
+	const char		*name;
+	ledSegment_t	seg [LED_SEGMENTS];
+} layout_t;
+
+static const layout_t layouts[LAYOUTS] = {
+	{"ring as segments",	{{LED_EDGE_RIGHT, 100, 0, 28, 0}, {LED_EDGE_TOP, 100, 0, 48, 0},
+							 {LED_EDGE_LEFT, 0, 100, 28, 0}, {LED_EDGE_BOTTOM, 0, 100, 48, 0}}},
+	{"gap for TV stand",	{{LED_EDGE_RIGHT, 100, 0, 30, 0}, {LED_EDGE_TOP, 100, 0, 52, 0},
+							 {LED_EDGE_LEFT, 0, 100, 30, 0}, {LED_EDGE_BOTTOM, 0, 40, 20, 0},
+							 {LED_EDGE_BOTTOM, 60, 100, 20, 9}}},
+	{"clockwise, unequal",	{{LED_EDGE_TOP, 0, 100, 60, 2}, {LED_EDGE_RIGHT, 0, 100, 25, 1},
+							 {LED_EDGE_BOTTOM, 100, 0, 64, 1}, {LED_EDGE_LEFT, 100, 0, 35, 1}}},
+	{"three sides",			{{LED_EDGE_LEFT, 100, 0, 20, 0}, {LED_EDGE_TOP, 0, 100, 40, 0},
+							 {LED_EDGE_RIGHT, 0, 100, 20, 0}}},
+	{"dense and sparse",	{{LED_EDGE_RIGHT, 50, 60, 20, 0}, {LED_EDGE_TOP, 90, 10, 5, 3},
+							 {LED_EDGE_LEFT, 20, 20, 2, 0}, {LED_EDGE_BOTTOM, 0, 100, 96, 0}}},
+	{"split edges",			{{LED_EDGE_TOP, 0, 50, 30, 0}, {LED_EDGE_TOP, 100, 50, 30, 4},
+							 {LED_EDGE_BOTTOM, 50, 0, 30, 0}, {LED_EDGE_BOTTOM, 50, 100, 30, 4},
+							 {LED_EDGE_LEFT, 0, 100, 10, 0}, {LED_EDGE_RIGHT, 0, 100, 10, 0}}},
+	{"longer than buffer",	{{LED_EDGE_RIGHT, 100, 0, 96, 0}, {LED_EDGE_TOP, 100, 0, 96, 0},
+							 {LED_EDGE_LEFT, 0, 100, 96, 0}, {LED_EDGE_BOTTOM, 0, 100, 96, 0}}},
+};
+
+static rgbValue_t	frame[SLOTS_Y][SLOTS_X];
+static int			verbose = 0;
+
+static unsigned long	genSeed = 1;
+
+
+
+static uint8_t genRand (void)
+{
+	genSeed = genSeed * 1103515245 + 12345;
+	return (genSeed >> 16) & 0xff;
+}
+
+
+static short edgeLen (uint8_t edge)
+{
+	return (edge == LED_EDGE_RIGHT || edge == LED_EDGE_LEFT) ? SLOTS_Y : SLOTS_X;
+}
+
+
+// first row/column, count and direction of a segment (same rounding as ambiLightBuildMatrix)
+static void segmentCells (const ledSegment_t *seg, short *first, short *cells, short *step)
+{
+	short len = edgeLen (seg->edge);
+	short from = seg->from * len / 100;
+	short to = seg->to * len / 100;
+
+	if (from == to)
+	{
+		if (from == len)
+			from--;
+		to = from + 1;
+	}
+	*step = (from < to) ? 1 : -1;
+	*first = (from < to) ? from : from - 1;
+	*cells = abs (to - from);
+}
+
+
+// one picture through the mapping; the LED colours are the sampled ones (factorI = 128)
+static void runFrame (void)
+{
+	rgbSlots = frame;
+	ambiLightClearImage ();
+	ambiLightDyn2Image ();
+}
+
+
+static int lit (short led)
+{
+	return rgbImage[led].R || rgbImage[led].G || rgbImage[led].B;
+}
+
+
+// probe all rows/columns of all edges; returns the number of failures
+static int probeLayout (const layout_t *lay)
+{
+	int fails = 0;
+	uint8_t edge;
+	short cell;
+
+	for (edge = 0; edge < LED_EDGES; edge++)
+	{
+		for (cell = 0; cell < edgeLen (edge); cell++)
+		{
+			short s, led = 0, j;
+			uint8_t edgeHit [LED_SEGMENTS];
+
+			memset (frame, 0, sizeof (frame));
+			for (j = 0; j < frameWidth; j++)
+			{
+				rgbValue_t *p;
+
+				switch (edge)
+				{
+				case LED_EDGE_RIGHT:	p = &frame[cell][SLOTS_X-1 - j]; break;
+				case LED_EDGE_TOP:		p = &frame[j][cell]; break;
+				case LED_EDGE_LEFT:		p = &frame[cell][j]; break;
+				default:				p = &frame[SLOTS_Y-1 - j][cell]; break;
+				}
+				p->R = p->G = p->B = 255;
+			}
+			runFrame ();
+
+			memset (edgeHit, 0, sizeof (edgeHit));
+			for (s = 0; s < LED_SEGMENTS && lay->seg[s].leds != 0; s++)
+			{
+				const ledSegment_t *seg = &lay->seg[s];
+				short first, cells, step, k;
+				short pos, segLed;
+
+				segmentCells (seg, &first, &cells, &step);
+				pos = (cell - first) * step;				// probe position within the segment
+
+				for (k = 0; k < seg->skip && led < LEDS_MAXTOTAL; k++, led++)
+				{
+					if (lit (led))
+					{
+						fails++;
+						if (verbose) printf ("  edge %d cell %d: gap LED %d is lit\n", edge, cell, led);
+					}
+				}
+
+				segLed = led;
+				for (k = 0; k < seg->leds && led < LEDS_MAXTOTAL; k++, led++)
+				{
+					if (seg->edge == edge)
+					{
+						if (pos >= 0 && pos < cells)
+						{
+							// nominal share of LED k: [k*cells/leds, (k+1)*cells/leds)
+							int lo = k * cells / seg->leds - 1;
+							int hi = ((k + 1) * cells + seg->leds - 1) / seg->leds;
+
+							if (lit (led))
+							{
+								edgeHit[s] = 1;
+								if (pos < lo || pos > hi)
+								{
+									fails++;
+									if (verbose) printf ("  edge %d cell %d: LED %d (segment %d, %d..%d) is lit\n",
+														edge, cell, led, s, lo, hi);
+								}
+							}
+						}
+						else if (lit (led))
+						{
+							fails++;
+							if (verbose) printf ("  edge %d cell %d: LED %d of segment %d outside its part is lit\n",
+												edge, cell, led, s);
+						}
+					}
+					else if (lit (led))			// other edge: only at the corners
+					{
+						uint8_t corner = (cell < frameWidth || cell >= edgeLen (edge) - frameWidth)
+									&& (seg->edge + edge) % 2 == 1;
+
+						if (!corner)
+						{
+							fails++;
+							if (verbose) printf ("  edge %d cell %d: LED %d on edge %d is lit\n", edge, cell, led, seg->edge);
+						}
+					}
+				}
+
+				if (seg->edge == edge && pos >= 0 && pos < cells && !edgeHit[s]
+						&& segLed + pos * seg->leds / cells < LEDS_MAXTOTAL)		// LED of the probe is driven
+				{
+					fails++;
+					if (verbose) printf ("  edge %d cell %d: no LED of segment %d is lit\n", edge, cell, s);
+				}
+			}
+
+			for (; led < LEDS_MAXTOTAL; led++)
+			{
+				if (lit (led))
+				{
+					fails++;
+					if (verbose) printf ("  edge %d cell %d: LED %d behind the strip is lit\n", edge, cell, led);
+				}
+			}
+		}
+	}
+	return fails;
+}
+
+
+int main (int argc, char **argv)
+{
+	static rgbIcontroller_t ring [LEDS_MAXTOTAL];
+	int opt, l, n, failed = 0;
+
+	while ((opt = getopt (argc, argv, "v")) != -1)
+	{
+		switch (opt)
+		{
+		case 'v': verbose = 1; break;
+		default:
+			optind = argc + 1;
+			break;
+		}
+	}
+	if (optind != argc)
+	{
+		fprintf (stderr, "usage: layoutcheck [-v]\n");
+		return 2;
+	}
+
+	ambiLightInit ();				// dyn borders = full picture
+	factorI = MAX_ICONTROL;
+	ledsX = 48;
+	ledsY = 28;
+	rgbImageWid = SLOTS_X;
+	rgbImageHigh = SLOTS_Y;
+
+	for (frameWidth = 1; frameWidth <= 11; frameWidth += 5)
+	{
+		printf ("frameWidth %d:\n", frameWidth);
+
+		for (l = 0; l < LAYOUTS; l++)
+		{
+			const layout_t *lay = &layouts[l];
+			int total = 0, fails = 0, s;
+
+			for (s = 0; s < LED_SEGMENTS && lay->seg[s].leds != 0; s++)
+				total += lay->seg[s].skip + lay->seg[s].leds;
+			if (total > LEDS_MAXTOTAL)
+				total = LEDS_MAXTOTAL;
+
+			memcpy (ledLayout, lay->seg, sizeof (ledLayout));
+			WS2812layoutUpdate ();
+			if (ledsPhysical != total)
+			{
+				printf ("  %-20s strip length %d, expected %d\n", lay->name, ledsPhysical, total);
+				fails++;
+			}
+
+			if (l == 0)				// same as the ring of ledsX/ledsY
+			{
+				for (n = 0; n < RING_FRAMES; n++)
+				{
+					int x, y;
+
+					for (y = 0; y < SLOTS_Y; y++)
+						for (x = 0; x < SLOTS_X; x++)
+							frame[y][x].R = genRand(), frame[y][x].G = genRand(), frame[y][x].B = genRand();
+
+					memset (ledLayout, 0, sizeof (ledLayout));
+					WS2812layoutUpdate ();
+					runFrame ();
+					memcpy (ring, rgbImage, sizeof (ring));
+
+					memcpy (ledLayout, lay->seg, sizeof (ledLayout));
+					WS2812layoutUpdate ();
+					runFrame ();
+					if (memcmp (ring, rgbImage, sizeof (ring)) != 0)
+						fails++;
+				}
+			}
+
+			fails += probeLayout (lay);
+			printf ("  %-20s %3d LEDs  %s (%d failures)\n", lay->name, total, fails ? "FAIL" : "OK", fails);
+			if (fails)
+				failed++;
+		}
+	}
+
+	memset (ledLayout, 0, sizeof (ledLayout));
+	WS2812layoutUpdate ();
+
+	if (failed)
+	{
+		printf ("FAIL: %d layouts map wrong\n", failed);
+		return 1;
+	}
+	printf ("OK: all layouts map as described\n");
+	return 0;
+}
+
+#endif
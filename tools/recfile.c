@@ -0,0 +1,236 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+
+/*
+ * Parsing and decoding of frame records (see ../framestream.h); shared by the host tools.
+ */
+
+#ifndef __arm__				// host program, empty in the firmware build (see tools/Makefile)
+
+#include <string.h>
+#include "recfile.h"
+
+
+// CRC of the STM32 CRC unit when each byte is written as one 32 bit word
+uint32_t crcByte (uint32_t crc, uint8_t b)
+{
+	int i;
+
+	crc ^= b;
+	for (i = 0; i < 32; i++)
+		crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : (crc << 1);
+	return crc;
+}
+
+
+static uint32_t get32 (const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+/*
+ * Look for one complete record in buf[0..n). Returns the number of bytes consumed: 0 if more data is needed,
+ * otherwise the bytes skipped plus the record length; *rec->payload is NULL when only garbage was skipped.
+ */
+size_t parseRecord (const uint8_t *buf, size_t n, record_t *rec, size_t *start, unsigned long *crcErrors)
+{
+	size_t p = 0;
+
+	rec->payload = NULL;
+	while (p + 1 < n)
+	{
+		if (buf[p] == FS_SYNC0 && buf[p+1] == FS_SYNC1)
+		{
+			size_t total;
+			uint32_t crc = 0xFFFFFFFF;
+			size_t i;
+
+			if (n - p < FS_HEADER_SIZE)
+				return p;
+			total = FS_HEADER_SIZE + (buf[p+8] | (buf[p+9] << 8)) + FS_CRC_SIZE;
+			if (n - p < total)
+				return p;
+
+			for (i = p + 2; i < p + total - FS_CRC_SIZE; i++)
+				crc = crcByte (crc, buf[i]);
+			if (crc == get32 (&buf[p + total - FS_CRC_SIZE]))
+			{
+				rec->type = buf[p+2];
+				rec->flags = buf[p+3];
+				rec->seq = get32 (&buf[p+4]);
+				rec->len = buf[p+8] | (buf[p+9] << 8);
+				rec->payload = &buf[p + FS_HEADER_SIZE];
+				*start = p;
+				return p + total;
+			}
+			(*crcErrors)++;
+		}
+		p++;
+	}
+	return p;
+}
+
+
+// decode an FS_TYPE_RGB payload to w*h RGB triples; returns 0 if the payload is inconsistent
+int decodeRGB (const record_t *rec, uint8_t *rgb, int *w, int *h)
+{
+	static uint8_t planes[MAX_SLOTS * 3];
+	const uint8_t *s = rec->payload + 2;
+	const uint8_t *end = rec->payload + rec->len;
+	int n, i;
+
+	if (rec->len < 2)
+		return 0;
+	*w = rec->payload[0];
+	*h = rec->payload[1];
+	n = *w * *h * 3;
+	if (n > MAX_SLOTS * 3)
+		return 0;
+
+	if (rec->flags & FS_FLAG_RLE)
+	{
+		i = 0;
+		while (s < end && i < n)
+		{
+			int c = *s++;
+
+			if (c < 0x80)
+			{
+				if (s + c + 1 > end || i + c + 1 > n)
+					return 0;
+				memcpy (&planes[i], s, c + 1);
+				s += c + 1;
+				i += c + 1;
+			}
+			else
+			{
+				if (s >= end || i + c - 0x7d > n)
+					return 0;
+				memset (&planes[i], *s++, c - 0x7d);
+				i += c - 0x7d;
+			}
+		}
+		if (i != n || s != end)
+			return 0;
+	}
+	else
+	{
+		if (end - s != n)
+			return 0;
+		memcpy (planes, s, n);
+	}
+
+	// planar rows to RGB triples
+	for (i = 0; i < n; i++)
+	{
+		int row = i / (*w * 3);
+		int c = (i / *w) % 3;
+		int x = i % *w;
+		uint8_t *p = &rgb[(row * *w + x) * 3 + c];
+
+		*p = planes[i];
+		if ((rec->flags & FS_FLAG_DELTA) && x > 0)
+			*p += p[-3];
+	}
+	return 1;
+}
+
+
+
+// write w*h RGB triples as uncompressed FS_TYPE_RGB record; returns 0 on write errors
+int recWriteRGB (FILE *f, uint32_t seq, const uint8_t *rgb, int w, int h)
+{
+	static uint8_t rec[MAX_RECORD];
+	uint16_t len = 2 + w * h * 3;
+	uint32_t crc = 0xFFFFFFFF;
+	int n = 0, x, y, c, i;
+
+	rec[n++] = FS_SYNC0;
+	rec[n++] = FS_SYNC1;
+	rec[n++] = FS_TYPE_RGB;
+	rec[n++] = 0;						// no delta, no RLE
+	for (i = 0; i < 4; i++)
+		rec[n++] = seq >> (8 * i);
+	rec[n++] = len & 0xff;
+	rec[n++] = len >> 8;
+	rec[n++] = w;
+	rec[n++] = h;
+	for (y = 0; y < h; y++)				// planar rows
+		for (c = 0; c < 3; c++)
+			for (x = 0; x < w; x++)
+				rec[n++] = rgb[(y * w + x) * 3 + c];
+
+	for (i = 2; i < n; i++)
+		crc = crcByte (crc, rec[i]);
+	for (i = 0; i < 4; i++)
+		rec[n++] = crc >> (8 * i);
+
+	return fwrite (rec, 1, n, f) == (size_t)n;
+}
+
+int recOpen (recReader_t *r, const char *file)
+{
+	memset (r, 0, sizeof (*r));
+	r->f = fopen (file, "rb");
+	if (r->f == NULL)
+	{
+		perror (file);
+		return 0;
+	}
+	return 1;
+}
+
+
+// next valid record of the file; its payload stays valid until the next call. Returns 0 at end of file.
+int recRead (recReader_t *r, record_t *rec)
+{
+	for (;;)
+	{
+		size_t start = 0;
+		size_t used;
+
+		memmove (r->buf, r->buf + r->used, r->fill - r->used);
+		r->fill -= r->used;
+		r->used = 0;
+
+		used = parseRecord (r->buf, r->fill, rec, &start, &r->crcErrors);
+		if (used == 0)
+		{
+			size_t n = fread (r->buf + r->fill, 1, sizeof (r->buf) - r->fill, r->f);
+
+			if (n == 0)
+				return 0;
+			r->fill += n;
+			continue;
+		}
+		r->used = used;
+		if (rec->payload != NULL)
+			return 1;
+	}
+}
+
+
+void recClose (recReader_t *r)
+{
+	if (r->f != NULL)
+		fclose (r->f);
+	r->f = NULL;
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+
+#ifndef RECFILE_H_
+#define RECFILE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "../framestream.h"
+
+#define		MAX_PAYLOAD		65535
+#define		MAX_RECORD		(FS_HEADER_SIZE + MAX_PAYLOAD + FS_CRC_SIZE)
+#define		MAX_SLOTS		(128 * 128)
+
+typedef struct {
+	uint8_t		type;
+	uint8_t		flags;
+	uint32_t	seq;
+	uint16_t	len;
+	const uint8_t *payload;
+} record_t;
+
+typedef struct {
+	FILE			*f;
+	uint8_t			buf[2 * MAX_RECORD];
+	size_t			fill;
+	size_t			used;				// bytes of the record returned last
+	unsigned long	crcErrors;
+} recReader_t;
+
+uint32_t crcByte (uint32_t crc, uint8_t b);
+size_t parseRecord (const uint8_t *buf, size_t n, record_t *rec, size_t *start, unsigned long *crcErrors);
+int decodeRGB (const record_t *rec, uint8_t *rgb, int *w, int *h);
+int recWriteRGB (FILE *f, uint32_t seq, const uint8_t *rgb, int w, int h);
+int recOpen (recReader_t *r, const char *file);
+int recRead (recReader_t *r, record_t *rec);
+void recClose (recReader_t *r);
+
+#endif /* RECFILE_H_ */
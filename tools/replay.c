@@ -0,0 +1,383 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+/*
+ * Replays recorded frames (see ../framestream.h) or synthetic ones through the slot to LED path of ambiLight.c,
+ * as main() does for every captured picture, and writes the resulting LED frames. It runs as fast as the host
+ * can, so long recordings can be used to tune factorI, frameWidth and dynFramesLimit.
+ *
+ *	replay [options] <recording>|gen:<frames>[:<scene>]
+ *		-o <file>	write LED frames (2*ledsX + 2*ledsY RGB triples per frame, raw)
+ *		-c <file>	compare LED frames with a golden file written by -o; exit code 1 on differences
+ *		-t <n>		tolerance per LED channel for -c (default 0)
+ *		-p <us>		fail if the pipeline takes more than <us> per frame on average
+ *		-i <n>		factorI (1..128)
+ *		-e <n>		frameWidth (slots aggregated per LED)
+ *		-d <n>		dynFramesLimit (0 = black border detection off)
+ *		-m <ms>		LED delay (tvprocDelayMs; pictures are REALTIME_FPS apart)
+ *		-x <n>		ledsX
+ *		-y <n>		ledsY
+ *
+ * Synthetic scenes (deterministic, so their LED output can be kept as golden file):
+ *	mixed		letterbox with moving gradient and a scene cut every 250 frames (default)
+ *	letterbox	static picture (colour blocks, no gradient, no cuts) with black bars at top and bottom
+ *	pillarbox	black bars left and right
+ *	cuts		full picture, new colours every 25 frames
+ *	dark		dim picture just above black level
+ *	saturated	pure primary and secondary colours per screen region
+ *
+ * Regression check after changes of ambiLight.c: tools/golden holds the LED output of every scene (300 frames) and
+ * of a short recording made with "ambitool rec" (capture.rec), written with -o at the default settings.
+ *	make -C tools replay-check		replays all of them with "-c ... -t 1"; fails on any difference
+ *	make -C tools goldens			writes them again, only after an intended change of the LED output
+ * For other settings or recordings write golden files with the old code and compare the new code against them the
+ * same way. Golden files of the code before the sampling matrix (ambiLight.c) need "-t 2": the integrators run per
+ * LED since then.
+ *
+ * Build on Linux:	make -C tools build/replay	(see tools/Makefile)
+ *
+ * Note: long is 64 bit on the host, so the integrators of ambiLight.c cannot overflow here as they might on
+ * the target.
+ */
+
+#ifndef __arm__				// host program, empty in the firmware build (see tools/Makefile)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "main.h"
+#include "ambiLight.h"
+#include "recfile.h"
+
+#define		REALTIME_FPS	50			// pictures per second in full capture mode
+#define		GEN_BARS_Y		5			// letterbox rows of synthetic frames
+#define		GEN_BARS_X		8			// pillarbox columns
+#define		GEN_SCENE		250			// frames per scene in "mixed"
+#define		GEN_CUT			25			// frames per scene in "cuts"
+
+enum { ST_SLOTS2DYN = 0, ST_DYN2IMAGE, ST_IMAGE2LED, STAGES };
+enum { GEN_MIXED = 0, GEN_LETTERBOX, GEN_PILLARBOX, GEN_CUTS, GEN_DARK, GEN_SATURATED, GEN_SCENES };
+
+extern int		frameWidth;
+extern short	dynLeft, dynRight, dynTop, dynBottom;
+
+static const char *stageNames[STAGES] = {"ambiLightSlots2Dyn", "ambiLightDyn2Image", "ambiLightImage2LedRGB"};
+static const char *sceneNames[GEN_SCENES] = {"mixed", "letterbox", "pillarbox", "cuts", "dark", "saturated"};
+static double		stageTime[STAGES];
+
+static rgbValue_t	frame[SLOTS_Y][SLOTS_X];
+
+static unsigned long	genSeed = 1;
+
+
+
+static double now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// own generator so that golden files do not depend on the C library
+static uint8_t genRand (void)
+{
+	genSeed = genSeed * 1103515245 + 12345;
+	return (genSeed >> 16) & 0xff;
+}
+
+
+static uint8_t clampByte (int v)
+{
+	return (v > 255 ? 255 : v);
+}
+
+
+// synthetic picture <n> of a scene
+static void genFrame (unsigned long n, int scene)
+{
+	static uint8_t base[3];
+	int x, y, c;
+
+	if (scene == GEN_LETTERBOX ? n == 0 : n % (scene == GEN_CUTS ? GEN_CUT : GEN_SCENE) == 0)
+		for (c = 0; c < 3; c++)
+			base[c] = genRand();
+
+	for (y = 0; y < SLOTS_Y; y++)
+	{
+		for (x = 0; x < SLOTS_X; x++)
+		{
+			uint8_t v[3];
+			int bar = 0;
+
+			if (scene == GEN_MIXED || scene == GEN_LETTERBOX)
+				bar = (y < GEN_BARS_Y || y >= SLOTS_Y - GEN_BARS_Y);
+			if (scene == GEN_PILLARBOX)
+				bar = (x < GEN_BARS_X || x >= SLOTS_X - GEN_BARS_X);
+
+			for (c = 0; c < 3; c++)
+			{
+				if (bar)
+					v[c] = 16 + (genRand() & 3);
+				else if (scene == GEN_DARK)
+					v[c] = 20 + ((x + y + n / 8 + c * 8) & 0x0f) + (genRand() & 3);
+				else if (scene == GEN_SATURATED)
+				{
+					int region = ((x * 3 / SLOTS_X) + (y * 2 / SLOTS_Y) * 3 + n / 100) % 6 + 1;	// 1..6 = R,G,Y,B,M,C
+
+					v[c] = (region & (1 << c)) ? 255 : 0;
+				}
+				else if (scene == GEN_CUTS)
+					v[c] = clampByte (base[c] + (genRand() & 7));
+				else if (scene == GEN_LETTERBOX)
+					v[c] = clampByte (base[c] / 2 + ((x / 16 + y / 10 + c) & 3) * 32);
+				else
+					v[c] = clampByte (base[c] + ((x + c * 16 + n) & 0x3f) + (y & 0x1f) + (genRand() & 7));
+			}
+			frame[y][x].R = v[0];
+			frame[y][x].G = v[1];
+			frame[y][x].B = v[2];
+		}
+	}
+}
+
+
+// one picture taken at <ms> through the same stages as in main()
+static void processFrame (uint32_t ms)
+{
+	double t0, t1, t2, t3;
+
+	rgbSlots = frame;
+
+	t0 = now ();
+	ambiLightSlots2Dyn ();
+	t1 = now ();
+	ambiLightDyn2Image ();
+	t2 = now ();
+	ambiLightImage2LedRGB (ms);
+	t3 = now ();
+
+	stageTime[ST_SLOTS2DYN] += t1 - t0;
+	stageTime[ST_DYN2IMAGE] += t2 - t1;
+	stageTime[ST_IMAGE2LED] += t3 - t2;
+}
+
+
+int main (int argc, char **argv)
+{
+	static recReader_t in;
+	static rgbValue_t lastLeds[LEDS_MAXTOTAL];
+	static rgbValue_t golden[LEDS_MAXTOTAL];
+	const char *outFile = NULL;
+	const char *goldenFile = NULL;
+	unsigned long genFrames = 0;
+	unsigned long frames = 0, skipped = 0;
+	unsigned long long activity = 0;
+	unsigned long diffLeds = 0, diffFrames = 0, firstDiff = 0;
+	int tolerance = 0, maxDiff = 0, goldenShort = 0;
+	double perfLimit = 0, pipeline = 0;
+	int scene = GEN_MIXED;
+	int delay = 0;
+	int leds, opt, i;
+	FILE *out = NULL, *gold = NULL;
+	double tStart, total;
+
+	while ((opt = getopt (argc, argv, "o:c:t:p:i:e:d:m:x:y:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'o': outFile = optarg; break;
+		case 'c': goldenFile = optarg; break;
+		case 't': tolerance = atoi (optarg); break;
+		case 'p': perfLimit = atof (optarg); break;
+		case 'i': factorI = atoi (optarg); break;
+		case 'e': frameWidth = atoi (optarg); break;
+		case 'd': dynFramesLimit = atoi (optarg); break;
+		case 'm': delay = atoi (optarg); break;
+		case 'x': ledsX = atoi (optarg); break;
+		case 'y': ledsY = atoi (optarg); break;
+		default:
+			optind = argc + 1;
+			break;
+		}
+	}
+	if (optind == argc - 1 && strncmp (argv[optind], "gen:", 4) == 0)
+	{
+		char *s;
+
+		genFrames = strtoul (argv[optind] + 4, &s, 0);
+		if (*s == ':')
+		{
+			for (scene = 0; scene < GEN_SCENES; scene++)
+				if (strcmp (s + 1, sceneNames[scene]) == 0)
+					break;
+		}
+		else if (*s != 0)
+			scene = GEN_SCENES;
+	}
+	if (optind != argc - 1 || factorI < 1 || factorI > 128 || frameWidth < 1 || frameWidth > 11
+			|| delay < 0 || delay > DELAY_MS_MAX || ledsX < 1 || ledsX > LEDS_XMAX || ledsY < 1 || ledsY > LEDS_YMAX
+			|| scene >= GEN_SCENES || tolerance < 0)
+	{
+		fprintf (stderr, "usage: replay [-o ledfile] [-c goldenfile] [-t tolerance] [-p us] [-i factorI] [-e frameWidth]\n"
+						 "              [-d dynFramesLimit] [-m delayMs] [-x ledsX] [-y ledsY]\n"
+						 "              <recording>|gen:<frames>[:mixed|letterbox|pillarbox|cuts|dark|saturated]\n");
+		return 2;
+	}
+
+	if (genFrames == 0 && !recOpen (&in, argv[optind]))
+		return 1;
+
+	if (outFile != NULL && (out = fopen (outFile, "wb")) == NULL)
+	{
+		perror (outFile);
+		return 1;
+	}
+	if (goldenFile != NULL && (gold = fopen (goldenFile, "rb")) == NULL)
+	{
+		perror (goldenFile);
+		return 1;
+	}
+
+	leds = 2 * ledsX + 2 * ledsY;
+	ambiLightInit ();
+	tvprocDelayMs = delay;
+
+	tStart = now ();
+	for (;;)
+	{
+		if (genFrames != 0)
+		{
+			if (frames >= genFrames)
+				break;
+			genFrame (frames, scene);
+		}
+		else
+		{
+			static uint8_t rgb[MAX_SLOTS * 3];
+			record_t rec;
+			int w, h;
+
+			if (!recRead (&in, &rec))
+				break;
+			if (rec.type != FS_TYPE_RGB)
+				continue;
+			if (!decodeRGB (&rec, rgb, &w, &h) || w != SLOTS_X || h != SLOTS_Y)
+			{
+				skipped++;
+				continue;
+			}
+			memcpy (frame, rgb, sizeof (frame));
+		}
+
+		processFrame (frames * 1000 / REALTIME_FPS);
+		frames++;
+
+		for (i = 0; i < leds; i++)
+		{
+			activity += abs (ws2812ledRGB[i].R - lastLeds[i].R) + abs (ws2812ledRGB[i].G - lastLeds[i].G)
+					  + abs (ws2812ledRGB[i].B - lastLeds[i].B);
+			lastLeds[i] = ws2812ledRGB[i];
+		}
+		if (out != NULL)
+			fwrite (ws2812ledRGB, sizeof (rgbValue_t), leds, out);
+
+		if (gold != NULL && !goldenShort)
+		{
+			int bad = 0;
+
+			if (fread (golden, sizeof (rgbValue_t), leds, gold) != (size_t)leds)
+			{
+				goldenShort = 1;
+				continue;
+			}
+			for (i = 0; i < leds; i++)
+			{
+				int d = abs (ws2812ledRGB[i].R - golden[i].R);
+
+				if (abs (ws2812ledRGB[i].G - golden[i].G) > d)
+					d = abs (ws2812ledRGB[i].G - golden[i].G);
+				if (abs (ws2812ledRGB[i].B - golden[i].B) > d)
+					d = abs (ws2812ledRGB[i].B - golden[i].B);
+				if (d > maxDiff)
+					maxDiff = d;
+				if (d > tolerance)
+				{
+					if (diffLeds == 0)
+						firstDiff = frames;
+					diffLeds++;
+					bad = 1;
+				}
+			}
+			diffFrames += bad;
+		}
+	}
+	total = now () - tStart;
+
+	if (out != NULL)
+		fclose (out);
+	if (genFrames == 0)
+		recClose (&in);
+
+	if (frames == 0)
+	{
+		fprintf (stderr, "no frames (%lu skipped, %lu CRC errors)\n", skipped, in.crcErrors);
+		return 1;
+	}
+
+	printf ("%lu frames in %.3f s: %.0f frames/s (%.0f x real time at %d/s)",
+			frames, total, frames / total, frames / total / REALTIME_FPS, REALTIME_FPS);
+	if (genFrames == 0)
+		printf (", %lu skipped, %lu CRC errors", skipped, in.crcErrors);
+	else
+		printf (", scene %s", sceneNames[scene]);
+	printf ("\n");
+	for (i = 0; i < STAGES; i++)
+	{
+		printf ("  %-24s %8.2f us/frame\n", stageNames[i], stageTime[i] * 1e6 / frames);
+		pipeline += stageTime[i] * 1e6 / frames;
+	}
+	printf ("factorI %d, frameWidth %d, dynFramesLimit %d, delay %d ms, LEDs %dx%d\n",
+			(int)factorI, frameWidth, (int)dynFramesLimit, delay, ledsX, ledsY);
+	printf ("dyn borders: left %d, right %d, top %d, bottom %d\n", dynLeft, dynRight, dynTop, dynBottom);
+	printf ("LED activity: %.2f mean |change| per LED channel and frame\n",
+			(double)activity / ((double)frames * leds * 3));
+
+	if (gold != NULL)
+	{
+		if (!goldenShort && fread (golden, 1, 1, gold) == 1)
+			goldenShort = 1;			// golden file has more frames
+		fclose (gold);
+
+		if (goldenShort)
+			printf ("FAIL: golden file has a different number of frames\n");
+		else if (diffLeds != 0)
+			printf ("FAIL: %lu LEDs in %lu frames differ by more than %d (max %d, first in frame %lu)\n",
+					diffLeds, diffFrames, tolerance, maxDiff, firstDiff);
+		else
+			printf ("OK: all frames within tolerance %d (max difference %d)\n", tolerance, maxDiff);
+	}
+	if (perfLimit > 0 && pipeline > perfLimit)
+		printf ("FAIL: %.2f us/frame exceeds limit of %.2f us\n", pipeline, perfLimit);
+
+	return (goldenShort || diffLeds != 0 || (perfLimit > 0 && pipeline > perfLimit)) ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,833 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+/*
+ * Runs ws2812.c unmodified on a Linux host and checks the LED encoder:
+ *	- the table driven bit encoder rgb2pwm() gives the same timer values as the former bit loop for all bytes;
+ *	  both are timed over random frames
+ *	- the delta encoder of WS2812update(): after every update the timer/DMA buffer must be identical to a full
+ *	  encode of all LEDs done here with the bit loop (overlay, gamma, masterBrightness with the division per
+ *	  channel, reset pulse), and the DMA length must be the strip length. Random sequences of static pictures,
+ *	  single and many changed LEDs, overlays, gamma, brightness and strip length changes are applied. A DMA must
+ *	  be started exactly when some LED changed or the last buffer could not be sent (transfer still running). An
+ *	  update while the last transfer is running must leave the buffers it reads alone (no lane remap, no encode).
+ *	- built with -DWS2812_STREAMING=1: the circular DMA over the ring is simulated value by value with the half and
+ *	  full transfer IRQs, and the sent bit stream must be the full encode followed by at least the reset pulse.
+ *	  At the end one transfer is run with the IRQ latency of WS2812_IRQ_BLOCK_US (line IRQs of the capture), which
+ *	  must send the stream without underruns, and one with more than half the ring, which must count underruns.
+ *	- built with -DWS2812_LANES=2, 4 or 8 (ws2812par.c): the bit transposed byte buffer is decoded back into one bit
+ *	  stream per lane; each must be the single strip's LEDs of that lane (split at the edges as described in
+ *	  ws2812par.h, computed here on its own) followed by 0 bits up to the longest lane and the reset pulse. The
+ *	  lengths of the three DMA streams must be the longest lane.
+ *	- built with -DWS2812_APA102=1 (apa102.c): the SPI frame must follow the APA102 / SK9822 spec: 32 bit start
+ *	  frame of zeros, per LED 111 + 5 bit brightness, blue, green, red, then at least 32 + n/2 zero bits. Each LED
+ *	  must give the 16 bit colour computed here within half a step of its 8 bit colour at its brightness, and the
+ *	  brightness must be the smallest reaching the brightest channel. The DMA must send the whole frame as bytes
+ *	  to the SPI.
+ *	Random LED layouts (segments with gaps, also longer than LEDS_MAXTOTAL) and the ring are used in all builds.
+ *
+ *	ws2812check [-n updates]
+ *
+ * As in capsim, the peripheral and Cortex-M system address ranges are mapped as plain memory at their real
+ * addresses, so the StdPeriph driver runs on these "registers"; the DMA transfer complete IRQ is called here.
+ * The output options are separate builds: -DWS2812_STREAMING=1, -DWS2812_LANES=2/4/8 (8 lanes also with
+ * -DWS2812PAR_BOARD_PINS=0: no free port byte on the Discovery board, see ws2812par.h) and -DWS2812_APA102=1;
+ * tools/Makefile builds them as ws2812check-streaming, -lanes2, -lanes4, -lanes8 and -apa102.
+ *
+ * Build on Linux:	make -C tools build/ws2812check	(see tools/Makefile)
+ */
+
+#ifndef __arm__				// host program, empty in the firmware build (see tools/Makefile)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../ws2812.c"				// the LED module itself, including its static data
+#if WS2812_LANES > 1
+#include "../ws2812par.c"
+#define		WS2812_DMA_DONE		DMA2_Stream4_IRQHandler
+#elif WS2812_APA102
+#include "../apa102.c"
+#define		WS2812_DMA_DONE		DMA1_Stream4_IRQHandler
+#else
+#define		WS2812_DMA_DONE		DMA1_Stream7_IRQHandler
+#endif
+
+// buffer a running transfer reads, besides the GRB values of the LEDs (the source of the streaming ring encoder)
+#if WS2812_LANES > 1
+#define		DMA_SOURCE			ws2812parBits
+#elif WS2812_APA102
+#define		DMA_SOURCE			apa102frame
+#elif !WS2812_STREAMING
+#define		DMA_SOURCE			ws2812timerValues
+#endif
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE		0x100000
+#endif
+
+#define		HOST_PERIPH_SIZE	(AHB1PERIPH_BASE + 0x8000 - PERIPH_BASE)
+#define		HOST_CORE_BASE		0xE0000000UL
+#define		HOST_CORE_SIZE		0x00100000UL
+#define		BENCH_FRAMES		2000
+
+uint32_t		hostPrimask = 0;
+uint32_t		SystemCoreClock = 168000000;
+int				masterBrightness = 100;
+
+static uint16_t	reference[WS2812_MAXDMA_LEN];
+static uint32_t	refGRB[LEDS_MAXTOTAL];			// GRB sent last (model of the LEDs)
+static short	refLeds = 0;
+static uint8_t	refPending = 0;
+static unsigned long	busyUpdates = 0;
+
+static uint32_t	busyEncoded[LEDS_MAXTOTAL];		// copies taken before an update while the last transfer runs
+#ifdef DMA_SOURCE
+static uint8_t	busySource[sizeof (DMA_SOURCE)];
+#endif
+
+static unsigned long	genSeed = 1;
+
+#if WS2812_LANES > 1
+static short	laneOfLed[WS2812_LANES][LEDS_MAXTOTAL];	// strip LED at each lane position
+static short	laneLeds[WS2812_LANES];
+static double	timeSingle = 0, timeLanes = 0;			// transmission time (bits) of all transfers
+#endif
+
+#if WS2812_APA102
+static uint16_t	ref16[LEDS_MAXTOTAL][3];					// 16 bit R, G, B of every LED
+#endif
+
+#if WS2812_STREAMING
+#define		STREAM_MAX			(WS2812_MAXDMA_LEN + 4 * WS2812_RING_HALF)
+static uint16_t	stream[STREAM_MAX];				// timer values sent by the simulated DMA
+#endif
+
+
+
+void delay_ms (uint16_t time_ms) { (void)time_ms; }
+
+
+static int genRand (int n)
+{
+	genSeed = genSeed * 1103515245 + 12345;
+	return (genSeed >> 16) % n;
+}
+
+
+static double now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static int mapRegion (unsigned long base, unsigned long size)
+{
+	void *p = mmap ((void*)base, size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE | MAP_NORESERVE, -1, 0);
+
+	if (p != (void*)base)
+	{
+		fprintf (stderr, "cannot map register space at 0x%08lx\n", base);
+		return 0;
+	}
+	return 1;
+}
+
+
+// the bit encoder before the table
+static uint16_t *rgb2pwmLoop (uint16_t *dest, const uint8_t color)
+{
+	register uint8_t mask = 0x80;
+
+	do
+	{
+		if (color & mask)
+			*dest = WS2812_PWM_ONE;
+		else
+			*dest = WS2812_PWM_ZERO;
+
+		dest++;
+		mask >>= 1;
+	} while (mask != 0);
+
+	return dest;
+}
+
+
+static uint8_t gammaBrightness (uint8_t c)
+{
+	int g = c;
+
+	if (ws2812gamma != WS2812_GAMMA_LINEAR)
+		g = (int)(255.0f * powf (c / 255.0f, ws2812gamma / 10.0f) + 0.5f);
+	return (uint8_t)((g * masterBrightness) / 100);
+}
+
+
+// table against loop for all bytes and timing of both over random frames of LEDS_MAXTOTAL LEDs; returns failures
+static int checkBitEncoder (void)
+{
+	static uint8_t frame[LEDS_MAXTOTAL * 3];
+	static uint16_t bufLoop[LEDS_MAXTOTAL * 24] __attribute__ ((aligned (4)));
+	static uint16_t bufTable[LEDS_MAXTOTAL * 24] __attribute__ ((aligned (4)));
+	double tLoop = 0, tTable = 0, t;
+	int c, f, i, fails = 0;
+
+	for (c = 0; c < 256; c++)
+	{
+		rgb2pwmLoop (bufLoop, c);
+		rgb2pwm (bufTable, c);
+		if (memcmp (bufLoop, bufTable, 8 * sizeof (uint16_t)) != 0)
+		{
+			if (fails++ < 10)
+				printf ("byte 0x%02x: table differs from bit loop\n", c);
+		}
+	}
+
+	for (f = 0; f < BENCH_FRAMES; f++)
+	{
+		uint16_t *p;
+
+		for (i = 0; i < LEDS_MAXTOTAL * 3; i++)
+			frame[i] = genRand (256);
+
+		t = now ();
+		for (p = bufLoop, i = 0; i < LEDS_MAXTOTAL * 3; i++)
+			p = rgb2pwmLoop (p, frame[i]);
+		tLoop += now () - t;
+
+		t = now ();
+		for (p = bufTable, i = 0; i < LEDS_MAXTOTAL * 3; i++)
+			p = rgb2pwm (p, frame[i]);
+		tTable += now () - t;
+
+		if (memcmp (bufLoop, bufTable, sizeof (bufLoop)) != 0)
+		{
+			if (fails++ < 10)
+				printf ("frame %d: table differs from bit loop\n", f);
+		}
+	}
+
+	printf ("bit encoder, %d LEDs: loop %.2f us, table %.2f us per frame (%.1fx)\n", LEDS_MAXTOTAL,
+			tLoop * 1e6 / BENCH_FRAMES, tTable * 1e6 / BENCH_FRAMES, tLoop / tTable);
+	return fails;
+}
+
+
+#if WS2812_STREAMING
+// the IRQ handler as the NVIC calls it: again as long as a flag is pending; the flag clear register is emulated
+static void streamIrq (void)
+{
+	int n;
+
+	for (n = 0; n < 4 && (DMA1->HISR & (DMA_HISR_HTIF7 | DMA_HISR_TCIF7)); n++)
+	{
+		DMA1->HIFCR = 0;
+		DMA1_Stream7_IRQHandler ();
+		DMA1->HISR &= ~DMA1->HIFCR;
+	}
+}
+
+
+// circular DMA from the ring to the timer until the IRQ handler disables the stream; the IRQ is served <latency>
+// transfers after the half or full flag was set. Returns the number of timer values sent or -1 if it did not stop.
+static int runStream (int latency)
+{
+	int n = 0, pos = 0, wait = -1;
+
+	while (WS2812_DMA_STREAM->CR & DMA_SxCR_EN)
+	{
+		if (n >= STREAM_MAX)
+			return -1;
+		stream[n++] = ws2812ring[pos++];
+		WS2812_DMA_STREAM->NDTR--;
+		if (pos == WS2812_RING_HALF)
+			DMA1->HISR |= DMA_HISR_HTIF7;
+		else if (pos == 2 * WS2812_RING_HALF)
+		{
+			pos = 0;
+			WS2812_DMA_STREAM->NDTR = 2 * WS2812_RING_HALF;
+			DMA1->HISR |= DMA_HISR_TCIF7;
+		}
+		if (wait < 0 && (DMA1->HISR & (DMA_HISR_HTIF7 | DMA_HISR_TCIF7)))
+			wait = latency;
+		if (wait >= 0 && wait-- == 0)
+			streamIrq ();
+	}
+	return n;
+}
+
+
+// the sent stream must be the reference (LEDs + reset pulse) with only zeros behind it
+static int checkStream (int n)
+{
+	int i;
+
+	if (n < WS2812_TIMERDMA_LEN || memcmp (stream, reference, WS2812_TIMERDMA_LEN * sizeof (uint16_t)) != 0)
+		return 0;
+	for (i = WS2812_TIMERDMA_LEN; i < n; i++)
+		if (stream[i] != 0)
+			return 0;
+	return 1;
+}
+#endif
+
+
+#if WS2812_LANES > 1
+// split the strip onto the lanes: 2 lanes right+top / left+bottom, 4 lanes one per edge, 8 lanes edges in halves
+static int laneSplit (void)
+{
+	static uint8_t edge[LEDS_MAXTOTAL];
+	short edgeLeds[LED_EDGES] = {0}, edgeDone[LED_EDGES] = {0};
+	int n = 0, s, k, longest = 0;
+
+	if (ledLayout[0].leds == 0)
+	{
+		int len[LED_EDGES] = {ledsY, ledsX, ledsY, ledsX};		// right, top, left, bottom
+
+		for (s = 0; s < LED_EDGES; s++)
+			for (k = 0; k < len[s] && n < ledsPhysical; k++)
+				edge[n++] = s;
+	}
+	else
+	{
+		for (s = 0; s < LED_SEGMENTS && ledLayout[s].leds != 0; s++)
+			for (k = 0; k < ledLayout[s].skip + ledLayout[s].leds && n < ledsPhysical; k++)
+				edge[n++] = ledLayout[s].edge % LED_EDGES;
+	}
+	for (k = 0; k < n; k++)
+		edgeLeds[edge[k]]++;
+
+	memset (laneLeds, 0, sizeof (laneLeds));
+	for (k = 0; k < n; k++)
+	{
+		int e = edge[k], l;
+
+		if (WS2812_LANES == 2)
+			l = e / 2;
+		else if (WS2812_LANES == 4)
+			l = e;
+		else
+			l = 2 * e + (2 * edgeDone[e]++ >= edgeLeds[e]);
+		laneOfLed[l][laneLeds[l]++] = k;
+		if (laneLeds[l] > longest)
+			longest = laneLeds[l];
+	}
+	return longest;
+}
+
+
+// split again; returns 1 if any LED is on another lane position now
+static int laneSplitChanged (void)
+{
+	static short before[WS2812_LANES][LEDS_MAXTOTAL];
+	short beforeLeds[WS2812_LANES];
+	int l;
+
+	memcpy (before, laneOfLed, sizeof (before));
+	memcpy (beforeLeds, laneLeds, sizeof (beforeLeds));
+	laneSplit ();
+	if (memcmp (beforeLeds, laneLeds, sizeof (laneLeds)) != 0)
+		return 1;
+	for (l = 0; l < WS2812_LANES; l++)
+		if (memcmp (before[l], laneOfLed[l], laneLeds[l] * sizeof (short)) != 0)
+			return 1;
+	return 0;
+}
+
+
+// decode the lanes from the transposed buffer and compare them with the LEDs; returns 0 on a difference
+static int checkLanes (unsigned long u)
+{
+	int longest = laneSplit (), l, p, b;
+
+	if (longest != ws2812parLongest)
+	{
+		printf ("update %lu: longest lane %d, expected %d\n", u, ws2812parLongest, longest);
+		return 0;
+	}
+	for (l = 0; l < WS2812_LANES; l++)
+	{
+		uint16_t bit = WS2812PAR_LANE_BIT (l);
+
+		for (p = 0; p * 24 < longest * 24 + WS2812_RESET_LEN; p++)
+		{
+			uint32_t grb = 0, expect = (p < laneLeds[l] ? refGRB[laneOfLed[l][p]] : 0);
+
+			for (b = 0; b < 24; b++)
+			{
+				int k = p * 24 + b;
+
+				if (k >= longest * 24 + WS2812_RESET_LEN)
+					break;
+				grb = (grb << 1) | !(ws2812parBits[k] & bit);		// 1 = stays high after T0H
+			}
+			if (b == 24 && grb != expect)
+			{
+				printf ("update %lu: lane %d LED %d is %06x, expected %06x\n", u, l, p, grb, expect);
+				return 0;
+			}
+			if (b < 24 && grb != 0)
+			{
+				printf ("update %lu: lane %d: no reset pulse\n", u, l);
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+#endif
+
+
+#if WS2812_APA102
+static uint16_t gammaBrightness16 (uint8_t c)
+{
+	float f = c / 255.0f;
+
+	if (ws2812gamma != WS2812_GAMMA_LINEAR)
+		f = powf (f, ws2812gamma / 10.0f);
+	return (uint16_t)(65535.0f * f * masterBrightness / 100 + 0.5f);
+}
+
+
+// the SPI frame against the spec and the 16 bit colours; returns 0 on an error
+static int checkApa102 (unsigned long u)
+{
+	int n = ledsPhysical, len = APA102_FRAME_LEN (n), i, k;
+
+	for (k = 0; k < APA102_START_LEN; k++)
+	{
+		if (apa102frame[k] != 0)
+		{
+			printf ("update %lu: no start frame\n", u);
+			return 0;
+		}
+	}
+	for (i = 0; i < n; i++)
+	{
+		uint8_t *led = &apa102frame[APA102_START_LEN + 4 * i];
+		uint32_t bright = led[0] & 0x1f;
+		uint32_t max = ref16[i][0];
+
+		for (k = 1; k < 3; k++)
+			if (ref16[i][k] > max)
+				max = ref16[i][k];
+
+		if ((led[0] & 0xe0) != 0xe0)
+		{
+			printf ("update %lu: LED %d without 111 bits (0x%02x)\n", u, i, led[0]);
+			return 0;
+		}
+		if ((APA102_GLOBAL_DIM && (max * 31 > bright * 65535 || (bright > 0 && (bright - 1) * 65535 >= max * 31)))
+				|| (!APA102_GLOBAL_DIM && bright != 31))
+		{
+			printf ("update %lu: LED %d brightness %u for %u\n", u, i, bright, max);
+			return 0;
+		}
+		for (k = 0; k < 3; k++)
+		{
+			long long c = led[3 - k];									// red, green, blue
+			long long err = 2 * c * bright * 65535 - 2LL * ref16[i][k] * 255 * 31;
+
+			if (err > (long long)bright * 65535 || err < -(long long)bright * 65535 || (bright == 0 && c != 0))
+			{
+				printf ("update %lu: LED %d colour %d is %d at %u, expected %u / 65535\n", u, i, k, (int)c, bright,
+						ref16[i][k]);
+				return 0;
+			}
+		}
+	}
+	if ((len - APA102_START_LEN - 4 * n) * 8 < 32 + n / 2)
+	{
+		printf ("update %lu: reset and end frame too short for %d LEDs\n", u, n);
+		return 0;
+	}
+	for (k = APA102_START_LEN + 4 * n; k < len; k++)
+	{
+		if (apa102frame[k] != 0)
+		{
+			printf ("update %lu: no reset / end frame\n", u);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+// distinct levels of a grey ramp below 10 % with 8 bit colours and with the APA102 brightness
+static void darkLevels (void)
+{
+	static uint8_t seen8[256];
+	static uint8_t seenApa[256 * 32];
+	int c, n8 = 0, nApa = 0;
+
+	ws2812gamma = 22;
+	masterBrightness = 100;
+	for (c = 0; c < 256; c++)
+	{
+		uint8_t v8 = gammaBrightness (c);
+		uint32_t frame = APA102ledFrame (gammaBrightness16 (c), 0, 0);
+		int level = (frame & 0xff) * (frame >> 24);				// 0 .. 255 * 31
+
+		if (v8 * 10 < 255 && !seen8[v8]++)
+			n8++;
+		if (level * 10 < 255 * 31 && !seenApa[level]++)
+			nApa++;
+	}
+	printf ("grey levels below 10 %% at gamma 2.2: %d with 8 bit colours, %d with APA102 brightness\n", n8, nApa);
+}
+#endif
+
+
+// full encode of all LEDs as WS2812update() did before the delta encoder; returns the number of changed LEDs
+static int encodeReference (void)
+{
+	uint16_t *p = reference;
+	int i, changed = 0;
+
+	for (i = 0; i < ledsPhysical; i++)
+	{
+		uint32_t grb;
+
+		if (ws2812ovrlayCounter && ws2812ledHasOVR[i])
+			grb = (ws2812ledOVR[i].G << 16) | (ws2812ledOVR[i].R << 8) | ws2812ledOVR[i].B;
+		else
+			grb = (gammaBrightness (ws2812ledRGB[i].G) << 16) | (gammaBrightness (ws2812ledRGB[i].R) << 8)
+				| gammaBrightness (ws2812ledRGB[i].B);
+
+		p = rgb2pwmLoop (p, grb >> 16);
+		p = rgb2pwmLoop (p, grb >> 8);
+		p = rgb2pwmLoop (p, grb);
+
+#if WS2812_APA102
+		if (ws2812ovrlayCounter && ws2812ledHasOVR[i])
+		{
+			ref16[i][0] = ws2812ledOVR[i].R * 257;
+			ref16[i][1] = ws2812ledOVR[i].G * 257;
+			ref16[i][2] = ws2812ledOVR[i].B * 257;
+		}
+		else
+		{
+			ref16[i][0] = gammaBrightness16 (ws2812ledRGB[i].R);
+			ref16[i][1] = gammaBrightness16 (ws2812ledRGB[i].G);
+			ref16[i][2] = gammaBrightness16 (ws2812ledRGB[i].B);
+		}
+		grb = APA102ledFrame (ref16[i][0], ref16[i][1], ref16[i][2]);		// changes are seen on the LED frame
+#endif
+
+		if (refLeds != ledsPhysical || grb != refGRB[i])
+			changed++;
+		refGRB[i] = grb;
+	}
+	for (i = 0; i < WS2812_RESET_LEN; i++)
+		*p++ = 0;
+
+	refLeds = ledsPhysical;
+	return changed;
+}
+
+
+static void randomLed (int i)
+{
+	ws2812ledRGB[i].R = genRand (256);
+	ws2812ledRGB[i].G = genRand (256);
+	ws2812ledRGB[i].B = genRand (256);
+}
+
+
+int main (int argc, char **argv)
+{
+	unsigned long updates = 5000, u, fails = 0, dmaStarts = 0, skipped = 0, partial = 0, encodedLeds = 0;
+	double tStatic = 0, tAll = 0, t;
+	int opt, i, n;
+
+	while ((opt = getopt (argc, argv, "n:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': updates = strtoul (optarg, NULL, 0); break;
+		default: optind = argc + 1; break;
+		}
+	}
+	if (optind != argc || updates == 0)
+	{
+		fprintf (stderr, "usage: ws2812check [-n updates]\n");
+		return 2;
+	}
+
+	if (!mapRegion (PERIPH_BASE, HOST_PERIPH_SIZE) || !mapRegion (HOST_CORE_BASE, HOST_CORE_SIZE))
+		return 1;
+
+	fails += checkBitEncoder ();
+
+	WS2812init ();
+#if WS2812_LANES > 1
+	refLeds = ledsPhysical;				// init sent all LEDs black
+	laneSplit ();
+#elif WS2812_APA102
+	refLeds = ledsPhysical;				// init sent all LEDs black
+#endif
+#if WS2812_STREAMING
+	refLeds = ledsPhysical;				// init sent all LEDs black from the GRB values
+	if (runStream (0) < 0)
+	{
+		printf ("DMA of the init transfer not stopped\n");
+		fails++;
+	}
+#else
+	WS2812_DMA_DONE ();					// transfer of the init buffer done
+#endif
+
+	for (u = 0; u < updates; u++)
+	{
+		int change = genRand (100), changed;
+		int busy = (genRand (12) == 0);		// last transfer still running
+
+		if (change < 30)					// static picture
+			;
+		else if (change < 55)				// a few LEDs
+		{
+			for (n = genRand (4) + 1; n > 0; n--)
+				randomLed (genRand (ledsPhysical));
+		}
+		else if (change < 75)				// all LEDs
+		{
+			for (i = 0; i < ledsPhysical; i++)
+				randomLed (i);
+		}
+		else if (change < 82)				// overlay on/off or on other LEDs
+		{
+			ws2812ovrlayCounter = genRand (2);
+			for (i = 0; i < ledsPhysical; i++)
+			{
+				ws2812ledHasOVR[i] = (genRand (8) == 0);
+				ws2812ledOVR[i].R = ws2812ledOVR[i].G = ws2812ledOVR[i].B = genRand (256);
+			}
+		}
+		else if (change < 85)				// brightness
+			masterBrightness = genRand (101);
+		else if (change < 88)				// gamma
+			ws2812gamma = WS2812_GAMMA_LINEAR + genRand (WS2812_GAMMA_MAX - WS2812_GAMMA_LINEAR + 1);
+		else if (change < 92)				// strip length
+		{
+			ledsX = genRand (LEDS_XMAX) + 1;
+			ledsY = genRand (LEDS_YMAX) + 1;
+		}
+		else if (change < 95)				// segment layout or ring
+		{
+			memset (ledLayout, 0, sizeof (ledLayout));
+			if (genRand (3) != 0)
+			{
+				for (n = genRand (LED_SEGMENTS) + 1, i = 0; i < n; i++)
+				{
+					ledLayout[i].edge = genRand (LED_EDGES);
+					ledLayout[i].from = genRand (101);
+					ledLayout[i].to = genRand (101);
+					ledLayout[i].leds = genRand (80) + 1;
+					ledLayout[i].skip = genRand (4);
+				}
+			}
+			WS2812layoutUpdate ();
+		}
+
+		if (busy)							// the buffers must not change; all is sent with the next update
+		{
+			ledBusy = 1;
+			memcpy (busyEncoded, ws2812encoded, sizeof (busyEncoded));
+#ifdef DMA_SOURCE
+			memcpy (busySource, DMA_SOURCE, sizeof (busySource));
+#endif
+			WS2812update ();
+			if (memcmp (busyEncoded, ws2812encoded, sizeof (busyEncoded)) != 0
+#ifdef DMA_SOURCE
+					|| memcmp (busySource, DMA_SOURCE, sizeof (busySource)) != 0
+#endif
+					)
+			{
+				if (fails++ < 10)
+					printf ("update %lu: buffers of the running transfer changed (%d LEDs)\n", u, ledsPhysical);
+			}
+			busyUpdates++;
+			refPending = 1;
+#if WS2812_STREAMING
+			ledBusy = 0;
+#else
+			WS2812_DMA_DONE ();
+#endif
+			continue;
+		}
+
+#if WS2812_LANES > 1
+		if (laneSplitChanged ())			// all LEDs sent again on their new lanes
+			refLeds = 0;
+#endif
+		changed = encodeReference ();
+		t = now ();
+		WS2812update ();
+		t = now () - t;
+		if (change < 30)
+			tStatic += t;
+		else if (change < 75 && change >= 55)
+			tAll += t;
+
+#if WS2812_LANES > 1
+		if (!checkLanes (u))
+			fails++;
+#elif !WS2812_STREAMING && !WS2812_APA102
+		if (memcmp (ws2812timerValues, reference, WS2812_TIMERDMA_LEN * sizeof (uint16_t)) != 0)
+		{
+			if (fails++ < 10)
+				printf ("update %lu: buffer differs from full encode (%d LEDs)\n", u, ledsPhysical);
+		}
+#endif
+
+		if (changed == 0 && !refPending)
+			skipped++;
+		else if (changed != 0 && changed < ledsPhysical)
+			partial++;
+		encodedLeds += changed;
+
+		if (changed != 0 || refPending)		// a transfer must have been started
+		{
+#if WS2812_STREAMING
+			if (!ledBusy || !checkStream (runStream (0)))
+			{
+				if (fails++ < 10)
+					printf ("update %lu: no DMA or stream differs from full encode (%d LEDs)\n", u, ledsPhysical);
+			}
+#elif WS2812_LANES > 1
+			if (!ledBusy || WS2812PAR_DMA_DATA->NDTR != ws2812parLongest * 24 + WS2812_RESET_LEN
+					|| WS2812PAR_DMA_RESET->NDTR != WS2812PAR_DMA_DATA->NDTR
+					|| (ws2812parLongest != 0 && WS2812PAR_DMA_SET->NDTR != ws2812parLongest * 24)
+					|| WS2812PAR_DMA_DATA->PAR != WS2812PAR_DATA_REG				// bytes into BSRRH
+					|| (WS2812PAR_DMA_DATA->CR & (DMA_SxCR_MSIZE | DMA_SxCR_PSIZE)) != 0)
+			{
+				if (fails++ < 10)
+					printf ("update %lu: no DMA or wrong lengths %lu/%lu/%lu for %d bits\n", u,
+							(unsigned long)WS2812PAR_DMA_SET->NDTR, (unsigned long)WS2812PAR_DMA_DATA->NDTR,
+							(unsigned long)WS2812PAR_DMA_RESET->NDTR, ws2812parLongest * 24);
+			}
+			timeSingle += ledsPhysical * 24.0 / WS2812_OUT_FREQ;
+			timeLanes += ws2812parLongest * 24.0 / WS2812_OUT_FREQ;
+#elif WS2812_APA102
+			if (!ledBusy || APA102_DMA_STREAM->NDTR != APA102_FRAME_LEN (ledsPhysical)
+					|| APA102_DMA_STREAM->PAR != (uint32_t)&APA102_SPI->DR
+					|| (APA102_DMA_STREAM->CR & (DMA_SxCR_MSIZE | DMA_SxCR_PSIZE)) != 0
+					|| !(APA102_SPI->CR2 & SPI_CR2_TXDMAEN))
+			{
+				if (fails++ < 10)
+					printf ("update %lu: no SPI DMA or wrong length %lu\n", u, (unsigned long)APA102_DMA_STREAM->NDTR);
+			}
+			if (!checkApa102 (u))				// the frame as it is sent
+				fails++;
+#else
+			if (!ledBusy || WS2812_DMA_STREAM->NDTR != WS2812_TIMERDMA_LEN)
+			{
+				if (fails++ < 10)
+					printf ("update %lu: no DMA or wrong length %lu\n", u, (unsigned long)WS2812_DMA_STREAM->NDTR);
+			}
+#endif
+			dmaStarts++;
+			refPending = 0;
+		}
+		else if (ledBusy)
+		{
+			if (fails++ < 10)
+				printf ("update %lu: DMA without change\n", u);
+		}
+
+#if WS2812_STREAMING
+		ledBusy = 0;						// transfer done (the simulated ones stopped already)
+#else
+		WS2812_DMA_DONE ();					// transfer done
+#endif
+	}
+
+	printf ("%lu updates: %lu DMA transfers, %lu skipped, %lu partial, %lu while busy, %.1f LEDs encoded per update\n",
+			updates, dmaStarts, ws2812skipped, ws2812partial, ws2812busy, (double)encodedLeds / updates);
+	printf ("host time per update: %.2f us static picture, %.2f us all LEDs changed\n",
+			tStatic * 1e6 / (updates * 30 / 100), tAll * 1e6 / (updates * 20 / 100));
+
+	if (ws2812updates != updates || ws2812skipped != skipped || ws2812partial != partial || ws2812busy != busyUpdates)
+	{
+		printf ("counters: %lu/%lu updates, %lu/%lu skipped, %lu/%lu partial, %lu/%lu busy\n", ws2812updates, updates,
+				ws2812skipped, skipped, ws2812partial, partial, ws2812busy, busyUpdates);
+		fails++;
+	}
+#if WS2812_APA102
+	darkLevels ();
+#endif
+#if WS2812_LANES > 1
+	printf ("%d lanes: %.2f ms per transfer instead of %.2f ms on one line, bit buffer %d bytes instead of %d\n",
+			WS2812_LANES, timeLanes * 1e3 / dmaStarts, timeSingle * 1e3 / dmaStarts, (int)sizeof (ws2812parBits),
+			(int)(WS2812_MAXDMA_LEN * sizeof (uint16_t)));
+#endif
+#if WS2812_STREAMING
+	printf ("streaming: ring of %d LEDs = %d bytes instead of %d bytes for %d LEDs\n", WS2812_RING_LEDS,
+			(int)sizeof (ws2812ring), (int)(WS2812_MAXDMA_LEN * sizeof (uint16_t)), LEDS_MAXTOTAL);
+	if (ws2812underruns != 0)
+	{
+		printf ("%lu underruns without IRQ latency\n", ws2812underruns);
+		fails++;
+	}
+
+	ledsX = LEDS_XMAX;						// IRQ delayed by the line IRQs of the capture (1.25 us per value)
+	ledsY = LEDS_YMAX;
+	for (i = 0; i < LEDS_MAXTOTAL; i++)
+		randomLed (i);
+	encodeReference ();
+	WS2812update ();
+	n = checkStream (runStream (WS2812_IRQ_BLOCK_US * 4 / 5));
+	if (!n || ws2812underruns != 0)
+	{
+		printf ("IRQ blocked %d us: %lu underruns, stream %s\n", WS2812_IRQ_BLOCK_US, ws2812underruns,
+				n ? "ok" : "corrupted");
+		fails++;
+	}
+	ledBusy = 0;
+
+	for (i = 0; i < LEDS_MAXTOTAL; i++)		// IRQ served after the DMA wrapped into the half to refill
+		randomLed (i);
+	encodeReference ();
+	WS2812update ();
+	n = checkStream (runStream (WS2812_RING_HALF + 8));
+	if (n || ws2812underruns == 0)
+	{
+		printf ("late IRQ: %lu underruns, stream %s\n", ws2812underruns, n ? "not corrupted" : "corrupted");
+		fails++;
+	}
+	ledBusy = 0;
+#endif
+
+	if (fails)
+	{
+		printf ("FAIL: %lu errors\n", fails);
+		return 1;
+	}
+	printf ("OK: table encoder identical to bit loop, delta encoded buffer identical to full encode in all updates\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,678 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+/*
+ * Compares ambiLightDyn2Image() (one pass over the compiled slot to LED sampling matrix) and the same edge zones
+ * taken from the summed-area table of ambiLightZoneSum() (table build every frame, frameWidth rectangle sums per
+ * zone) with the former loops, which are kept below as reference: edge zones into the block image, then blocks to
+ * LEDs. It runs frame widths 1..11 and LED strips of 50..432 LEDs; the LED count is split 16:9 into ledsX and ledsY
+ * (at most LEDS_XMAX and LEDS_YMAX), the image has one block per LED up to SLOTS_X * SLOTS_Y blocks. factorI is 128,
+ * so the integrators hold the values of the last frame; all paths are compared LED by LED (the reference rounds at
+ * every step, the matrix and the table once per LED or zone, so they may differ by 1). The matrix compile time is
+ * printed as well; it is only spent when the geometry or the dyn borders change.
+ *
+ *	zonebench [-n frames]
+ *
+ * The times are host times per frame; on the target the ratio is similar, the absolute values are not.
+ *
+ * Build on Linux:	make -C tools build/zonebench	(see tools/Makefile)
+ */
+
+#ifndef __arm__				// host program, empty in the firmware build (see tools/Makefile)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "main.h"
+#include "ambiLight.h"
+
+#define		BENCH_PICTURES	16			// different pictures cycled through
+#define		MAX_DIFF		1			// allowed difference per channel to the reference
+
+extern int		frameWidth;
+extern short	dynLeft, dynRight, dynTop, dynBottom;
+
+static const short	ledCounts[] = {50, 100, 150, 200, 250, 312, 432};
+
+static rgbValue_t		pictures[BENCH_PICTURES][SLOTS_Y][SLOTS_X];
+static rgbIcontroller_t	refImage [2*SLOTS_X + 2*SLOTS_Y];
+static rgbValue_t		refLeds [LEDS_MAXTOTAL];
+static rgbIcontroller_t	tableImage [2*SLOTS_X + 2*SLOTS_Y];
+static rgbValue_t		tableLeds [LEDS_MAXTOTAL];
+static rgbValue_t		matrixLeds [LEDS_MAXTOTAL];
+
+static unsigned long	genSeed = 1;
+
+
+
+static double now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static uint8_t genRand (void)
+{
+	genSeed = genSeed * 1103515245 + 12345;
+	return (genSeed >> 16) & 0xff;
+}
+
+
+/*
+ * ambiLightDyn2Image() before the sampling matrix (writes refImage)
+ */
+static void loopDyn2Image (void)
+{
+	int i;
+	int j;
+	long  rVal, gVal, bVal;
+	short curImage;
+	short cntVal;
+	short dv;
+
+	/*
+	 * right edge
+	 */
+	curImage = 0;			// = bottom right
+	cntVal = 0;
+	rVal = gVal = bVal = 0;
+	dv = 0;
+
+	int d = (2<<frameWidth) - 1;
+
+	for (i = SLOTS_Y-1; i >= 0; i--)
+	{
+		if (i <= dynBottom && i >= dynTop)	// else do not change R/G/B vals because blocks should be black (avoids black flickering of LEDs)
+		{
+			for (j = 0; j < frameWidth; j++)
+			{
+				long n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[i][dynRight-j].R;
+				rVal += (n / d);
+
+				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[i][dynRight-j].G;
+				gVal += (n / d);
+
+				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[i][dynRight-j].B;
+				bVal += (n / d);
+			}
+		}
+		cntVal++;
+
+		dv += rgbImageHigh;
+		if (dv >= SLOTS_Y)
+		{
+			while (dv >= SLOTS_Y)
+			{
+				dv -= SLOTS_Y;
+				computeI (&refImage [curImage], rVal / 100 / cntVal, gVal / 100 / cntVal, bVal / 100 / cntVal);
+				curImage++;
+			}
+			rVal = gVal = bVal = 0;
+			cntVal = 0;
+		}
+	}
+
+	// left edge
+	curImage = rgbImageHigh + rgbImageWid;			// top left starts at <right edge leds> + <top edge leds>
+	cntVal = 0;
+	rVal = gVal = bVal = 0;
+	dv = 0;
+
+	for (i = 0; i < SLOTS_Y; i++)
+	{
+		if (i <= dynBottom && i >= dynTop)	// else do not change R/G/B vals because blocks should be black (avoids black flickering of LEDs)
+		{
+			for (j = 0; j < frameWidth; j++)
+			{
+				long n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[i][dynLeft+j].R;
+				rVal += (n / d);
+
+				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[i][dynLeft+j].G;
+				gVal += (n / d);
+
+				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[i][dynLeft+j].B;
+				bVal += (n / d);
+			}
+		}
+
+		cntVal++;
+
+		dv += rgbImageHigh;
+		if (dv >= SLOTS_Y)
+		{
+			while (dv >= SLOTS_Y)
+			{
+				dv -= SLOTS_Y;
+				computeI (&refImage [curImage], rVal / 100 / cntVal, gVal / 100 / cntVal, bVal / 100 / cntVal);
+				curImage++;
+			}
+			rVal = gVal = bVal = 0;
+			cntVal = 0;
+		}
+	}
+
+	// top edge
+	curImage = rgbImageHigh;			// top right starts at <right edge leds>
+	cntVal = 0;
+	rVal = gVal = bVal = 0;
+	dv = 0;
+
+	for (i = SLOTS_X-1; i >= 0; i--)
+	{
+		if (i <= dynRight && i >= dynLeft)	// else do not change R/G/B vals because blocks should be black (avoids black flickering of LEDs)
+		{
+			for (j = 0; j < frameWidth; j++)
+			{
+				long n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[dynTop+j][i].R;
+				rVal += (n / d);
+
+				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[dynTop+j][i].G;
+				gVal += (n / d);
+
+				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[dynTop+j][i].B;
+				bVal += (n / d);
+			}
+		}
+		cntVal++;
+
+		dv += rgbImageWid;
+		if (dv >= SLOTS_X)
+		{
+			while (dv >= SLOTS_X)
+			{
+				dv -= SLOTS_X;
+				computeI (&refImage [curImage], rVal / 100 / cntVal, gVal / 100 / cntVal, bVal / 100 / cntVal);
+				curImage++;
+			}
+			rVal = gVal = bVal = 0;
+			cntVal = 0;
+		}
+	}
+
+	// bottom edge
+	curImage = 2*rgbImageHigh + rgbImageWid;			// bottom left starts at <2*Y leds> + <top leds>
+	cntVal = 0;
+	rVal = gVal = bVal = 0;
+	dv = 0;
+
+	for (i = 0; i < SLOTS_X; i++)
+	{
+		if (i <= dynRight && i >= dynLeft)	// else do not change R/G/B vals because blocks should be black (avoids black flickering of LEDs)
+		{
+			for (j = 0; j < frameWidth; j++)
+			{
+				long n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[dynBottom-j][i].R;
+				rVal += (n / d);
+
+				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[dynBottom-j][i].G;
+				gVal += (n / d);
+
+				n = ((2<<(frameWidth-1-j)) * 100) * (long)rgbSlots[dynBottom-j][i].B;
+				bVal += (n / d);
+			}
+		}
+		cntVal++;
+
+		dv += rgbImageWid;
+		if (dv >= SLOTS_X)
+		{
+			while (dv >= SLOTS_X)
+			{
+				dv -= SLOTS_X;
+				computeI (&refImage [curImage], rVal / 100 / cntVal, gVal / 100 / cntVal, bVal / 100 / cntVal);
+				curImage++;
+			}
+			rVal = gVal = bVal = 0;
+			cntVal = 0;
+		}
+	}
+}
+
+
+
+/*
+ * Integrate one edge zone into the image block <pid> with ambiLightZoneSum(). The zone starts with the slot
+ * rectangle x0..x1, y0..y1 at the dyn border and grows by dx/dy towards the picture center up to frameWidth slots.
+ * Slot depth j is weighted with 2^(frameWidth-j), which is the sum of the nested rectangles of depth 1..frameWidth
+ * with weights 2^(frameWidth-k) (2 for the deepest). The result is divided by <cntVal> rows/columns, also counting
+ * those outside the dyn area.
+ */
+static void tableZone2Image (rgbIcontroller_t *pid, short x0, short y0, short x1, short y1, short dx, short dy, short cntVal)
+{
+	long rVal, gVal, bVal;
+	long d = ((2<<frameWidth) - 1) * (long)cntVal;
+	short k;
+
+	rVal = gVal = bVal = 0;
+
+	if (x0 <= x1 && y0 <= y1)		// else the zone is outside the dyn area (keep LEDs black)
+	{
+		for (k = 0; k < frameWidth; k++)
+		{
+			uint64_t sum = ambiLightZoneSum (x0, y0, x1, y1);
+			long w = (k < frameWidth-1) ? (1 << (frameWidth-1-k)) : 2;
+
+			rVal += w * ZONE_R(sum);
+			gVal += w * ZONE_G(sum);
+			bVal += w * ZONE_B(sum);
+
+			if (dx < 0) x0--; else x1 += dx;
+			if (dy < 0) y0--; else y1 += dy;
+		}
+	}
+
+	computeI (pid, rVal / d, gVal / d, bVal / d);
+}
+
+
+/*
+ * The same block image as loopDyn2Image() from zone queries: frameWidth rectangle sums per zone (writes tableImage)
+ */
+static void tableDyn2Image (void)
+{
+	short i, z;
+	short curImage;
+	short cntVal;
+	short dv;
+
+	// right edge
+	curImage = 0;			// = bottom right
+	cntVal = 0;
+	dv = 0;
+
+	for (i = z = SLOTS_Y-1; i >= 0; i--)	// zone = rows i..z
+	{
+		cntVal++;
+
+		dv += rgbImageHigh;
+		if (dv >= SLOTS_Y)
+		{
+			while (dv >= SLOTS_Y)
+			{
+				dv -= SLOTS_Y;
+				tableZone2Image (&tableImage [curImage], dynRight, (i < dynTop ? dynTop : i),
+						dynRight, (z > dynBottom ? dynBottom : z), -1, 0, cntVal);
+				curImage++;
+			}
+			cntVal = 0;
+			z = i - 1;
+		}
+	}
+
+	// left edge
+	curImage = rgbImageHigh + rgbImageWid;			// top left starts at <right edge leds> + <top edge leds>
+	cntVal = 0;
+	dv = 0;
+
+	for (i = z = 0; i < SLOTS_Y; i++)		// zone = rows z..i
+	{
+		cntVal++;
+
+		dv += rgbImageHigh;
+		if (dv >= SLOTS_Y)
+		{
+			while (dv >= SLOTS_Y)
+			{
+				dv -= SLOTS_Y;
+				tableZone2Image (&tableImage [curImage], dynLeft, (z < dynTop ? dynTop : z),
+						dynLeft, (i > dynBottom ? dynBottom : i), 1, 0, cntVal);
+				curImage++;
+			}
+			cntVal = 0;
+			z = i + 1;
+		}
+	}
+
+	// top edge
+	curImage = rgbImageHigh;			// top right starts at <right edge leds>
+	cntVal = 0;
+	dv = 0;
+
+	for (i = z = SLOTS_X-1; i >= 0; i--)	// zone = columns i..z
+	{
+		cntVal++;
+
+		dv += rgbImageWid;
+		if (dv >= SLOTS_X)
+		{
+			while (dv >= SLOTS_X)
+			{
+				dv -= SLOTS_X;
+				tableZone2Image (&tableImage [curImage], (i < dynLeft ? dynLeft : i), dynTop,
+						(z > dynRight ? dynRight : z), dynTop, 0, 1, cntVal);
+				curImage++;
+			}
+			cntVal = 0;
+			z = i - 1;
+		}
+	}
+
+	// bottom edge
+	curImage = 2*rgbImageHigh + rgbImageWid;			// bottom left starts at <2*Y leds> + <top leds>
+	cntVal = 0;
+	dv = 0;
+
+	for (i = z = 0; i < SLOTS_X; i++)		// zone = columns z..i
+	{
+		cntVal++;
+
+		dv += rgbImageWid;
+		if (dv >= SLOTS_X)
+		{
+			while (dv >= SLOTS_X)
+			{
+				dv -= SLOTS_X;
+				tableZone2Image (&tableImage [curImage], (z < dynLeft ? dynLeft : z), dynBottom,
+						(i > dynRight ? dynRight : i), dynBottom, 0, -1, cntVal);
+				curImage++;
+			}
+			cntVal = 0;
+			z = i + 1;
+		}
+	}
+}
+
+
+
+/*
+ * ambiLightImage2LedRGB() before the sampling matrix (block image <image> to <leds>, without the delay line)
+ */
+static void loopImage2Led (const rgbIcontroller_t *image, rgbValue_t *leds)
+{
+	int i;
+	long  rVal, gVal, bVal;
+	short ledIdx;
+	short cntVal;
+	short dv;
+
+	// distribute the scaled virtual image to the led buffer
+
+	ledIdx = 0;			// = bottom right
+	cntVal = 0;
+	rVal = gVal = bVal = 0;
+	dv = 0;
+
+	for (i = 0; i < rgbImageHigh; i++)	// expand the image blocks to the physical LED strip
+	{
+		rVal += image[i].R;
+		gVal += image[i].G;
+		bVal += image[i].B;
+		cntVal++;
+
+		dv += ledsY;
+		if (dv >= rgbImageHigh)
+		{
+			while (dv >= rgbImageHigh)
+			{
+				dv -= rgbImageHigh;
+				leds[ledIdx].R = rVal / cntVal;
+				leds[ledIdx].G = gVal / cntVal;
+				leds[ledIdx].B = bVal / cntVal;
+				ledIdx++;
+			}
+			rVal = gVal = bVal = 0;
+			cntVal = 0;
+		}
+	}
+
+	ledIdx = ledsY;			// = top right
+	cntVal = 0;
+	rVal = gVal = bVal = 0;
+	dv = 0;
+
+	for (i = rgbImageHigh; i < rgbImageWid + rgbImageHigh; i++)
+	{
+		rVal += image[i].R;
+		gVal += image[i].G;
+		bVal += image[i].B;
+		cntVal++;
+
+		dv += ledsX;
+		if (dv >= rgbImageWid)
+		{
+			while (dv >= rgbImageWid)
+			{
+				dv -= rgbImageWid;
+				leds[ledIdx].R = rVal / cntVal;
+				leds[ledIdx].G = gVal / cntVal;
+				leds[ledIdx].B = bVal / cntVal;
+				ledIdx++;
+			}
+			rVal = gVal = bVal = 0;
+			cntVal = 0;
+		}
+	}
+
+	ledIdx = ledsY + ledsX;			// = top left
+	cntVal = 0;
+	rVal = gVal = bVal = 0;
+	dv = 0;
+
+	for (i = rgbImageWid + rgbImageHigh; i < rgbImageHigh + rgbImageWid + rgbImageHigh; i++)
+	{
+		rVal += image[i].R;
+		gVal += image[i].G;
+		bVal += image[i].B;
+		cntVal++;
+
+		dv += ledsY;
+		if (dv >= rgbImageHigh)
+		{
+			while (dv >= rgbImageHigh)
+			{
+				dv -= rgbImageHigh;
+				leds[ledIdx].R = rVal / cntVal;
+				leds[ledIdx].G = gVal / cntVal;
+				leds[ledIdx].B = bVal / cntVal;
+				ledIdx++;
+			}
+			rVal = gVal = bVal = 0;
+			cntVal = 0;
+		}
+	}
+
+	ledIdx = ledsY + ledsX + ledsY;			// = bottom left
+	cntVal = 0;
+	rVal = gVal = bVal = 0;
+	dv = 0;
+
+	for (i = rgbImageHigh + rgbImageWid + rgbImageHigh; i < rgbImageHigh + rgbImageWid + rgbImageHigh + rgbImageWid; i++)
+	{
+		rVal += image[i].R;
+		gVal += image[i].G;
+		bVal += image[i].B;
+		cntVal++;
+
+		dv += ledsX;
+		if (dv >= rgbImageWid)
+		{
+			while (dv >= rgbImageWid)
+			{
+				dv -= rgbImageWid;
+				leds[ledIdx].R = rVal / cntVal;
+				leds[ledIdx].G = gVal / cntVal;
+				leds[ledIdx].B = bVal / cntVal;
+				ledIdx++;
+			}
+			rVal = gVal = bVal = 0;
+			cntVal = 0;
+		}
+	}
+}
+
+// largest channel difference between <leds> and the LEDs of the reference
+static int compareLeds (const rgbValue_t *leds)
+{
+	int i, maxDiff = 0;
+
+	for (i = 0; i < ledsPhysical; i++)
+	{
+		int d;
+
+		d = abs (leds[i].R - refLeds[i].R);
+		if (d > maxDiff) maxDiff = d;
+		d = abs (leds[i].G - refLeds[i].G);
+		if (d > maxDiff) maxDiff = d;
+		d = abs (leds[i].B - refLeds[i].B);
+		if (d > maxDiff) maxDiff = d;
+	}
+	return maxDiff;
+}
+
+
+int main (int argc, char **argv)
+{
+	unsigned long frames = 2000, n;
+	int opt, x, y, l, worst = 0;
+
+	while ((opt = getopt (argc, argv, "n:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': frames = strtoul (optarg, NULL, 0); break;
+		default:
+			optind = argc + 1;
+			break;
+		}
+	}
+	if (optind != argc || frames < 1)
+	{
+		fprintf (stderr, "usage: zonebench [-n frames]\n");
+		return 2;
+	}
+
+	for (n = 0; n < BENCH_PICTURES; n++)		// gradients with noise, dark border
+	{
+		for (y = 0; y < SLOTS_Y; y++)
+		{
+			for (x = 0; x < SLOTS_X; x++)
+			{
+				int border = (y < 3 || y >= SLOTS_Y-3 || x < 2 || x >= SLOTS_X-2);
+
+				pictures[n][y][x].R = border ? 16 : (x * 4 + n * 8 + (genRand() & 15)) & 0xff;
+				pictures[n][y][x].G = border ? 16 : (y * 6 + n * 4 + (genRand() & 15)) & 0xff;
+				pictures[n][y][x].B = border ? 16 : ((x + y) * 2 + (genRand() & 63)) & 0xff;
+			}
+		}
+	}
+
+	ambiLightInit ();
+	factorI = MAX_ICONTROL;			// image blocks = zone values of the last frame
+	dynLeft = 2;
+	dynRight = SLOTS_X-3;
+	dynTop = 3;
+	dynBottom = SLOTS_Y-4;
+
+	printf ("%6s %5s %7s %10s %10s %8s %10s %10s %8s %5s\n", "LEDs", "depth", "blocks", "loops us", "matrix us",
+			"speedup", "build us", "table us", "speedup", "diff");
+
+	for (l = 0; l < (int)(sizeof (ledCounts) / sizeof (ledCounts[0])); l++)
+	{
+		int lx = ledCounts[l] * 16 / (2 * (16 + 9));
+
+		ledsX = (lx < LEDS_XMAX) ? lx : LEDS_XMAX;
+		ledsY = (ledCounts[l] / 2 - lx < LEDS_YMAX) ? ledCounts[l] / 2 - lx : LEDS_YMAX;
+		rgbImageWid = (ledsX < SLOTS_X) ? ledsX : SLOTS_X;
+		rgbImageHigh = (ledsY < SLOTS_Y) ? ledsY : SLOTS_Y;
+
+		for (frameWidth = 1; frameWidth <= 11; frameWidth++)
+		{
+			double t0, tLoops, tMatrix, tBuild, tTable;
+			int maxDiff = 0;
+
+			ambiLightClearImage ();
+			memset (refImage, 0, sizeof (refImage));
+			memset (tableImage, 0, sizeof (tableImage));
+
+			t0 = now ();
+			for (n = 0; n < frames; n++)
+			{
+				rgbSlots = pictures[n % BENCH_PICTURES];
+				loopDyn2Image ();
+				loopImage2Led (refImage, refLeds);
+			}
+			tLoops = now () - t0;
+
+			t0 = now ();
+			for (n = 0; n < frames; n++)
+			{
+				rgbSlots = pictures[n % BENCH_PICTURES];
+				ambiLightDyn2Image ();
+			}
+			tMatrix = now () - t0;
+
+			t0 = now ();
+			for (n = 0; n < frames / 10 + 1; n++)
+				ambiLightBuildMatrix ();
+			tBuild = (now () - t0) / (frames / 10 + 1);
+
+			t0 = now ();
+			for (n = 0; n < frames; n++)		// a new picture every frame, so every frame builds the table
+			{
+				rgbSlots = pictures[n % BENCH_PICTURES];
+				tableDyn2Image ();
+				loopImage2Led (tableImage, tableLeds);
+			}
+			tTable = now () - t0;
+
+			for (n = 0; n < BENCH_PICTURES; n++)		// compare all paths on every picture
+			{
+				int d;
+
+				rgbSlots = pictures[n];
+				loopDyn2Image ();
+				loopImage2Led (refImage, refLeds);
+				tableDyn2Image ();
+				loopImage2Led (tableImage, tableLeds);
+				ambiLightDyn2Image ();
+				for (x = 0; x < ledsPhysical; x++)
+				{
+					matrixLeds[x].R = rgbImage[x].R;
+					matrixLeds[x].G = rgbImage[x].G;
+					matrixLeds[x].B = rgbImage[x].B;
+				}
+				d = compareLeds (matrixLeds);
+				if (d > maxDiff)
+					maxDiff = d;
+				d = compareLeds (tableLeds);
+				if (d > maxDiff)
+					maxDiff = d;
+			}
+			if (maxDiff > worst)
+				worst = maxDiff;
+
+			printf ("%6d %5d %3dx%-3d %10.2f %10.2f %8.2f %10.2f %10.2f %8.2f %5d\n", ledCounts[l], frameWidth,
+					rgbImageWid, rgbImageHigh, tLoops * 1e6 / frames, tMatrix * 1e6 / frames, tLoops / tMatrix,
+					tBuild * 1e6, tTable * 1e6 / frames, tLoops / tTable, maxDiff);
+		}
+	}
+
+	if (worst > MAX_DIFF)
+	{
+		printf ("FAIL: LED values differ by up to %d from the reference\n", worst);
+		return 1;
+	}
+	printf ("OK: LED values within %d of the reference\n", MAX_DIFF);
+	return 0;
+}
+
+#endif
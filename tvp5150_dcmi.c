@@ -21,6 +21,7 @@
  *	24.07.2014	pitschu v1.2 fixed bugs in pixel to slots mapping (integer division problems)
 */
 
+#include <string.h>
 #include "hardware.h"
 #include "AvrXSerialIo.h"
 #include "ws2812.h"
@@ -55,11 +56,27 @@
 #define		LINE_WIDTH		864		// full line width in pixels
 #define		PAL_WIDTH		720		// visible part
 #define		PAL_HEIGHT		288
-#define		DMA_LINES		1
+#define		DMA_LINES		4		// lines per DMA buffer (= per line IRQ)
 
 #undef 		HARD_SYNC
 #define 	HARD_SYNC		// had no luck in using embedded codes; I use the hsync+vsync pins now
 
+#define		USE_SIMD_ACCU	// use the Cortex-M4 DSP instructions for slot accumulation (undef for plain C version)
+
+#ifdef USE_SIMD_ACCU
+#define		ACCU_SIMD		1
+#else
+#define		ACCU_SIMD		0
+#endif
+
+#define		LINE_BUDGET_US			48		// max runtime of line IRQ in full width mode (PAL line = 64us)
+#define		FALLBACK_RETRY_FIELDS	250		// AUTO: clean split fields before full width is tried again (5 s)
+#define		FALLBACK_RETRY_MAX		4000	// 	doubled after every fallback up to this (80 s)
+#define		LINE_IRQ_CYCLES_BASE	120		// line IRQ timing model: entry/exit, flags, row stepping
+#define		LINE_IRQ_CYCLES_SLOT	16		// 	per slot: run length load, store of sums
+#define		LINE_IRQ_CYCLES_PAIR_SIMD	4	// 	per pixel pair with SIMD kernel
+#define		LINE_IRQ_CYCLES_PAIR_C		10	// 	per pixel pair with C kernel
+
 
 // some PAL timings: Front porch = 20 bytes, sync width = 128 bytes, back porch = 140 bytes
 //		Vertical:	 front porch = 2.5 lines, sync width = 6 lines, back porch = 15 lines
@@ -71,6 +88,14 @@ unsigned long	cropLeft	= 		160;				// back porch bytes until visible area starts
 unsigned long	cropTop		= 		16;
 unsigned long	cropHeight	= 		274;
 
+// crop values of the other line system are kept here; swapped with the ones above when the standard changes
+cropProfile_t	cropProfiles[VIDEO_SYSTEMS] = {
+		{160, 696, 16, 274},					// 625 lines / 50 fields (PAL, PAL-N, SECAM)
+		{160, 696, 12, 236},					// 525 lines / 60 fields (NTSC, PAL-M, NTSC 4.43)
+};
+unsigned char	videoSystem = 		VIDEO_625;	// line system the crop values above belong to (stored in flash)
+unsigned char	videoStandard = 	STD_UNKNOWN;	// last standard detected by TVP5150
+
 unsigned long	dmaWidth 	= 		PAL_WIDTH/4;		// in words (= DMA unit)
 unsigned long	dmaBufLen	= 		((PAL_WIDTH/2) * DMA_LINES);
 
@@ -82,10 +107,28 @@ unsigned char	Contrast			= 80;
 volatile short	captureLeftRight = 	0;			// 0 = left; 1 = right; one frame for each side
 volatile short 	captureReady = 		0;			// semaphore for main(); set when frame captured completly
 
+unsigned char	captureMode = CAPTURE_AUTO;		// user setting (stored in flash); see captureMode_e
+volatile short	captureFull = 		0;			// 1 = field currently captured covers the full line width
+volatile unsigned long	captureFallbacks = 0;		// number of switches from full width back to split mode
+volatile unsigned long	lineCyclesMax = 	0;			// longest line IRQ of the running field (cycles)
+volatile unsigned long	lineCyclesLast = 	0;			// longest line IRQ of the last complete field
+unsigned long	lineCyclesBudget = 	(168 * LINE_BUDGET_US);	// set from SystemCoreClock in TVP5150init()
+
 unsigned char	videoSourceSelect = 0;			// 0 = auto; 1/2 = video channel
 unsigned char	videoCurrentSource = 1;			// current video channel set in TVP5150
 
 unsigned short	tvp5150AGC = 1;					// pitschu 140505: user selectable setting (usrinterface.c)
+unsigned char	colorMatrix = COLOR_BT601_FULL;	// YCbCr -> RGB matrix (colorMatrix_e)
+unsigned char	slotProfile = SLOT_PROFILE_UNIFORM;	// slot widths along a line (slotProfile_e)
+unsigned char	captureEdgeBands = 0;			// 1 = accumulate only the edge bands needed by ambiLight (stored in flash)
+
+volatile short	captureBandX = 0;				// slots of left/right band in the current picture; 0 = all captured
+volatile short	captureBandY = 0;				// slot rows of top/bottom band
+volatile unsigned long	bandPairsSkipped = 0;		// pixel pairs not accumulated in the last field
+volatile unsigned long	bandCyclesSaved = 0;		// line IRQ cycles per field saved by the bands (measured)
+volatile unsigned long	bandCyclesModel = 0;		// the same from the timing model (estimate)
+volatile unsigned long	lineCyclesFieldBands = 0;	// line IRQ cycles per field of the last picture with bands
+volatile unsigned long	lineCyclesFieldAll = 0;		// 	and of the last probe picture without them
 
 
 short 	TVP5150initRegisters(void);
@@ -102,15 +145,20 @@ typedef struct {
 	uint8_t		Y1;
 } YCbCr_t;
 
-static volatile YCbCr_t YCbCr_buf0 [((LINE_WIDTH/2) * DMA_LINES)+1] = {{0}};		// the two alternating DMA buffers
-static volatile YCbCr_t YCbCr_buf1 [((LINE_WIDTH/2) * DMA_LINES)+1] = {{0}};
+// the two alternating DMA buffers; 16 byte aligned for memory bursts
+static volatile YCbCr_t YCbCr_buf0 [((LINE_WIDTH/2) * DMA_LINES)+1] __attribute__ ((aligned (16))) = {{0}};
+static volatile YCbCr_t YCbCr_buf1 [((LINE_WIDTH/2) * DMA_LINES)+1] __attribute__ ((aligned (16))) = {{0}};
 
 
+/*
+ * Slot accumulators. Cb and Cr are summed as raw bytes (offset 128 is removed when converting to RGB) in the two
+ * halves of <CbCr>, so that the SIMD kernel can add them with one UXTAB16. A slot gets at most ~6 pixel pairs per
+ * line and ~8 lines per field, so 16 bit sums are far from overflowing (limit is 128 pairs for Y).
+ */
 typedef struct {
-	long		Y;
-	long		Cb;
-	long		Cr;
-	long		cnt;			// number of pixels in this slot
+	uint32_t	CbCr;			// Cb sum in lower, Cr sum in upper half word
+	uint16_t	Y;				// sum of Y0 and Y1
+	uint16_t	cnt;			// number of pixel pairs in this slot
 } videoData_t;
 
 
@@ -118,12 +166,579 @@ static volatile videoData_t YCbCrSlots [(SLOTS_Y * SLOTS_X) + 1] = {{0}};		// yc
 static volatile videoData_t *arrP;				// working pointer used in HSYNC handler
 
 static unsigned short  arrYslotCnt;			// counter within slice currently running
+static unsigned short  arrRow;				// slot row currently filled by line IRQ
+static uint8_t		   arrPart;				// part of picture captured in this field (CONV_LEFT...)
 
 static int tvp5150_log_status(void);		// prints all TVP5150 registers
 
 
-// rgbSlots[][] array is the main output of this module. It contains the raw RGB video data; its updated with each new frame
-volatile rgbValue_t   rgbSlots [SLOTS_Y][SLOTS_X];					// RGB values are updated permanently
+/*
+ * Triple buffered frame store; the RGB frames are the main output of this module. PendSV writes into <frameWrite>,
+ * main() reads <frameRead>; <frameMiddle> holds the buffer passed between them (bits 0..1 = index, FRAME_FRESH =
+ * published but not yet taken). Publish and acquire swap their own buffer with the middle one by LDREX/STREX, so
+ * neither side waits and main() never sees a half written frame.
+ */
+#define		FRAME_FRESH		4
+
+typedef struct {
+	uint32_t	seq;							// frame id; increments with each picture
+	rgbValue_t	slots [SLOTS_Y][SLOTS_X];
+} rgbFrame_t;
+
+static rgbFrame_t			rgbFrames[3];
+static volatile uint32_t	frameMiddle = 1;
+static uint32_t				frameWrite = 0;		// owned by PendSV
+static uint32_t				frameRead = 2;		// owned by main()
+static uint32_t				frameSeq = 0;
+
+rgbValue_t		(*rgbSlots)[SLOTS_X] = rgbFrames[2].slots;		// frame acquired by main(); see TVP5150acquireFrame()
+unsigned long	rgbFrameSeq = 0;				// id of this frame
+volatile unsigned long	framesDropped = 0;		// published frames overwritten before main() took them
+volatile unsigned long	framesDuplicated = 0;	// acquire calls without a new frame
+
+/*
+ * Snapshot of one row of raw slot sums for recording (see framestream.c). main() requests a row, PendSV copies
+ * it while converting; in split mode the row is complete when both halves were copied.
+ */
+#define		RAW_ROW_IDLE	0
+#define		RAW_ROW_WAIT	1
+#define		RAW_ROW_READY	2
+
+static videoData_t			rawRow [SLOTS_X];
+static volatile uint8_t		rawRowState = RAW_ROW_IDLE;
+static uint8_t				rawRowParts;		// halves copied (bit 0 = left, bit 1 = right)
+static short				rawRowY;
+
+
+/***********************************************************************************/
+
+/*
+ * Slot accumulation kernels. Both add <n> pixel pairs (n > 0) of a DMA line buffer to one slot.
+ * slotAddRunC() is the portable reference; slotAddRunSIMD() uses UXTAB16 to add Cb/Cr (bytes 0/2) and
+ * Y0/Y1 (bytes 1/3) of a whole word in two instructions. Both must give identical sums (see tools/dcmicheck.c).
+ */
+static inline void slotAddRunC (videoData_t *p, const YCbCr_t *s, short n)
+{
+	uint32_t cb = 0, cr = 0, y = 0;
+
+	do
+	{
+		cb += s->Cb;
+		cr += s->Cr;
+		y  += s->Y0;
+		y  += s->Y1;
+		s++;
+	} while (--n != 0);
+
+	p->CbCr += cb | (cr << 16);
+	p->Y    += y;
+}
+
+
+static inline void slotAddRunSIMD (videoData_t *p, const YCbCr_t *s, short n)
+{
+	register const uint32_t *w = (const uint32_t *)s;
+	register uint32_t cbcr = 0, y = 0;
+
+	do
+	{
+		register uint32_t v = *w++;
+		cbcr = __UXTAB16(cbcr, v);				// Cb += byte 0; Cr += byte 2
+		y    = __UXTAB16(y, v >> 8);			// Y0 += byte 1; Y1 += byte 3
+	} while (--n != 0);
+
+	p->CbCr = __UADD16(p->CbCr, cbcr);
+	p->Y   += (y & 0xffff) + (y >> 16);
+}
+
+
+// add one DMA line to the <slots> slots starting at <p>; <runs> gives the pixel pairs of each slot (see slotRunsBuild())
+static inline void lineAddSlots (videoData_t *p, const YCbCr_t *s, const uint8_t *runs, short slots, const short simd)
+{
+	do
+	{
+		register short n = *runs++;
+
+		if (simd)
+			slotAddRunSIMD (p, s, n);
+		else
+			slotAddRunC (p, s, n);
+		p->cnt += n;
+
+		s += n;
+		p++;			// gather pixels into next X slot
+	} while (--slots != 0);
+}
+
+
+/*
+ * Run length table: number of pixel pairs per slot for the current crop; rebuilt in captureSetWindow() only when
+ * line width, capture mode or slot profile changed. Split mode uses slotRuns[0..31] for the left and [32..63] for the
+ * right half, full mode all 64 entries. With SLOT_PROFILE_EDGE the slots near the left and right picture border are
+ * narrower (weights below) and the center slots wider; uniform slots all have weight 1.
+ */
+static const uint8_t slotEdgeWeights[] = {2, 2, 3, 3, 4, 4, 5, 5};		// from the border inwards; then 6
+
+static uint8_t			slotRuns[SLOTS_X];
+static uint32_t			slotRunsKey = 0;
+static const uint8_t	*arrRuns = slotRuns;		// run lengths of the field currently captured
+static short			arrSlots = SLOTS_X/2;		// slots per line of this field
+
+/*
+ * Edge bands. ambiLightDyn2Image() only reads the <frameWidth> slots next to the dynamic borders, which move by at
+ * most DYN_WIN_X/Y; so with captureEdgeBands set, the center part of the lines in the slot rows between the top and
+ * bottom band is not accumulated. For the current field: slots [0, bandA) and [bandB, arrSlots) are accumulated,
+ * bandB starts <bandBPairs> pixel pairs into the line and <bandSkipPairs> are skipped. The requested band sizes
+ * come from ambiLight.
+ * Every BAND_PROBE_PICTURES picture is captured completely; the line IRQ cycles of that picture compared with a
+ * picture captured with bands give the measured saving (bandCyclesSaved).
+ */
+#define		BAND_PROBE_PICTURES		64
+
+static short			bandReqX = SLOTS_X/2, bandReqY = SLOTS_Y/2;
+static short			bandA, bandB, bandBPairs, bandSkipPairs, bandRows;
+static short			bandActive = 0;
+static short			bandProbe = 0;				// 1 = current picture is captured without bands
+static unsigned long	bandPictures = 0;
+static unsigned long	bandPairsField, bandSlotsField;
+static unsigned long	lineCyclesPicture;			// line IRQ cycles of the running picture
+
+static inline uint32_t slotWeight (short slot, uint8_t profile)
+{
+	short e = (slot < SLOTS_X/2 ? slot : SLOTS_X-1 - slot);		// distance to picture border
+
+	if (profile != SLOT_PROFILE_EDGE)
+		return 1;
+	return (e < sizeof (slotEdgeWeights) ? slotEdgeWeights[e] : 6);
+}
+
+// spread <width> pixel pairs over <slots> slots (picture slot index <first>...); every slot gets at least one pair
+static void slotRunsBuild (uint8_t *runs, short width, short first, short slots, uint8_t profile)
+{
+	uint32_t total = 0, sum = 0;
+	short k, b, last = 0;
+
+	for (k = 0; k < slots; k++)
+		total += slotWeight (first + k, profile);
+
+	for (k = 0; k < slots; k++)
+	{
+		sum += slotWeight (first + k, profile);
+		b = k + 1 + ((uint32_t)(width - slots) * sum + total/2) / total;		// end of slot k
+		runs[k] = b - last;
+		last = b;
+	}
+}
+
+
+/*
+ * Timing model of the line IRQ: estimated cycles for one DMA line of <width> pixel pairs spread over <slots> slots.
+ * Used to decide whether full width capture fits into the line budget before trying it; the constants were taken
+ * from TVP5150benchmark() runs and include some reserve.
+ */
+unsigned long TVP5150lineCyclesEstimate (short width, short slots)
+{
+#ifdef USE_SIMD_ACCU
+	return LINE_IRQ_CYCLES_BASE + (unsigned long)slots * LINE_IRQ_CYCLES_SLOT + (unsigned long)width * LINE_IRQ_CYCLES_PAIR_SIMD;
+#else
+	return LINE_IRQ_CYCLES_BASE + (unsigned long)slots * LINE_IRQ_CYCLES_SLOT + (unsigned long)width * LINE_IRQ_CYCLES_PAIR_C;
+#endif
+}
+
+
+/*
+ * YCbCr -> RGB conversion by table lookup. For the selected matrix five tables hold Y, Cr*R, Cr*G, Cb*G and Cb*B
+ * in Q6 fixed point (rounding bias included in the Y table); a pixel then costs 5 loads, 4 adds and 3 shifts.
+ * Coefficients are Q16; limited range matrices expand Y 16..235 and Cb/Cr 16..240 to full range.
+ * The tables are (re)built lazily whenever <colorMatrix> was changed.
+ */
+typedef struct {
+	const char	*name;
+	int32_t		yOffset;
+	int32_t		yGain, crR, crG, cbG, cbB;		// Q16
+} colorCoeffs_t;
+
+static const colorCoeffs_t colorCoeffs[COLOR_MATRICES] = {
+		{"BT.601 full range",		0,	65536,	 91881,	46802,	22553,	116130},
+		{"BT.601 limited range",	16,	76309,	104597,	53279,	25675,	132201},
+		{"BT.709 full range",		0,	65536,	103206,	30679,	12276,	121609},
+		{"BT.709 limited range",	16,	76309,	117489,	34925,	13975,	138438},
+};
+
+static int16_t	colorY[256], colorCrR[256], colorCrG[256], colorCbG[256], colorCbB[256];
+static unsigned char colorTablesMatrix = 0xff;		// matrix the tables were built for
+
+static void colorBuildTables (void)
+{
+	const colorCoeffs_t *c = &colorCoeffs[colorMatrix < COLOR_MATRICES ? colorMatrix : COLOR_BT601_FULL];
+	int32_t i;
+
+	for (i = 0; i < 256; i++)
+	{
+		colorY[i]   = ((i - c->yOffset) * c->yGain + 512 + (32 << 10)) >> 10;		// Q16 -> Q6; +0.5 rounding
+		colorCrR[i] = ((i - 128) * c->crR + 512) >> 10;
+		colorCrG[i] = ((i - 128) * c->crG + 512) >> 10;
+		colorCbG[i] = ((i - 128) * c->cbG + 512) >> 10;
+		colorCbB[i] = ((i - 128) * c->cbB + 512) >> 10;
+	}
+	colorTablesMatrix = colorMatrix;
+}
+
+static inline uint8_t colorClamp (int32_t l)
+{
+	if (l < 0) l = 0;
+	if (l > 254) l = 254;			// 255 is reserved
+	return l;
+}
+
+// convert one pixel; Y, Cb and Cr are raw bytes (Cb/Cr with offset 128)
+static inline void yuv2rgbLUT (rgbValue_t *rgb, uint32_t Y, uint32_t Cb, uint32_t Cr)
+{
+	int32_t y = colorY[Y];
+
+	rgb->R = colorClamp ((y + colorCrR[Cr]) >> 6);
+	rgb->G = colorClamp ((y - colorCrG[Cr] - colorCbG[Cb]) >> 6);
+	rgb->B = colorClamp ((y + colorCbB[Cb]) >> 6);
+}
+
+// the former integer conversion (BT.601 full range); timing reference for TVP5150benchmark()
+static void yuv2rgbInt (rgbValue_t *rgb, long Y, long Cb, long Cr)
+{
+	long l;
+
+	Cb -= 128;
+	Cr -= 128;
+
+	l = (Cr * 1403);				// red
+	l /= 1000;
+	rgb->R = colorClamp (l + Y);
+
+	l = (Cr * 714) + (Cb * 344);	// green
+	l /= 1000;
+	rgb->G = colorClamp (Y - l);
+
+	l = (Cb * 1773);				// blue
+	l /= 1000;
+	rgb->B = colorClamp (l + Y);
+}
+
+
+const char *TVP5150colorMatrixName (unsigned char m)
+{
+	return colorCoeffs[m < COLOR_MATRICES ? m : COLOR_BT601_FULL].name;
+}
+
+
+/*
+ * Deferred conversion. The line IRQ queues each slot row as soon as it is complete; at VSYNC the rows left over
+ * and (when the picture is complete) an end marker are queued. PendSV runs at lowest priority and converts the
+ * queued rows into rgbSlots, so neither the VSYNC nor the line IRQ is delayed by the conversion. A converted row is
+ * written again by the line IRQ at the earliest after the vertical blanking (~1.5ms), far more than PendSV needs.
+ * Jobs are one byte: slot row in bits 0..5, part of picture in bits 6..7. When PendSV falls so far behind that the
+ * queue is full, the job is dropped and counted in convJobsDropped (its row is then added to the next field).
+ */
+#define		CONV_QUEUE_SIZE		128				// power of 2; holds rows of more than 2 fields
+#define		CONV_LEFT			(0 << 6)
+#define		CONV_RIGHT			(1 << 6)
+#define		CONV_FULL			(2 << 6)
+#define		CONV_PICTURE_END	0x3f			// row code of end marker
+
+static volatile uint8_t	convQueue[CONV_QUEUE_SIZE];
+static volatile uint8_t	convHead = 0;			// written by line and VSYNC IRQ (same priority)
+static volatile uint8_t	convTail = 0;			// written by PendSV
+
+volatile unsigned long	vsyncCycles, vsyncCyclesMax;		// runtime of VSYNC IRQ
+volatile unsigned long	convCycles, convCyclesMax;			// runtime of deferred conversion per picture
+volatile unsigned long	convJobsDropped = 0;				// jobs lost because the queue was full
+static unsigned long	convCyclesPicture;
+
+static inline void convQueueJob (uint8_t job)
+{
+	uint8_t next = (convHead + 1) & (CONV_QUEUE_SIZE - 1);
+
+	if (next == convTail)
+		convJobsDropped++;					// queue full; PendSV has not caught up
+	else
+	{
+		convQueue[convHead] = job;
+		convHead = next;
+	}
+	SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;		// trigger PendSV
+}
+
+
+static inline uint32_t frameExchange (uint32_t v)
+{
+	uint32_t old;
+
+	__DMB();				// frame data is written before it is handed over
+	do
+	{
+		old = __LDREXW ((uint32_t*)&frameMiddle);
+	} while (__STREXW (v, (uint32_t*)&frameMiddle) != 0);
+	__DMB();
+
+	return old;
+}
+
+
+// hand the frame just written over to main() and continue with the buffer set free (PendSV only)
+static void framePublish (void)
+{
+	uint32_t old;
+
+	rgbFrames[frameWrite].seq = ++frameSeq;
+	old = frameExchange (frameWrite | FRAME_FRESH);
+	if (old & FRAME_FRESH)
+		framesDropped++;
+	frameWrite = old & 3;
+}
+
+
+/*
+ * Take the latest published frame (main() only). <rgbSlots> points to it until the next call; when no new frame
+ * was published the old one is kept. Returns the frame id.
+ */
+uint32_t TVP5150acquireFrame (void)
+{
+	if (frameMiddle & FRAME_FRESH)
+	{
+		frameRead = frameExchange (frameRead) & 3;
+		rgbSlots = rgbFrames[frameRead].slots;
+	}
+	else
+		framesDuplicated++;
+
+	rgbFrameSeq = rgbFrames[frameRead].seq;
+	return rgbFrameSeq;
+}
+
+
+// clear all RGB frames (e.g. after crop changes)
+void TVP5150clearFrames (void)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+		memset (rgbFrames[i].slots, 0, sizeof (rgbFrames[i].slots));
+}
+
+
+// ask PendSV for a copy of the raw sums of slot row <y>
+void TVP5150requestRawRow (short y)
+{
+	rawRowY = y;
+	rawRowParts = 0;
+	rawRowState = RAW_ROW_WAIT;
+}
+
+
+// copy the requested raw row (RAW_ROW_BYTES) to <buf>; returns its row index or -1 if not yet captured
+short TVP5150getRawRow (uint8_t *buf)
+{
+	if (rawRowState != RAW_ROW_READY)
+		return -1;
+
+	memcpy (buf, rawRow, RAW_ROW_BYTES);
+	rawRowState = RAW_ROW_IDLE;
+	return rawRowY;
+}
+
+
+// convert one slot row of the left/right half or the full width into the write frame and clear it for the next field
+static void convertRow (short y, uint8_t part)
+{
+	short offset = (part == CONV_RIGHT ? SLOTS_X/2 : 0);
+	short width = (part == CONV_FULL ? SLOTS_X : SLOTS_X/2);
+	videoData_t *cp = (videoData_t *)&YCbCrSlots[y * SLOTS_X + offset];
+	rgbValue_t *rgb = &rgbFrames[frameWrite].slots[y][offset];
+	short x;
+
+	if (colorTablesMatrix != colorMatrix)
+		colorBuildTables ();
+
+	if (rawRowState == RAW_ROW_WAIT && y == rawRowY)
+	{
+		memcpy (&rawRow[offset], cp, width * sizeof (videoData_t));
+		rawRowParts |= (part == CONV_FULL ? 3 : (part == CONV_RIGHT ? 2 : 1));
+		if (rawRowParts == 3)
+			rawRowState = RAW_ROW_READY;
+	}
+
+	for (x = offset; x < offset+width; x++)
+	{
+		if (cp->cnt > 0)
+		{
+			uint32_t cnt = cp->cnt;
+
+			// average values; we have 2 Y values per pixel pair
+			yuv2rgbLUT (rgb, (cp->Y / cnt) / 2, (cp->CbCr & 0xffff) / cnt, (cp->CbCr >> 16) / cnt);
+		}
+		cp->CbCr = 0;
+		cp->Y = 0;
+		cp->cnt= 0;
+
+		cp += 1;
+		rgb += 1;
+	}
+}
+
+
+/*
+ * Set crop window, DMA line length and slot pointer for the next field. In split mode each field captures
+ * <captureWidth> bytes of one half of the picture into SLOTS_X/2 slots; in full mode one field captures
+ * 2*<captureWidth> bytes into all SLOTS_X slots. DCMI and DMA must be disabled when called.
+ */
+static void captureSetWindow (void)
+{
+	DCMI_CROPInitTypeDef DCMI_Crop;
+
+	if (captureFull)
+	{
+		dmaWidth = captureWidth / 2;
+		arrP = &YCbCrSlots[0];
+		DCMI_Crop.DCMI_CaptureCount 			= 2 * captureWidth - 1;
+		DCMI_Crop.DCMI_HorizontalOffsetCount 	= cropLeft;
+	}
+	else
+	{
+		dmaWidth = captureWidth / 4;
+		arrP = (captureLeftRight == 0 ? &YCbCrSlots[0] : &YCbCrSlots[SLOTS_X/2]);
+		DCMI_Crop.DCMI_CaptureCount 			= captureWidth - 1;  // !! we capture only half of <captureWidth> pixels !!
+		DCMI_Crop.DCMI_HorizontalOffsetCount 	= cropLeft + (captureLeftRight == 0 ? 0 : captureWidth);
+	}
+	dmaBufLen = dmaWidth * DMA_LINES;
+	arrYslotCnt = 0;
+	arrRow = 0;
+
+	// memory bursts of 4 words need a buffer length that is a multiple of 4 (stream is disabled here)
+	DMA2_Stream1->CR = (DMA2_Stream1->CR & ~DMA_SxCR_MBURST) | ((dmaBufLen & 3) == 0 ? DMA_MemoryBurst_INC4 : DMA_MemoryBurst_Single);
+
+	if (slotRunsKey != (dmaWidth | (captureFull << 16) | ((uint32_t)slotProfile << 17)))
+	{
+		slotRunsKey = dmaWidth | (captureFull << 16) | ((uint32_t)slotProfile << 17);
+		if (captureFull)
+			slotRunsBuild (slotRuns, dmaWidth, 0, SLOTS_X, slotProfile);
+		else
+		{
+			slotRunsBuild (&slotRuns[0], dmaWidth, 0, SLOTS_X/2, slotProfile);
+			slotRunsBuild (&slotRuns[SLOTS_X/2], dmaWidth, SLOTS_X/2, SLOTS_X/2, slotProfile);
+		}
+	}
+	arrSlots = (captureFull ? SLOTS_X : SLOTS_X/2);
+	arrRuns = &slotRuns[captureFull || captureLeftRight == 0 ? 0 : SLOTS_X/2];
+
+	// edge bands of this field (slot indices relative to first slot of the field)
+	{
+		short first = (captureFull || captureLeftRight == 0 ? 0 : SLOTS_X/2);
+		short k;
+
+		bandA = bandReqX - first;
+		bandB = SLOTS_X - bandReqX - first;
+		if (bandA < 0) bandA = 0;
+		if (bandA > arrSlots) bandA = arrSlots;
+		if (bandB < bandA) bandB = bandA;
+		if (bandB > arrSlots) bandB = arrSlots;
+		bandRows = bandReqY;
+
+		if (captureFull || captureLeftRight == 0)		// new picture starts
+			bandProbe = (captureEdgeBands && (++bandPictures % BAND_PROBE_PICTURES) == 0);
+
+		bandActive = (captureEdgeBands && !bandProbe && bandB > bandA && 2 * bandRows < SLOTS_Y);
+		for (k = 0, bandBPairs = 0; k < bandB; k++)
+			bandBPairs += arrRuns[k];
+		for (k = bandA, bandSkipPairs = 0; k < bandB; k++)
+			bandSkipPairs += arrRuns[k];
+
+		if (captureFull || captureLeftRight == 0)		// new picture starts
+		{
+			captureBandX = (captureEdgeBands ? bandReqX : 0);
+			captureBandY = (captureEdgeBands ? bandReqY : 0);
+		}
+	}
+	arrPart = (captureFull ? CONV_FULL : (captureLeftRight == 0 ? CONV_LEFT : CONV_RIGHT));
+
+	DCMI_CROPCmd (DISABLE);
+	DCMI_Crop.DCMI_VerticalLineCount 		= cropHeight - 1;
+	DCMI_Crop.DCMI_VerticalStartLine 		= cropTop;
+	DCMI_CROPConfig (&DCMI_Crop);
+	DCMI_CROPCmd (ENABLE);
+}
+
+
+/*
+ * Set the size of the edge bands (in slots) that must be captured when captureEdgeBands is on; used from the
+ * next field on. Called by ambiLight with DYN_WIN_X/Y + frameWidth.
+ */
+void TVP5150setEdgeBands (short x, short y)
+{
+	bandReqX = (x < SLOTS_X/2 ? x : SLOTS_X/2);
+	bandReqY = (y < SLOTS_Y/2 ? y : SLOTS_Y/2);
+}
+
+
+/*
+ * Decide the capture mode of the next field (called at VSYNC; <overflow>: the DCMI FIFO overflowed in the field
+ * just finished). AUTO starts with full width when the timing model says it fits; it falls back to split mode when
+ * a line IRQ took longer than <lineCyclesBudget> or the FIFO overflowed. A single overflow (flash write, USB burst)
+ * must not cost the 50 Hz mode for good: full width is tried again after retryPeriod split fields without overflow,
+ * at once when the user changes the capture mode or width. retryPeriod is FALLBACK_RETRY_FIELDS and doubles (up to
+ * FALLBACK_RETRY_MAX) for a fallback within FALLBACK_RETRY_FIELDS fields of the retry, so a source that does not fit
+ * at full width loses a field only now and then.
+ */
+static void captureSelectMode (short overflow)
+{
+	static unsigned char lastMode = 0xff;
+	static unsigned long lastWidth = 0;
+	static unsigned short retryWait = 0;			// split fields until full width is tried again
+	static unsigned short retryPeriod = 0;			// wait of the last fallback (0 = none yet)
+	static unsigned short fullFields = 0;			// clean full width fields since the last switch
+
+	if (captureMode != lastMode || captureWidth != lastWidth)
+	{
+		lastMode = captureMode;
+		lastWidth = captureWidth;
+		retryWait = retryPeriod = 0;
+	}
+
+	switch (captureMode)
+	{
+	case CAPTURE_SPLIT:
+		captureFull = 0;
+		break;
+
+	case CAPTURE_FULL:
+		captureFull = 1;
+		break;
+
+	default:			// CAPTURE_AUTO
+		if (captureFull)
+		{
+			if (lineCyclesLast > lineCyclesBudget || overflow)
+			{
+				captureFull = 0;
+				captureFallbacks++;
+				if (retryPeriod == 0 || fullFields >= FALLBACK_RETRY_FIELDS)
+					retryPeriod = FALLBACK_RETRY_FIELDS;
+				else if (retryPeriod < FALLBACK_RETRY_MAX)
+					retryPeriod *= 2;				// failed again soon after the retry
+				retryWait = retryPeriod;
+			}
+			else if (fullFields < FALLBACK_RETRY_FIELDS)
+				fullFields++;
+		}
+		else if (overflow)
+			retryWait = retryPeriod;						// count clean fields only
+		else if (retryWait > 0)
+			retryWait--;
+		else if (TVP5150lineCyclesEstimate(captureWidth / 2, SLOTS_X) <= lineCyclesBudget)
+		{
+			captureFull = 1;
+			fullFields = 0;
+		}
+		break;
+	}
+}
 
 
 /***********************************************************************************/
@@ -134,6 +749,13 @@ short TVP5150init(void)
 	TVP5150initDCMI();
 	TVP5150initDMA();
 
+	lineCyclesBudget = (SystemCoreClock / 1000000) * LINE_BUDGET_US;
+	CORE_CycleCounEn();				// line IRQ measures its runtime
+
+	printf ("DCMI DMA: %d line(s) per IRQ, buffers 2 x %d bytes\n", DMA_LINES, (int)sizeof (YCbCr_buf0));
+
+	NVIC_SetPriority (PendSV_IRQn, (1 << __NVIC_PRIO_BITS) - 1);		// deferred conversion at lowest priority
+
 	TVP5150initRegisters();
 
 	delay_ms(100);
@@ -148,24 +770,14 @@ short TVP5150init(void)
 
 void TVP5150startCapture(void)
 {
-	DCMI_CROPInitTypeDef DCMI_Crop;
 	int timeout = 1000;
 
 	captureReady = 0;
-	captureLeftRight = 0;		// start with left half
-	arrP = &YCbCrSlots[0];
-
-	DCMI_Crop.DCMI_CaptureCount 			= captureWidth - 1;  // !! we capture only half of <captureWidth> pixels !!
-	DCMI_Crop.DCMI_HorizontalOffsetCount 	= cropLeft;		// get left half of picture
-	DCMI_Crop.DCMI_VerticalLineCount 		= cropHeight - 1;
-	DCMI_Crop.DCMI_VerticalStartLine 		= cropTop;
-	DCMI_CROPConfig (&DCMI_Crop);
-	DCMI_CROPCmd (ENABLE);
-
-	dmaWidth = captureWidth / 4;
-	dmaBufLen = dmaWidth;
-
-	arrYslotCnt = 0;
+	captureLeftRight = 0;		// start with left half (split mode)
+	captureFull = 0;
+	lineCyclesLast = lineCyclesMax = 0;
+	captureSelectMode (0);
+	captureSetWindow ();
 
 	DMA_SetCurrDataCounter(DMA2_Stream1, dmaBufLen);
 	DMA_MemoryTargetConfig(DMA2_Stream1, (uint32_t)&YCbCr_buf0[0], DMA_Memory_0);
@@ -245,6 +857,87 @@ unsigned char TVP5150getStatus1 ()
 
 
 
+static const struct {
+	const char		*name;
+	unsigned char	system;
+} videoStandards[STD_COUNT] = {
+		{"unknown",		VIDEO_625},
+		{"PAL",			VIDEO_625},
+		{"PAL-N",		VIDEO_625},
+		{"SECAM",		VIDEO_625},
+		{"NTSC",		VIDEO_525},
+		{"PAL-M",		VIDEO_525},
+		{"NTSC 4.43",	VIDEO_525},
+};
+
+// map the autoswitch result in status register 5 (R8C, bits 0..3) to videoStd_e; same coding as the Linux driver
+videoStd_e TVP5150standardFromStatus (unsigned char r8c)
+{
+	switch (r8c & 0x0f)
+	{
+	case 0x01:	return STD_NTSC;
+	case 0x03:	return STD_PAL;
+	case 0x05:	return STD_PAL_M;
+	case 0x07:	return STD_PAL_N;
+	case 0x09:	return STD_NTSC443;
+	case 0x0b:	return STD_SECAM;
+	default:	return STD_UNKNOWN;
+	}
+}
+
+
+const char *TVP5150standardName (unsigned char std)
+{
+	return videoStandards[std < STD_COUNT ? std : STD_UNKNOWN].name;
+}
+
+
+// lines per field of the current line system; cropTop + cropHeight must stay below
+unsigned short TVP5150fieldLines (void)
+{
+	return (videoSystem == VIDEO_525 ? 262 : 312);
+}
+
+
+/*
+ * Check the standard detected by TVP5150 (called from main loop while a signal is locked). When the line system
+ * changes (50 <-> 60 fields/s) the crop values are swapped with the profile of the new system; the capture IRQs
+ * take them over at the next VSYNC, the slot run table follows the new width automatically.
+ * Returns 1 when the standard has changed.
+ */
+short TVP5150checkStandard (void)
+{
+	videoStd_e std = TVP5150standardFromStatus (tvp5150_read(R8C_Status_register_5));
+	unsigned char sys;
+
+	if (std == STD_UNKNOWN || std == videoStandard)
+		return 0;
+
+	videoStandard = std;
+	sys = videoStandards[std].system;
+
+	if (sys != videoSystem && sys < VIDEO_SYSTEMS && videoSystem < VIDEO_SYSTEMS)
+	{
+		__disable_irq();			// VSYNC IRQ must not see a mix of both profiles
+		cropProfiles[videoSystem].cropLeft		= cropLeft;
+		cropProfiles[videoSystem].captureWidth	= captureWidth;
+		cropProfiles[videoSystem].cropTop		= cropTop;
+		cropProfiles[videoSystem].cropHeight	= cropHeight;
+
+		cropLeft		= cropProfiles[sys].cropLeft;
+		captureWidth	= cropProfiles[sys].captureWidth;
+		cropTop			= cropProfiles[sys].cropTop;
+		cropHeight		= cropProfiles[sys].cropHeight;
+		videoSystem = sys;
+		__enable_irq();
+	}
+
+	printf("\nVideo standard %s, %d lines per field\n", TVP5150standardName(std), (int)TVP5150fieldLines());
+	return 1;
+}
+
+
+
 short TVP5150initRegisters(void)
 {
 	TVP5150selectVideoSource(videoCurrentSource);
@@ -371,43 +1064,149 @@ void TVP5150initDMA(void)
 //-------------------------------------------------------------------------------------------------------------------
 
 
-// IRQ handler called when line buffer is full (just before HSYNC)
+/*
+ * Run C and SIMD accumulation kernels on a snapshot of the last captured DMA line, check that both produce
+ * identical slot sums and print the cycles used (called from user interface)
+ */
+void TVP5150benchmark (void)
+{
+	static YCbCr_t		line [LINE_WIDTH/2];
+	static videoData_t	slotsC [SLOTS_X];
+	static videoData_t	slotsSIMD [SLOTS_X];
+	short 		width = dmaWidth;
+	short		slots = arrSlots;
+	const uint8_t *runs = arrRuns;
+	uint32_t	t, cyclesC, cyclesSIMD;
+	int 		i;
+
+	// the buffer not targeted by DMA holds the last complete line
+	memcpy (line, (void*)(DMA_GetCurrentMemoryTarget(DMA2_Stream1) == 0 ? &YCbCr_buf1[0] : &YCbCr_buf0[0]), width * sizeof (YCbCr_t));
+	memset (slotsC, 0, sizeof (slotsC));
+	memset (slotsSIMD, 0, sizeof (slotsSIMD));
+
+	CORE_CycleCounEn();
+	__disable_irq();			// < 20us; DMA double buffering covers this
+	t = CORE_GetCycleCount();
+	lineAddSlots (slotsC, line, runs, slots, 0);
+	cyclesC = CORE_GetCycleCount() - t;
+
+	t = CORE_GetCycleCount();
+	lineAddSlots (slotsSIMD, line, runs, slots, 1);
+	cyclesSIMD = CORE_GetCycleCount() - t;
+	__enable_irq();
+
+	printf ("\nSlot accumulation of %d pixel pairs into %d slots: C = %d cycles, SIMD = %d cycles\n", (int)width, (int)slots, (int)cyclesC, (int)cyclesSIMD);
+	printf ("  line IRQ: model %d cycles, last field max %d cycles, budget %d cycles\n",
+			(int)TVP5150lineCyclesEstimate(width, slots), (int)lineCyclesLast, (int)lineCyclesBudget);
+
+	for (i = 0; i < slots; i++)
+	{
+		if (slotsC[i].CbCr != slotsSIMD[i].CbCr || slotsC[i].Y != slotsSIMD[i].Y || slotsC[i].cnt != slotsSIMD[i].cnt)
+		{
+			printf ("  slot %d differs: C = %08X/%d/%d, SIMD = %08X/%d/%d\n", i,
+					(unsigned int)slotsC[i].CbCr, (int)slotsC[i].Y, (int)slotsC[i].cnt,
+					(unsigned int)slotsSIMD[i].CbCr, (int)slotsSIMD[i].Y, (int)slotsSIMD[i].cnt);
+			break;
+		}
+	}
+	if (i == slots)
+		printf ("  slot sums are identical\n");
+
+	printf ("VSYNC IRQ: last %d, max %d cycles; deferred conversion: last %d, max %d cycles per picture, %d jobs dropped\n",
+			(int)vsyncCycles, (int)vsyncCyclesMax, (int)convCycles, (int)convCyclesMax, (int)convJobsDropped);
+	printf ("Frames: id %d, dropped %d, duplicated %d\n", (int)rgbFrameSeq, (int)framesDropped, (int)framesDuplicated);
+	if (captureEdgeBands)
+	{
+		printf ("Edge bands %d x %d slots: %d pixel pairs skipped in last field\n",
+				(int)captureBandX, (int)captureBandY, (int)bandPairsSkipped);
+		printf ("  line IRQ cycles per field: %d with bands, %d without (every %d. picture) = %d saved; model estimate %d\n",
+				(int)lineCyclesFieldBands, (int)lineCyclesFieldAll, BAND_PROBE_PICTURES, (int)bandCyclesSaved, (int)bandCyclesModel);
+	}
+
+	// colour conversion: cycles per pixel (the deviation over all 2^24 inputs is checked by tools/dcmicheck.c)
+	{
+		static volatile rgbValue_t out;
+		uint32_t	Y;
+		uint32_t	cyclesLUT, cyclesInt;
+
+		if (colorTablesMatrix != colorMatrix)
+			colorBuildTables ();
+
+		__disable_irq();
+		t = CORE_GetCycleCount();
+		for (Y = 0; Y < 256; Y++)
+			yuv2rgbLUT ((rgbValue_t*)&out, Y, Y ^ 0x55, 255 - Y);
+		cyclesLUT = CORE_GetCycleCount() - t;
+
+		t = CORE_GetCycleCount();
+		for (Y = 0; Y < 256; Y++)
+			yuv2rgbInt ((rgbValue_t*)&out, Y, Y ^ 0x55, 255 - Y);
+		cyclesInt = CORE_GetCycleCount() - t;
+		__enable_irq();
+
+		printf ("\nColour conversion (%s): LUT = %d cycles/pixel, integer = %d cycles/pixel\n",
+				TVP5150colorMatrixName(colorTablesMatrix), (int)(cyclesLUT / 256), (int)(cyclesInt / 256));
+	}
+}
+
+
+
+
+// add one captured line to the slots and step to the next slot row when the current one is complete
+static inline void captureLine (const YCbCr_t *s)
+{
+	register videoData_t *p = (videoData_t*)arrP;
+
+	if (bandActive && arrRow >= bandRows && arrRow < SLOTS_Y - bandRows)
+	{
+		// center slot row: only the left and right edge band are needed
+		if (bandA > 0)
+			lineAddSlots (p, s, arrRuns, bandA, ACCU_SIMD);
+		if (bandB < arrSlots)
+			lineAddSlots (p + bandB, s + bandBPairs, arrRuns + bandB, arrSlots - bandB, ACCU_SIMD);
+
+		bandSlotsField += bandB - bandA;
+		bandPairsField += bandSkipPairs;
+	}
+	else
+		lineAddSlots (p, s, arrRuns, arrSlots, ACCU_SIMD);	// add video data in blocks (YCbCrSlots)
+
+	// line l of the field goes to slot row l * SLOTS_Y / cropHeight; the last row is queued at VSYNC
+	arrYslotCnt += SLOTS_Y;
+	if (arrYslotCnt >= cropHeight && arrRow < SLOTS_Y - 1)
+	{
+		arrYslotCnt -= cropHeight;
+		arrP += SLOTS_X;			// points to next row
+		convQueueJob (arrRow++ | arrPart);		// row complete -> convert it
+	}
+}
+
+
+// IRQ handler called when a buffer of DMA_LINES lines is full
 void DMA2_Stream1_IRQHandler (void)
 {
 	if (DMA_GetITStatus(DMA2_Stream1, DMA_IT_TCIF1) == SET)
 	{
+		uint32_t t0 = CORE_GetCycleCount();
+		short l;
+
 		STM_EVAL_LEDOn(LED_RED);		// set check point for oszi
 		DMA_ClearITPendingBit(DMA2_Stream1, DMA_IT_TCIF1);
 
-		register videoData_t *p = (videoData_t*)arrP;
 		register YCbCr_t	  *s = (YCbCr_t*)(DMA_GetCurrentMemoryTarget(DMA2_Stream1) == 0 ? &YCbCr_buf1[0] : &YCbCr_buf0[0]);
-		register short a = 0;
-		register short x;
 
-		for (x = dmaWidth; x != 0; x--)				// add video data in blocks (YCbCrSlots)
+		for (l = 0; l < DMA_LINES; l++)
 		{
-			p->Cb += (unsigned long)s->Cb - 128;		// Cb and Cr are 2s complement vlues
-			p->Cr += (unsigned long)s->Cr - 128;
-			p->Y  += (unsigned long)s->Y0;				// add both Y values
-			p->Y  += (unsigned long)s->Y1;
-			//			p->Y -= 32;									// Y has an offset of 16 (BTU.601)
-			p->cnt++;
-			s++;
-			a += (SLOTS_X / 2);
-			if (a > dmaWidth)
-			{
-				a -= dmaWidth;
-				p++;			// gather pixels into next X slot
-			}
-		}
-
-		arrYslotCnt += SLOTS_Y;
-		if (arrYslotCnt > cropHeight)
-		{
-			arrYslotCnt -= cropHeight;
-			arrP += SLOTS_X;			// points to next row
+			captureLine (s);
+			s += dmaWidth;
 		}
 		STM_EVAL_LEDOff(LED_RED);
+
+		t0 = CORE_GetCycleCount() - t0;
+		lineCyclesPicture += t0;
+		t0 /= DMA_LINES;									// per line
+		if (t0 > lineCyclesMax)
+			lineCyclesMax = t0;
 	}
 }
 
@@ -419,13 +1218,13 @@ void DMA2_Stream1_IRQHandler (void)
 void DCMI_IRQHandler(void)
 {
 	// check masked IE bits
+	static short overflow = 0;
+
 	if (DCMI->MISR & DCMI_IT_VSYNC)
 	{
-		DCMI_CROPInitTypeDef DCMI_Crop;
-		short x, y;
-		long l;
-
-		captureLeftRight = (captureLeftRight == 0 ? 1 : 0);		// toggle left/right side
+		uint32_t t0 = CORE_GetCycleCount();
+		short wasFull = captureFull;				// mode of the field just finished
+		short wasLeftRight = captureLeftRight;
 
 		STM_EVAL_LEDOn(LED_ORN);
 
@@ -437,21 +1236,56 @@ void DCMI_IRQHandler(void)
 		DMA_Cmd(DMA2_Stream1, DISABLE);
 		while (DMA_GetCmdStatus(DMA2_Stream1) != DISABLE);
 
+		if (DMA_LINES > 1)
+		{
+			// flush the lines of the last, partly filled buffer (FIFO has been drained by disabling the stream)
+			short lines = (dmaBufLen - DMA_GetCurrDataCounter(DMA2_Stream1)) / dmaWidth;
+			const YCbCr_t *s = (YCbCr_t*)(DMA_GetCurrentMemoryTarget(DMA2_Stream1) == 0 ? &YCbCr_buf0[0] : &YCbCr_buf1[0]);
 
-		// reset values because they may have been changed by user
-		dmaWidth = captureWidth / 4;
-		dmaBufLen = dmaWidth;
+			while (lines-- > 0)
+			{
+				captureLine (s);
+				s += dmaWidth;
+			}
+		}
 
-		arrP = (captureLeftRight == 0 ? &YCbCrSlots[0] : &YCbCrSlots[SLOTS_X/2]);
-		arrYslotCnt = 0;
+		while (arrRow < SLOTS_Y)				// hand over the rows not yet queued by line IRQ
+			convQueueJob (arrRow++ | arrPart);
 
-		DCMI_CROPCmd (DISABLE);
-		DCMI_Crop.DCMI_CaptureCount 			= captureWidth-1;
-		DCMI_Crop.DCMI_HorizontalOffsetCount 	= cropLeft + (captureLeftRight == 0 ? 0 : captureWidth);
-		DCMI_Crop.DCMI_VerticalLineCount 		= cropHeight - 1;
-		DCMI_Crop.DCMI_VerticalStartLine 		= cropTop;
-		DCMI_CROPConfig (&DCMI_Crop);
-		DCMI_CROPCmd (ENABLE);
+		lineCyclesLast = lineCyclesMax;
+		lineCyclesMax = 0;
+		bandPairsSkipped = bandPairsField;
+		if (!bandProbe)
+			bandCyclesModel = bandPairsField * (ACCU_SIMD ? LINE_IRQ_CYCLES_PAIR_SIMD : LINE_IRQ_CYCLES_PAIR_C) + bandSlotsField * LINE_IRQ_CYCLES_SLOT;
+		bandPairsField = bandSlotsField = 0;
+
+		if (wasFull || wasLeftRight == 1)			// picture complete: measured line IRQ cycles per field
+		{
+			static short lastFull = -1;
+			unsigned long perField = lineCyclesPicture / (wasFull ? 1 : 2);
+
+			if (wasFull != lastFull || !captureEdgeBands)
+				lineCyclesFieldBands = lineCyclesFieldAll = 0;		// values of another mode are not comparable
+			lastFull = wasFull;
+
+			if (bandProbe)
+				lineCyclesFieldAll = perField;
+			else if (captureEdgeBands)
+				lineCyclesFieldBands = perField;
+			bandCyclesSaved = (lineCyclesFieldAll > lineCyclesFieldBands && lineCyclesFieldBands != 0 ?
+								lineCyclesFieldAll - lineCyclesFieldBands : 0);
+			lineCyclesPicture = 0;
+		}
+		captureSelectMode (overflow);
+		overflow = 0;
+
+		if (captureFull || wasFull)
+			captureLeftRight = 0;					// full width, or split mode restarting with left half
+		else
+			captureLeftRight = (captureLeftRight == 0 ? 1 : 0);		// toggle left/right side
+
+		// reset values because they may have been changed by user
+		captureSetWindow ();
 
 		DMA_SetCurrDataCounter(DMA2_Stream1, dmaBufLen);
 		DMA_MemoryTargetConfig(DMA2_Stream1, (uint32_t)&YCbCr_buf0[0], DMA_Memory_0);
@@ -464,61 +1298,14 @@ void DCMI_IRQHandler(void)
 		DCMI_Cmd(ENABLE);
 		DCMI_CaptureCmd(ENABLE);			// start capture
 
-		// now transform the YCbCr values into RGB-values
-
-		{
-			// when captureLeftRight = left then process the right half
-			short offset = (captureLeftRight == 0 ? SLOTS_X/2 : 0);
-			videoData_t *cp = (videoData_t *)(captureLeftRight == 0 ? &YCbCrSlots[SLOTS_X/2] : &YCbCrSlots[0]);
-
-
-			for (y = 0; y < SLOTS_Y; y++)
-			{
-				for (x = offset; x < offset+SLOTS_X/2; x++)
-				{
-					if (cp->cnt > 0)
-					{
-						long Y = (cp->Y / cp->cnt) / 2;		// we have 2 Y values here
-						long Cb =(cp->Cb / cp->cnt);		// build average values
-						long Cr =(cp->Cr / cp->cnt);
-
-						// we use integer arithmetics here to speed up; do it step by step, some compilers do strange things
-						l = (Cr * 1403);				// red
-						l /= 1000;
-						l += Y;
-						if (l < 0) l = 0;
-						if (l > 254) l = 254;
-						rgbSlots[y][x].R = l;
-
-						l = (Cr * 714) + (Cb * 344);	// green
-						l /= 1000;
-						l = Y - l;
-						if (l < 0) l = 0;
-						if (l > 254) l = 254;
-						rgbSlots[y][x].G = l;
-
-						l = (Cb * 1773);				// blue
-						l /= 1000;
-						l += Y;
-						if (l < 0) l = 0;
-						if (l > 254) l = 254;
-						rgbSlots[y][x].B = l;
-					}
-					cp->Cb = 0;
-					cp->Cr = 0;
-					cp->Y = 0;
-					cp->cnt= 0;
-
-					cp += 1;
-				}
-				cp += (SLOTS_X/2);	// skip to next line
-			}
-		}
-
-		if (captureLeftRight == 0)
-			captureReady = 1;			// semaphore for main loop to update LEDs
+		if (wasFull || wasLeftRight == 1)
+			convQueueJob (CONV_PICTURE_END);	// picture complete after conversion (sets captureReady)
 
 		STM_EVAL_LEDOff(LED_ORN);
+
+		vsyncCycles = CORE_GetCycleCount() - t0;
+		if (vsyncCycles > vsyncCyclesMax)
+			vsyncCyclesMax = vsyncCycles;
 	}
 
 	if (DCMI->MISR & DCMI_IT_LINE)
@@ -537,6 +1324,7 @@ void DCMI_IRQHandler(void)
 	{
 		//		STM_EVAL_LEDToggle (LED_BLU);
 		DCMI_ClearFlag(DCMI_FLAG_OVFRI);
+		overflow = 1;
 		put_c2Host('O');
 	}
 
@@ -550,6 +1338,34 @@ void DCMI_IRQHandler(void)
 
 
 
+// Deferred conversion stage (lowest priority); processes the rows queued by line and VSYNC IRQ
+void PendSV_Handler (void)
+{
+	while (convTail != convHead)
+	{
+		uint8_t job = convQueue[convTail];
+		uint32_t t0 = CORE_GetCycleCount();
+
+		if ((job & 0x3f) == CONV_PICTURE_END)
+		{
+			convCycles = convCyclesPicture;
+			if (convCycles > convCyclesMax)
+				convCyclesMax = convCycles;
+			convCyclesPicture = 0;
+			framePublish ();
+			captureReady = 1;			// semaphore for main loop to update LEDs
+		}
+		else
+		{
+			convertRow (job & 0x3f, job & 0xc0);
+			convCyclesPicture += CORE_GetCycleCount() - t0;		// includes time of preempting IRQs
+		}
+		convTail = (convTail + 1) & (CONV_QUEUE_SIZE - 1);
+	}
+}
+
+
+
 // IRQ called when vertical blanking starts
 // currently not used
 void EXTI15_10_IRQHandler (void)
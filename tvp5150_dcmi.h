@@ -39,6 +39,7 @@
 
 #define		SLOTS_X			64			// LED slots with RGB values from picture processor
 #define		SLOTS_Y			40
+#define		RAW_ROW_BYTES	(SLOTS_X * 8)	// one row of slot sums (CbCr u32, Y u16, cnt u16; little endian)
 
 #define		CROP_TOP_MIN	24
 #define		CROP_HEIGHT_MAX	284
@@ -46,6 +47,49 @@
 #define		CROP_WIDTH_MAX
 #define  	TVP5150_I2C_ADR		0xB8	// slave addr of chip
 
+typedef enum {
+	CAPTURE_SPLIT = 0,		// left and right half in alternating fields (25 pictures/s)
+	CAPTURE_FULL,			// full line width in every field (50 pictures/s)
+	CAPTURE_AUTO,			// full width; falls back to split when the line IRQ exceeds its budget
+	CAPTURE_MODES
+} captureMode_e;
+
+typedef enum {
+	COLOR_BT601_FULL = 0,	// YCbCr -> RGB matrices (see TVP5150colorMatrixName())
+	COLOR_BT601_LIMITED,
+	COLOR_BT709_FULL,
+	COLOR_BT709_LIMITED,
+	COLOR_MATRICES
+} colorMatrix_e;
+
+typedef enum {
+	STD_UNKNOWN = 0,		// video standards reported by TVP5150 (see TVP5150standardFromStatus())
+	STD_PAL,
+	STD_PAL_N,
+	STD_SECAM,
+	STD_NTSC,
+	STD_PAL_M,
+	STD_NTSC443,
+	STD_COUNT
+} videoStd_e;
+
+#define		VIDEO_625		0		// line systems; each has its own crop profile
+#define		VIDEO_525		1
+#define		VIDEO_SYSTEMS	2
+
+typedef struct {
+	unsigned long	cropLeft;
+	unsigned long	captureWidth;
+	unsigned long	cropTop;
+	unsigned long	cropHeight;
+} cropProfile_t;
+
+typedef enum {
+	SLOT_PROFILE_UNIFORM = 0,	// all slots of a line have the same width
+	SLOT_PROFILE_EDGE,			// finer slots near left and right picture border
+	SLOT_PROFILES
+} slotProfile_e;
+
 // TVP5150AM1 register address and default values
 #define R00_Video_input_source_selection_1    		0x00    // 00h  R/W
 #define R01_Analog_channel_controls    				0x01    // 15h  R/W
@@ -156,9 +200,23 @@ int tvp5150_read (short addr);
 void TVP5150selectVideoSource (unsigned char src);
 unsigned char TVP5150hasVideoSignal ();
 unsigned char TVP5150getStatus1 ();
-
-
-extern volatile rgbValue_t  rgbSlots [SLOTS_Y][SLOTS_X];
+void TVP5150benchmark (void);
+unsigned long TVP5150lineCyclesEstimate (short width, short slots);
+const char *TVP5150colorMatrixName (unsigned char m);
+uint32_t TVP5150acquireFrame (void);
+void TVP5150clearFrames (void);
+void TVP5150setEdgeBands (short x, short y);
+videoStd_e TVP5150standardFromStatus (unsigned char r8c);
+const char *TVP5150standardName (unsigned char std);
+unsigned short TVP5150fieldLines (void);
+short TVP5150checkStandard (void);
+void TVP5150requestRawRow (short y);
+short TVP5150getRawRow (uint8_t *buf);
+
+
+extern rgbValue_t			(*rgbSlots)[SLOTS_X];		// RGB slots of the frame acquired by main()
+extern unsigned long		rgbFrameSeq;
+extern volatile unsigned long	framesDropped, framesDuplicated;
 extern volatile short 		captureReady;
 
 extern unsigned char		videoSourceSelect;			// 0 = auto; 1/2 = video channel
@@ -172,8 +230,25 @@ extern unsigned long	captureWidth;
 extern unsigned long	cropLeft;
 extern unsigned long	cropTop;
 extern unsigned long	cropHeight;
+extern cropProfile_t	cropProfiles[VIDEO_SYSTEMS];
+extern unsigned char	videoSystem;				// VIDEO_625 / VIDEO_525
+extern unsigned char	videoStandard;				// videoStd_e
 
 extern unsigned short	tvp5150AGC;					// pitschu 140505: user selectable setting (usrinterface.c)
 
+extern unsigned char	colorMatrix;				// colorMatrix_e; user setting
+extern unsigned char	slotProfile;				// slotProfile_e; user setting
+extern unsigned char	captureEdgeBands;			// 1 = capture only edge bands; user setting
+extern volatile short	captureBandX, captureBandY;	// edge bands of current picture (0 = all captured)
+extern volatile unsigned long	bandPairsSkipped, bandCyclesSaved, bandCyclesModel;
+extern unsigned char	captureMode;				// captureMode_e; user setting
+extern volatile short	captureFull;				// 1 = currently capturing full width
+extern volatile unsigned long	captureFallbacks;
+extern volatile unsigned long	lineCyclesLast;
+extern unsigned long	lineCyclesBudget;
+extern volatile unsigned long	vsyncCycles, vsyncCyclesMax;		// VSYNC IRQ runtime
+extern volatile unsigned long	convCycles, convCyclesMax;			// deferred conversion (PendSV) per picture
+extern volatile unsigned long	convJobsDropped;					// conversion jobs lost on a full queue
+
 //--------------------------------------------------------------
 #endif
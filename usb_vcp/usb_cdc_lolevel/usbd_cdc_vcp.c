@@ -26,6 +26,8 @@ extern uint8_t  APP_Rx_Buffer []; /* Write CDC received data in this buffer.
 extern uint32_t APP_Rx_ptr_in;    /* Increment this pointer or roll it back to
                                      start address when writing received data
                                      in the buffer APP_Rx_Buffer. */
+extern uint32_t APP_Rx_ptr_out;   /* read position of the CDC core, may be
+                                     APP_RX_DATA_SIZE until it is rolled back */
 
 //--------------------------------------------------------------
 static uint16_t VCP_Init     (void);
@@ -187,6 +189,22 @@ void UB_VCP_DataTx (uint8_t wert)
 }
 
 
+//--------------------------------------------------------------
+//  pitschu
+// Freier Platz im Sendepuffer (UB_VCP_DataTx prueft nicht auf Ueberlauf)
+// Ret_wert : Anzahl Bytes, die ohne Ueberschreiben eingetragen werden koennen
+//--------------------------------------------------------------
+uint16_t UB_VCP_TxFree(void)
+{
+	uint32_t out = APP_Rx_ptr_out;
+
+	if (out >= APP_RX_DATA_SIZE)
+		out = 0;
+
+	return (uint16_t)((out + APP_RX_DATA_SIZE - APP_Rx_ptr_in - 1) % APP_RX_DATA_SIZE);
+}
+
+
 //--------------------------------------------------------------
 // Einen String aus dem Empfangspuffer auslesen
 // bis zur ersten Endekennung (0x0D)
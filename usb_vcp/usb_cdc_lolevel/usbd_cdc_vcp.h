@@ -40,6 +40,7 @@ typedef struct
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 void UB_VCP_DataTx (uint8_t wert);		// send char
+uint16_t UB_VCP_TxFree(void);			// pitschu: free bytes in TX buffer
 uint16_t UB_VCP_StringRx(char *ptr);	// read string including \r
 int16_t UB_VCP_CharRx(void);			// pitschu: get char from RX stream
 
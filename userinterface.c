@@ -26,6 +26,10 @@
 #include "main.h"
 #include "ambiLight.h"
 #include "stm32_ub_usb_cdc.h"
+#include "framestream.h"
+#if WS2812_LANES > 1
+#include "ws2812par.h"
+#endif
 
 
 typedef enum {
@@ -47,12 +51,120 @@ typedef enum {
 	MS_TVP_AGC,			// pitschu: added 140505
 	MS_XLEDS,			// pitschu: added 140502
 	MS_YLEDS,
-	MS_DYN_INT			// pitschu v1.2
+	MS_DYN_INT,			// pitschu v1.2
+	MS_CAPTURE_MODE,
+	MS_COLOR_MATRIX,
+	MS_SLOT_PROFILE,
+	MS_EDGE_BANDS,
+	MS_RECORD,
+	MS_LAYOUT,
+	MS_KERNEL,
+	MS_GAMMA
 } mainStates_e;
 
 
 mainStates_e mainState = MS_NONE;
 
+static uint8_t	layoutField = 0;		// selected field of the LED layout: segment * LAYOUT_FIELDS + field
+
+#define		LAYOUT_FIELDS		5		// edge, from, to, leds, skip
+
+static uint8_t	kernelField = 0;		// selected field of the edge kernels: edge * 2 + (0 = depth, 1 = kernel)
+
+
+static void printCaptureMode (void)
+{
+	static const char *modeNames[CAPTURE_MODES] = {"SPLIT", "FULL", "AUTO"};
+
+	printf("\nCapture mode is %s (now %s width; %d fallbacks; line IRQ %d of %d cycles)\n",
+			modeNames[captureMode % CAPTURE_MODES], captureFull ? "full" : "half",
+			(int)captureFallbacks, (int)lineCyclesLast, (int)lineCyclesBudget);
+}
+
+
+static void printRecordMode (void)
+{
+	static const char *modeNames[FS_MODES] = {"OFF", "RGB frames", "RGB frames + raw rows"};
+
+	printf("\nFrame recording is %s (%lu records sent, %lu aborted)\n",
+			modeNames[framestreamMode % FS_MODES], framestreamFrames, framestreamAborts);
+}
+
+
+static void printLayout (void)
+{
+	static const char *edgeNames[LED_EDGES] = {"right", "top", "left", "bottom"};
+	int i, f;
+
+	if (ledLayout[0].leds == 0)
+	{
+		printf("\nLED layout: ring of %d x %d LEDs (d = edit as segments)\n", ledsX, ledsY);
+		return;
+	}
+
+	printf("\nLED layout (%d LEDs; </> select, +/- change, d = back to ring):\n", ledsLayoutTotal);
+	for (i = 0; i < LED_SEGMENTS; i++)
+	{
+		int v[LAYOUT_FIELDS] = {ledLayout[i].edge, ledLayout[i].from, ledLayout[i].to, ledLayout[i].leds, ledLayout[i].skip};
+
+		printf(" %d:", i);
+		for (f = 0; f < LAYOUT_FIELDS; f++)
+		{
+			char mark = (layoutField == i * LAYOUT_FIELDS + f) ? '>' : ' ';
+
+			if (f == 0)
+				printf(" %c%-6s", mark, edgeNames[v[f] % LED_EDGES]);
+			else
+				printf(" %c%s %3d", mark, f == 1 ? "from" : f == 2 ? "to" : f == 3 ? "leds" : "skip", v[f]);
+		}
+		printf("\n");
+		if (ledLayout[i].leds == 0)			// end of table
+			break;
+	}
+}
+
+
+static void printKernels (void)
+{
+	static const char *edgeNames[LED_EDGES] = {"right", "top", "left", "bottom"};
+	static const char *kernelNames[EDGE_KERNELS] = {"exponential", "box", "gauss", "center"};
+	int i;
+
+	printf("\nEdge kernels (</> select, +/- change, d = all exponential with frame width %d):\n", frameWidth);
+	for (i = 0; i < LED_EDGES; i++)
+	{
+		printf(" %-6s %cdepth %2d%s %ckernel %s\n", edgeNames[i],
+				kernelField == i * 2 ? '>' : ' ', (int)ambiLightEdgeDepth (i), edgeKernel[i].depth ? "  " : " E",
+				kernelField == i * 2 + 1 ? '>' : ' ', kernelNames[edgeKernel[i].kernel % EDGE_KERNELS]);
+	}
+}
+
+
+// change the selected field of the LED layout by <d>
+static void changeLayout (int d)
+{
+	ledSegment_t *seg = &ledLayout[layoutField / LAYOUT_FIELDS];
+
+	switch (layoutField % LAYOUT_FIELDS)
+	{
+	case 0:
+		seg->edge = (seg->edge + LED_EDGES + d) % LED_EDGES;
+		break;
+	case 1:
+		if (seg->from + d >= 0 && seg->from + d <= 100) seg->from += d;
+		break;
+	case 2:
+		if (seg->to + d >= 0 && seg->to + d <= 100) seg->to += d;
+		break;
+	case 3:
+		if (seg->leds + d >= 0 && seg->leds + d <= LEDS_XMAX) seg->leds += d;
+		break;
+	default:
+		if (seg->skip + d >= 0 && seg->skip + d <= LEDS_XMAX) seg->skip += d;
+		break;
+	}
+}
+
 
 int UserInterface (void)
 {
@@ -68,12 +180,79 @@ int UserInterface (void)
 		case 'q':
 			ambiLightPrintDynInfos();
 			break;
+		case '#':
+			TVP5150benchmark();
+			ambiLightBenchmark();
+			printf("\nLED updates: %lu, %lu without change (no DMA), %lu partial, %lu while busy\n", ws2812updates,
+					ws2812skipped, ws2812partial, ws2812busy);
+#if WS2812_STREAMING
+			printf("LED stream underruns: %lu\n", ws2812underruns);
+#endif
+#if WS2812_LANES > 1
+			printf("LED lanes: %d, longest %d LEDs = %d us per frame (one line: %d us)\n", WS2812_LANES, ws2812parLongest,
+					ws2812parLongest * 24 * 10000 / (WS2812_OUT_FREQ / 100), ledsPhysical * 24 * 10000 / (WS2812_OUT_FREQ / 100));
+#endif
+			break;
 		case 'n':
 		case 'N':
 			TVP5150stopCapture ();
 			TVP5150init();
 			TVP5150startCapture();
 			break;
+		case 'o':
+		case 'O':
+			mainState = MS_CAPTURE_MODE;
+			printCaptureMode();
+			break;
+		case 'j':
+		case 'J':
+			mainState = MS_COLOR_MATRIX;
+			printf("\nColour matrix is %s\n", TVP5150colorMatrixName(colorMatrix));
+			break;
+		case 'u':
+		case 'U':
+			mainState = MS_SLOT_PROFILE;
+			printf("\nSlot widths are %s\n", slotProfile == SLOT_PROFILE_EDGE ? "finer at the edges" : "uniform");
+			break;
+		case 'z':
+		case 'Z':
+			mainState = MS_EDGE_BANDS;
+			printf("\nEdge band capture is %s\n", captureEdgeBands ? "ON" : "OFF");
+			break;
+		case '*':
+			mainState = MS_RECORD;
+			printRecordMode();
+			break;
+		case '@':
+			mainState = MS_LAYOUT;
+			printLayout();
+			break;
+		case 'k':
+		case 'K':
+			mainState = MS_KERNEL;
+			printKernels();
+			break;
+		case '^':
+			mainState = MS_GAMMA;
+			printf("\nLED gamma is %d.%d\n", ws2812gamma / 10, ws2812gamma % 10);
+			break;
+		case '<':
+		case '>':
+			if (mainState == MS_LAYOUT && ledLayout[0].leds != 0)
+			{
+				short next = (layoutField + 1) / LAYOUT_FIELDS;		// segment of the next field; up to the table end
+
+				if (c=='>' && next < LED_SEGMENTS && (next == 0 || ledLayout[next-1].leds != 0)) layoutField += 1;
+				if (c=='<' && layoutField > 0) layoutField -= 1;
+				printLayout();
+			}
+			if (mainState == MS_KERNEL)
+			{
+				if (c=='>' && kernelField < LED_EDGES * 2 - 1) kernelField += 1;
+				if (c=='<' && kernelField > 0) kernelField -= 1;
+				printKernels();
+			}
+			break;
 		case 'a':
 		case 'A':
 			mainState = MS_TVP_AGC;
@@ -82,7 +261,7 @@ int UserInterface (void)
 		case 'm':
 		case 'M':
 			mainState = MS_FRAME_DELAY;
-			printf("\nCurrent frame delay is %d frames\n", (int)tvprocDelayTime);
+			printf("\nCurrent LED delay is %d ms (delay line holds %d pictures)\n", (int)tvprocDelayMs, (int)ambiLightDelayEntries());
 			break;
 		case 'e':
 		case 'E':
@@ -192,10 +371,10 @@ int UserInterface (void)
 				printf("\nAGC setting is %s\n", tvp5150AGC ? "ON" : "OFF");
 				break;
 			case MS_FRAME_DELAY:
-				if (c=='+' && tvprocDelayTime < DELAY_LINE_SIZE-1) tvprocDelayTime += 1;
-				if (c=='-' && tvprocDelayTime > 0) tvprocDelayTime -= 1;
-				if (c=='d')	tvprocDelayTime = 0;
-				printf("Frame delay is %d frames\n", tvprocDelayTime);
+				if (c=='+' && tvprocDelayMs < DELAY_MS_MAX) tvprocDelayMs += DELAY_MS_STEP;
+				if (c=='-' && tvprocDelayMs > 0) tvprocDelayMs -= DELAY_MS_STEP;
+				if (c=='d')	tvprocDelayMs = 0;
+				printf("LED delay is %d ms\n", tvprocDelayMs);
 				break;
 			case MS_FRAME_WID:
 				if (c=='+' && frameWidth < 11) frameWidth += 1;
@@ -283,7 +462,7 @@ int UserInterface (void)
 				printf("\nCrop left is %d\n", (int)cropLeft/2);
 				printf("Capture width is %d\n", (int)captureWidth);
 				printf("Capture right is %d\n", (int)(cropLeft/2 + captureWidth));
-				memset((void*)&rgbSlots[0][0], 0, sizeof (rgbSlots));
+				TVP5150clearFrames();
 				break;
 			case MS_RIGHT:
 				if (c=='+' && captureWidth < 740)
@@ -301,10 +480,10 @@ int UserInterface (void)
 				printf("\nCrop left is %d\n", (int)cropLeft/2);
 				printf("Capture width is %d\n", (int)captureWidth);
 				printf("Capture right is %d\n", (int)(cropLeft/2 + captureWidth));
-				memset((void*)&rgbSlots[0][0], 0, sizeof (rgbSlots));
+				TVP5150clearFrames();
 				break;
 			case MS_TOP:
-				if (c=='+' && cropTop < 150 && (cropTop + cropHeight) < 312)
+				if (c=='+' && cropTop < 150 && (cropTop + cropHeight) < TVP5150fieldLines())
 				{
 					cropTop += 1;
 					cropHeight -= 1;
@@ -317,14 +496,14 @@ int UserInterface (void)
 				if (c=='d')
 				{
 					cropTop = 16;
-					cropHeight = 288;
+					cropHeight = TVP5150fieldLines() - 24;		// 288 for PAL, 238 for NTSC
 				}
 				printf("\nCrop top is %d\n", (int)cropTop);
 				printf("Crop bottom is %d\n", (int)(cropTop+cropHeight-1));
-				memset((void*)&rgbSlots[0][0], 0, sizeof (rgbSlots));
+				TVP5150clearFrames();
 				break;
 			case MS_HEIGHT:
-				if (c=='+' && (cropTop + cropHeight) < 312)
+				if (c=='+' && (cropTop + cropHeight) < TVP5150fieldLines())
 				{
 					cropHeight += 1;
 				}
@@ -332,10 +511,91 @@ int UserInterface (void)
 				{
 					cropHeight -= 1;
 				}
-				if (c=='d')	cropHeight = 288;
+				if (c=='d')	cropHeight = TVP5150fieldLines() - 24;
 				printf("\nCrop top is %d\n", (int)cropTop);
 				printf("Crop bottom is %d\n", (int)(cropTop+cropHeight-1));
-				memset((void*)&rgbSlots[0][0], 0, sizeof (rgbSlots));
+				TVP5150clearFrames();
+				break;
+
+			case MS_CAPTURE_MODE:
+				if (c=='+') captureMode = (captureMode + 1) % CAPTURE_MODES;
+				if (c=='-') captureMode = (captureMode + CAPTURE_MODES - 1) % CAPTURE_MODES;
+				if (c=='d')	captureMode = CAPTURE_AUTO;
+				printCaptureMode();
+				break;
+
+			case MS_COLOR_MATRIX:
+				if (c=='+') colorMatrix = (colorMatrix + 1) % COLOR_MATRICES;
+				if (c=='-') colorMatrix = (colorMatrix + COLOR_MATRICES - 1) % COLOR_MATRICES;
+				if (c=='d')	colorMatrix = COLOR_BT601_FULL;
+				printf("\nColour matrix is %s\n", TVP5150colorMatrixName(colorMatrix));
+				break;
+
+			case MS_SLOT_PROFILE:
+				if (c=='+') slotProfile = SLOT_PROFILE_EDGE;
+				if (c=='-') slotProfile = SLOT_PROFILE_UNIFORM;
+				if (c=='d')	slotProfile = (slotProfile == SLOT_PROFILE_EDGE ? SLOT_PROFILE_UNIFORM : SLOT_PROFILE_EDGE);	// toggle
+				printf("\nSlot widths are %s\n", slotProfile == SLOT_PROFILE_EDGE ? "finer at the edges" : "uniform");
+				break;
+
+			case MS_EDGE_BANDS:
+				if (c=='+') captureEdgeBands = 1;
+				if (c=='-') captureEdgeBands = 0;
+				if (c=='d')	captureEdgeBands = (captureEdgeBands ? 0 : 1);		// toggle
+				printf("\nEdge band capture is %s\n", captureEdgeBands ? "ON" : "OFF");
+				break;
+
+			case MS_RECORD:
+				if (c=='+') framestreamMode = (framestreamMode + 1) % FS_MODES;
+				if (c=='-') framestreamMode = (framestreamMode + FS_MODES - 1) % FS_MODES;
+				if (c=='d')	framestreamMode = FS_OFF;
+				printRecordMode();
+				break;
+
+			case MS_LAYOUT:
+				if (c=='d')
+				{
+					memset (ledLayout, 0, sizeof (ledLayout));
+					if (ledsLayoutTotal == 0)		// ring -> same ring as segments to start editing from
+					{
+						ledLayout[0] = (ledSegment_t){LED_EDGE_RIGHT,	100, 0,	ledsY, 0};
+						ledLayout[1] = (ledSegment_t){LED_EDGE_TOP,		100, 0,	ledsX, 0};
+						ledLayout[2] = (ledSegment_t){LED_EDGE_LEFT,	0, 100,	ledsY, 0};
+						ledLayout[3] = (ledSegment_t){LED_EDGE_BOTTOM,	0, 100,	ledsX, 0};
+					}
+					layoutField = 0;
+				}
+				else if (ledLayout[0].leds != 0)
+					changeLayout (c=='+' ? 1 : -1);
+				WS2812layoutUpdate();
+				ambiLightClearImage();
+				printLayout();
+				break;
+
+			case MS_KERNEL:
+			{
+				edgeKernel_t *k = &edgeKernel[kernelField / 2];
+
+				if (kernelField % 2 == 0)		// depth 0 (= frameWidth) .. EDGE_DEPTH_MAX
+				{
+					if (c=='+' && k->depth < EDGE_DEPTH_MAX) k->depth += 1;
+					if (c=='-' && k->depth > 0) k->depth -= 1;
+				}
+				else
+				{
+					if (c=='+') k->kernel = (k->kernel + 1) % EDGE_KERNELS;
+					if (c=='-') k->kernel = (k->kernel + EDGE_KERNELS - 1) % EDGE_KERNELS;
+				}
+				if (c=='d')	memset (edgeKernel, 0, sizeof (edgeKernel));
+				printKernels();
+				break;
+			}
+
+			case MS_GAMMA:
+				if (c=='+' && ws2812gamma < WS2812_GAMMA_MAX) ws2812gamma += 1;
+				if (c=='-' && ws2812gamma > WS2812_GAMMA_LINEAR) ws2812gamma -= 1;
+				if (c=='d')	ws2812gamma = WS2812_GAMMA_LINEAR;
+				printf("LED gamma is %d.%d\n", ws2812gamma / 10, ws2812gamma % 10);
 				break;
 
 			case MS_DYN_INT:
@@ -394,16 +654,25 @@ int UserInterface (void)
 				printf("     L=Left, W=Width, T=Top, H=Height\n");
 				printf("     I=I-factor of integrator (128 = MAX)\n");
 				printf("     E=# of slots aggregated for LED strip (1..10)\n");
+				printf("     K=sampling depth and kernel per edge (</> select)\n");
+				printf("     ^=LED gamma (1.0 = linear .. 3.0)\n");
 				printf("     G=Frame count for dynamic 'black border' detection (0=OFF; 1..200)\n");
 				printf("     X=virtual image width in blocks\n");
 				printf("     Y=virtual image height in blocks\n");
 				printf("     P=Physical image width: # of LEDs\n");
 				printf("     R=Physical image height: # of LEDs\n");
+				printf("     @=LED layout as segments (</> select field, +/- change, d=ring <-> segments)\n");
 				printf("     V=select video source (1 or 2)\n");
 				printf("     Q=show info about Dyn Matrix\n");
 				printf("     N=restart TVP5150 and show reg info\n");
+				printf("     #=run capture benchmarks\n");
+				printf("     *=frame recording to the host: +/- OFF, RGB frames, RGB frames + raw rows (d=OFF)\n");
 				printf("     A=set TVP5150 auto gain control ON/OFF\n");
-				printf("     M=set frame delay time (0-20 frames)\n");
+				printf("     O=capture mode: split (L/R in alternate fields), full width or auto\n");
+				printf("     J=colour matrix: BT.601 / BT.709, full or limited range\n");
+				printf("     U=slot widths uniform (-) or finer at the picture edges (+)\n");
+				printf("     Z=capture only the edge bands used for the LEDs ON/OFF\n");
+				printf("     M=set LED delay time (0-3000 ms)\n");
 				printf("     0,1 or 2: Set input channel 1 or 2; 0 = Auto\n");
 				break;
 		}
@@ -411,7 +680,7 @@ int UserInterface (void)
 		switch (mainState)
 		{
 		case MS_FRAME_DELAY:
-			displayOverlayPercents(((int)tvprocDelayTime*100)/(DELAY_LINE_SIZE-1), 300);
+			displayOverlayPercents(((int)tvprocDelayMs*100)/DELAY_MS_MAX, 300);
 			break;
 		case MS_FRAME_WID:
 			displayOverlayPercents(((int)frameWidth*100)/11, 300);
@@ -21,83 +21,241 @@
 
 
 #include <stdio.h>
+#include <math.h>
+#include "string.h"
 #include "stm32f4xx.h"
 #include "ws2812.h"
+#if WS2812_LANES > 1
+#include "ws2812par.h"
+#endif
+#if WS2812_APA102
+#include "apa102.h"
+#endif
 #include "main.h"
 
+#define		WS2812_PWM_LINE		(WS2812_LANES == 1 && !WS2812_APA102)	// output by the timer PWM of this file
+
 
 int			ledsX		=	48;					// physical number of LEDs (48 x 28 is for my Samsung 40" TV)
 int			ledsY		=	28;
 
+ledSegment_t ledLayout[LED_SEGMENTS];						// empty = ring of ledsX/ledsY (see ws2812.h)
+int			ledsLayoutTotal = 0;
+
 rgbValue_t 	ws2812ledRGB[LEDS_MAXTOTAL];			// color data for all leds
 
 rgbValue_t 	ws2812ledOVR[LEDS_MAXTOTAL];			// overlay color data for all leds (has higher prio than ws2812ledRGB
 unsigned char ws2812ledHasOVR[LEDS_MAXTOTAL];
 volatile unsigned long ws2812ovrlayCounter;				// ignore overlay when 0 (decr in system ticker)
 
-static uint16_t 		ws2812timerValues[WS2812_MAXDMA_LEN+1];	// buffer for timer/dma, one byte per bit + reset pulse
+#if WS2812_STREAMING
+/*
+ * Streaming output: the DMA runs in circular mode over a ring of WS2812_RING_LEDS LEDs. Each half of the ring is
+ * encoded again from ws2812encoded[] in the half/full transfer IRQ while the DMA sends the other half, so the
+ * transfer starts after the first ring is encoded and the memory does not depend on the strip length. After the
+ * last LED the ring is filled with zeros (reset pulse) and the DMA is stopped when those were sent.
+ */
+#define		WS2812_RING_HALF		(WS2812_RING_LEDS / 2 * 3 * 8)
+#define		WS2812_RESET_UNITS		((WS2812_RESET_LEN + 3 * 8 - 1) / (3 * 8))	// reset pulse in LED times
+
+static uint16_t			ws2812ring[2 * WS2812_RING_HALF] __attribute__ ((aligned (4)));
+static short			ws2812streamLed;						// next LED (or reset unit) to encode into the ring
+static volatile short	ws2812streamSent;						// LEDs (or reset units) sent
+static short			ws2812streamUnits;						// LEDs + reset units of the running transfer
+unsigned long			ws2812underruns = 0;					// ring half encoded after the DMA reached it
+#elif WS2812_PWM_LINE
+static uint16_t 		ws2812timerValues[WS2812_MAXDMA_LEN+1] __attribute__ ((aligned (4)));	// buffer for timer/dma, one half word per bit + reset pulse
+#endif
 volatile uint8_t		ledBusy = 0;							// = 1 while dma is sending data to leds
 
+/*
+ * Delta encoding: the GRB value (after overlay and brightness) each LED is encoded with in ws2812timerValues is
+ * kept, so WS2812update() only encodes the LEDs that changed. Without any change no DMA is started; the LEDs keep
+ * their colour. A new strip length encodes all LEDs again and moves the reset pulse. In streaming mode the GRB
+ * values are the source of the ring encoder; with several lanes a changed LED is written into its lane. For
+ * APA102 the LED frame (5 bit brightness and 8 bit colours) takes the place of the GRB value. While a transfer is
+ * running these buffers are read by the DMA, so an update then changes nothing and the LEDs are sent the next time.
+ */
+#define		WS2812_NOT_ENCODED		0xffffffff				// never a GRB value
+
+static uint32_t			ws2812encoded[LEDS_MAXTOTAL];			// GRB encoded per LED
+static short			ws2812encodedLeds = 0;					// strip length of the buffer (0 = nothing encoded)
+static uint8_t			ws2812pending = 0;						// buffer changed but not yet sent
+#if WS2812_APA102
+static uint16_t			ws2812scale[256];						// gamma (c) * masterBrightness / 100, 16 bit
+#else
+static uint8_t			ws2812scale[256];						// gamma (c) * masterBrightness / 100
+#endif
+static int				ws2812scaleBrightness = -1;				// masterBrightness of ws2812scale
+static uint8_t			ws2812scaleGamma = 0;					// ws2812gamma of ws2812scale
+
+uint8_t					ws2812gamma = WS2812_GAMMA_LINEAR;		// gamma * 10 of the LED colours (not of overlays)
 
+unsigned long			ws2812updates = 0;						// calls of WS2812update
+unsigned long			ws2812skipped = 0;						// ... without change (no DMA)
+unsigned long			ws2812partial = 0;						// ... with only some LEDs encoded
+unsigned long			ws2812busy = 0;							// ... while the last transfer was running (nothing encoded)
 
-static void WS2812startDMA(void);									// start the dma transfer (framebuffer to timer)
+
+
+static uint8_t WS2812startDMA(void);								// start the dma transfer (framebuffer to timer)
 
 
 //-------------------------------------------------------------------------------------------------------------
 
-static uint16_t *rgb2pwm(uint16_t *dest, const uint8_t color)
+/*
+ * Timer values of all colour bytes, MSB first; two per word (first bit in the low half word). 4 KB in flash.
+ */
+#define PWM_BIT(c, b)		(((c) >> (b)) & 1 ? WS2812_PWM_ONE : WS2812_PWM_ZERO)
+#define PWM_PAIR(c, b)		(PWM_BIT(c, b) | (PWM_BIT(c, (b) - 1) << 16))
+#define PWM_BYTE(c)			{PWM_PAIR(c, 7), PWM_PAIR(c, 5), PWM_PAIR(c, 3), PWM_PAIR(c, 1)}
+#define PWM_4(c)			PWM_BYTE(c), PWM_BYTE((c) + 1), PWM_BYTE((c) + 2), PWM_BYTE((c) + 3)
+#define PWM_16(c)			PWM_4(c), PWM_4((c) + 4), PWM_4((c) + 8), PWM_4((c) + 12)
+#define PWM_64(c)			PWM_16(c), PWM_16((c) + 16), PWM_16((c) + 32), PWM_16((c) + 48)
+
+static const uint32_t ws2812pwmBits[256][4] = {
+		PWM_64(0), PWM_64(64), PWM_64(128), PWM_64(192)
+};
+
+
+// the 8 timer values of one colour byte; <dest> is word aligned, so the copy is four word moves
+static inline uint16_t *rgb2pwm(uint16_t *dest, const uint8_t color)
 {
-	register uint8_t mask = 0x80;
+	memcpy(dest, ws2812pwmBits[color], sizeof (ws2812pwmBits[0]));
+
+	return dest + 8;
+}
 
-	do
-	{
-		if (color & mask)
-			*dest = WS2812_PWM_ONE;
-		else
-			*dest = WS2812_PWM_ZERO;
 
-		dest++;
-		mask >>= 1;
-	} while (mask != 0);
 
-	return dest;
+
+// count the LEDs of the layout (call after every change of ledLayout); at most LEDS_MAXTOTAL are driven
+void WS2812layoutUpdate(void)
+{
+	int i;
+
+	ledsLayoutTotal = 0;
+	for (i = 0; i < LED_SEGMENTS && ledLayout[i].leds != 0; i++)
+		ledsLayoutTotal += ledLayout[i].skip + ledLayout[i].leds;
+
+	if (ledsLayoutTotal > LEDS_MAXTOTAL)
+		ledsLayoutTotal = LEDS_MAXTOTAL;
 }
 
 
 
 
-// convert color codes from "ws2812_framebuffer" into serial "commands" for timer
+// convert color codes from "ws2812_framebuffer" into serial "commands" for timer (only the changed LEDs)
 void WS2812update(void)
 {
 	register uint32_t i;
 	register rgbValue_t *r;
-	uint16_t * bufp = ws2812timerValues;
-	int c;
+#if !WS2812_STREAMING && WS2812_PWM_LINE
+	uint16_t * bufp;
+#endif
+	uint8_t overlay = (ws2812ovrlayCounter != 0);
+	uint32_t grb;
+	short leds = ledsPhysical;
+	short changed = 0;
 
-	for (i = 0; i < ledsPhysical; i++)
+	if (ws2812scaleBrightness != masterBrightness || ws2812scaleGamma != ws2812gamma)
 	{
-		if (ws2812ovrlayCounter && ws2812ledHasOVR[i])
+		for (i = 0; i < 256; i++)
+		{
+#if WS2812_APA102
+			float c = i / 255.0f;
+
+			if (ws2812gamma != WS2812_GAMMA_LINEAR)
+				c = powf (c, ws2812gamma / 10.0f);
+			ws2812scale[i] = (uint16_t)(65535.0f * c * masterBrightness / 100 + 0.5f);
+#else
+			int c = i;
+
+			if (ws2812gamma != WS2812_GAMMA_LINEAR)
+				c = (int)(255.0f * powf (i / 255.0f, ws2812gamma / 10.0f) + 0.5f);
+			ws2812scale[i] = (uint8_t)((c * masterBrightness) / 100);
+#endif
+		}
+		ws2812scaleBrightness = masterBrightness;
+		ws2812scaleGamma = ws2812gamma;
+	}
+
+	ws2812updates++;
+	if (ledBusy)							// the last transfer still reads the buffers: no remap and no encode
+	{
+		ws2812busy++;
+		ws2812pending = 1;					// send the LEDs next time
+		return;
+	}
+
+#if WS2812_LANES > 1
+	if (WS2812parMap())						// strip split onto the lanes again: encode all LEDs
+		ws2812encodedLeds = 0;
+#endif
+	if (ws2812encodedLeds != leds)
+	{
+		for (i = 0; i < LEDS_MAXTOTAL; i++)
+			ws2812encoded[i] = WS2812_NOT_ENCODED;
+#if !WS2812_STREAMING && WS2812_PWM_LINE
+		bufp = &ws2812timerValues[leds * 3 * 8];
+		for (i = 0; i < WS2812_RESET_LEN; i++)		// append reset pulse (50us low level)
+			*bufp++ = 0;
+#endif
+		ws2812encodedLeds = leds;
+	}
+
+	for (i = 0; i < leds; i++)
+	{
+#if WS2812_APA102
+		if (overlay && ws2812ledHasOVR[i])			// LED frame instead of GRB
 		{
 			r = (rgbValue_t *)&ws2812ledOVR[i];
-			bufp = rgb2pwm(bufp, r->G);
-			bufp = rgb2pwm(bufp, r->R);
-			bufp = rgb2pwm(bufp, r->B);
+			grb = APA102ledFrame(r->R * 257, r->G * 257, r->B * 257);
 		}
 		else
 		{
 			r = (rgbValue_t *)&ws2812ledRGB[i];
-			c = ((int)r->G * masterBrightness) / 100;
-			bufp = rgb2pwm(bufp, (const uint8_t)c);
-			c = ((int)r->R * masterBrightness) / 100;
-			bufp = rgb2pwm(bufp, (const uint8_t)c);
-			c = ((int)r->B * masterBrightness) / 100;
-			bufp = rgb2pwm(bufp, (const uint8_t)c);
+			grb = APA102ledFrame(ws2812scale[r->R], ws2812scale[r->G], ws2812scale[r->B]);
+		}
+#else
+		if (overlay && ws2812ledHasOVR[i])
+		{
+			r = (rgbValue_t *)&ws2812ledOVR[i];
+			grb = ((uint32_t)r->G << 16) | ((uint32_t)r->R << 8) | r->B;
+		}
+		else
+		{
+			r = (rgbValue_t *)&ws2812ledRGB[i];
+			grb = ((uint32_t)ws2812scale[r->G] << 16) | ((uint32_t)ws2812scale[r->R] << 8) | ws2812scale[r->B];
+		}
+#endif
+
+		if (grb != ws2812encoded[i])
+		{
+			ws2812encoded[i] = grb;
+#if WS2812_LANES > 1
+			WS2812parEncode(i, grb);
+#elif WS2812_APA102
+			APA102encode(i, grb);
+#elif !WS2812_STREAMING
+			bufp = &ws2812timerValues[i * 3 * 8];
+			bufp = rgb2pwm(bufp, grb >> 16);
+			bufp = rgb2pwm(bufp, grb >> 8);
+			rgb2pwm(bufp, grb);
+#endif
+			changed++;
 		}
 	}
-	for (i = 0; i < WS2812_RESET_LEN; i++)		// append reset pulse (50us low level)
-		*bufp++ = 0;
 
-	WS2812startDMA();		// send it to RGB stripe
+	if (changed == 0 && !ws2812pending)
+	{
+		ws2812skipped++;
+		return;
+	}
+	if (changed != 0 && changed < leds)
+		ws2812partial++;
+
+	ws2812pending = !WS2812startDMA();		// send it to RGB stripe; again next time if the last DMA was running
 }
 
 
@@ -106,18 +264,26 @@ void WS2812update(void)
 
 void WS2812init(void)
 {
+#if WS2812_PWM_LINE
 	GPIO_InitTypeDef GPIO_InitStructure;
 	TIM_TimeBaseInitTypeDef timbaseinit;
 	TIM_OCInitTypeDef timocinit;
 	NVIC_InitTypeDef nvic_init;
+#endif
 
 	// clear dma buffer
 	int i;
 
+#if WS2812_STREAMING || !WS2812_PWM_LINE
+	for (i = 0; i < LEDS_MAXTOTAL; i++)			// first transfer: all LEDs black
+		ws2812encoded[i] = 0;
+	ws2812encodedLeds = ledsPhysical;
+#else
 	for (i = 0; i < (WS2812_MAXDMA_LEN - WS2812_RESET_LEN); i++)
 		ws2812timerValues[i] = WS2812_PWM_ZERO;
 	for (; i < WS2812_MAXDMA_LEN; i++)
 		ws2812timerValues[i] = 0;
+#endif
 
 	for (i = 0; i < LEDS_MAXTOTAL; i++)
 	{
@@ -130,6 +296,11 @@ void WS2812init(void)
 		ws2812ledHasOVR[i] = 0;
 	}
 
+#if WS2812_LANES > 1
+	WS2812parInit();
+#elif WS2812_APA102
+	APA102init();
+#else
 	// GPIO
 	RCC_AHB1PeriphClockCmd(WS2812_RCC_GPIO, ENABLE);
 	GPIO_InitStructure.GPIO_Pin = WS2812_GPIO_PIN;
@@ -172,7 +343,11 @@ void WS2812init(void)
 	// DMA
 	RCC_AHB1PeriphClockCmd(WS2812_RCC_DMA, ENABLE);
 	TIM_DMACmd(WS2812_TIM, WS2812_DMA_SOURCE, ENABLE);
+#if WS2812_STREAMING
+	DMA_ITConfig(WS2812_DMA_STREAM, DMA_IT_HT | DMA_IT_TC, ENABLE);
+#else
 	DMA_ITConfig(WS2812_DMA_STREAM, DMA_IT_TC, ENABLE);
+#endif
 
 	// NVIC for DMA
 	nvic_init.NVIC_IRQChannel = DMA1_Stream7_IRQn;
@@ -181,31 +356,84 @@ void WS2812init(void)
 	nvic_init.NVIC_IRQChannelCmd = ENABLE;
 	NVIC_Init(&nvic_init);
 
+#if WS2812_STREAMING
+	printf("LED output: DMA ring %d bytes (%d bytes less than the timer values of %d LEDs)\n", (int)sizeof (ws2812ring),
+			(int)(WS2812_MAXDMA_LEN * sizeof (uint16_t) - sizeof (ws2812ring)), LEDS_MAXTOTAL);
+#else
+	printf("LED output: timer values %d bytes for %d LEDs\n", (int)sizeof (ws2812timerValues), LEDS_MAXTOTAL);
+#endif
+#endif
+
 	WS2812startDMA();
 }
 
 
 
 
-// transfer framebuffer data to the timer
-static void WS2812startDMA(void)
+#if WS2812_STREAMING
+// encode the next LEDs of the running transfer (zeros after the last one) into one half of the ring
+static void WS2812fillRing(uint16_t *dest)
+{
+	short n;
+
+	for (n = 0; n < WS2812_RING_LEDS / 2; n++, ws2812streamLed++)
+	{
+		uint32_t grb = (ws2812streamLed < ws2812encodedLeds ? ws2812encoded[ws2812streamLed] : WS2812_NOT_ENCODED);
+
+		if (grb != WS2812_NOT_ENCODED)		// else reset pulse or strip length just changed
+		{
+			dest = rgb2pwm(dest, grb >> 16);
+			dest = rgb2pwm(dest, grb >> 8);
+			dest = rgb2pwm(dest, grb);
+		}
+		else
+		{
+			memset(dest, 0, 3 * 8 * sizeof (uint16_t));
+			dest += 3 * 8;
+		}
+	}
+}
+#endif
+
+
+
+
+// transfer framebuffer data to the timer; returns 0 if the last transfer is still running
+static uint8_t WS2812startDMA(void)
 {
 	if (ledBusy)		// last DMA is not finished
-		return;
+		return 0;
 
 	ledBusy = 1;
+#if WS2812_LANES > 1
+	WS2812parStart();
+#elif WS2812_APA102
+	APA102start(ws2812encodedLeds);
+#else
+#if WS2812_STREAMING
+	ws2812streamUnits = ws2812encodedLeds + WS2812_RESET_UNITS;
+	ws2812streamLed = ws2812streamSent = 0;
+	WS2812fillRing(&ws2812ring[0]);
+	WS2812fillRing(&ws2812ring[WS2812_RING_HALF]);
+#endif
 	DMA_InitTypeDef dma_init =
 	{
+#if WS2812_STREAMING
+			.DMA_BufferSize 		= 2 * WS2812_RING_HALF,
+			.DMA_Memory0BaseAddr 	= (uint32_t) &ws2812ring[0],
+			.DMA_Mode 				= DMA_Mode_Circular,
+#else
 			.DMA_BufferSize 		= (ledsPhysical * 3 * 8 + WS2812_RESET_LEN),
+			.DMA_Memory0BaseAddr 	= (uint32_t) &ws2812timerValues[0],
+			.DMA_Mode 				= DMA_Mode_Normal,
+#endif
 			.DMA_Channel 			= WS2812_DMA_CHANNEL,
 			.DMA_DIR 				= DMA_DIR_MemoryToPeripheral,
 			.DMA_FIFOMode 			= DMA_FIFOMode_Disable,
 			.DMA_FIFOThreshold 		= DMA_FIFOThreshold_HalfFull,
-			.DMA_Memory0BaseAddr 	= (uint32_t) &ws2812timerValues[0],
 			.DMA_MemoryBurst 		= DMA_MemoryBurst_Single,
 			.DMA_MemoryDataSize 	= DMA_MemoryDataSize_HalfWord,
 			.DMA_MemoryInc 			= DMA_MemoryInc_Enable,
-			.DMA_Mode 				= DMA_Mode_Normal,
 			.DMA_PeripheralBaseAddr = (uint32_t) &WS2812_TIM->WS2812_CCR,
 			.DMA_PeripheralBurst 	= DMA_PeripheralBurst_Single,
 			.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord,
@@ -219,15 +447,46 @@ static void WS2812startDMA(void)
 	DMA_Init(WS2812_DMA_STREAM, &dma_init);
 	DMA_Cmd(WS2812_DMA_STREAM, ENABLE);
 	TIM_DMACmd(WS2812_TIM, WS2812_DMA_SOURCE, ENABLE);
+#endif
+	return 1;
 }
 
 
 
 
-// gets called when dma transfer has completed
+#if WS2812_PWM_LINE
+// gets called when dma transfer has completed (streaming: when one half of the ring was sent)
 void DMA1_Stream7_IRQHandler(void)
 {
+#if WS2812_STREAMING
+	uint16_t *half;
+	uint8_t late;
+
+	if (DMA_GetITStatus(WS2812_DMA_STREAM, DMA_IT_HTIF7) != RESET)		// first half sent, DMA in the second
+	{
+		DMA_ClearITPendingBit(WS2812_DMA_STREAM, DMA_IT_HTIF7);
+		half = &ws2812ring[0];
+		late = (WS2812_DMA_STREAM->NDTR > WS2812_RING_HALF);
+	}
+	else																// second half sent, DMA in the first
+	{
+		DMA_ClearITPendingBit(WS2812_DMA_STREAM, DMA_IT_TCIF7);
+		half = &ws2812ring[WS2812_RING_HALF];
+		late = (WS2812_DMA_STREAM->NDTR <= WS2812_RING_HALF);
+	}
+
+	ws2812streamSent += WS2812_RING_LEDS / 2;
+	if (ws2812streamSent < ws2812streamUnits)
+	{
+		if (late && ws2812streamLed < ws2812encodedLeds)
+			ws2812underruns++;
+		WS2812fillRing(half);
+		return;
+	}
+	// all LEDs and the reset pulse sent; the DMA is in the zeros behind them
+#else
 	DMA_ClearITPendingBit(WS2812_DMA_STREAM, DMA_IT_TCIF7);
+#endif
 	DMA_Cmd(WS2812_DMA_STREAM, DISABLE);
 	while (DMA_GetCmdStatus(WS2812_DMA_STREAM) == ENABLE)
 		; //wait
@@ -237,6 +496,7 @@ void DMA1_Stream7_IRQHandler(void)
 
 	ledBusy = 0;			// get ready for next transfer
 }
+#endif
 
 
 
@@ -34,11 +34,32 @@
 #define		LEDS_XMAX		96
 #define		LEDS_YMAX		60
 #define		LEDS_MAXTOTAL	(2*LEDS_XMAX+2*LEDS_YMAX)			// MAX physical leds on stripe
-#define		DELAY_LINE_SIZE	20					// delay line for imgage processor in the TV
 
 extern int		ledsX;
 extern int		ledsY;
-#define			ledsPhysical		(2*ledsX+2*ledsY)				// physical leds on stripe
+
+/*
+ * Optional LED layout for strips which are not a closed ring of 2*ledsX + 2*ledsY LEDs: a list of segments in strip
+ * order, each on one edge of the picture. Positions are percent of the edge from top resp. left; from > to runs
+ * backwards (e.g. right edge bottom to top = 100..0). <skip> LEDs in front of a segment stay black (gap for the TV
+ * stand, corners). The table ends at the first segment with 0 LEDs; if the first one has 0 LEDs, the ring of
+ * ledsX/ledsY is used (starting bottom right, counter-clockwise).
+ */
+#define			LED_SEGMENTS		8
+
+enum { LED_EDGE_RIGHT = 0, LED_EDGE_TOP, LED_EDGE_LEFT, LED_EDGE_BOTTOM, LED_EDGES };
+
+typedef struct {
+	uint8_t		edge;				// LED_EDGE_xxx
+	uint8_t		from, to;			// 0..100 % of the edge
+	uint8_t		leds;				// LEDs on this segment; 0 = end of table
+	uint8_t		skip;				// unused LEDs on the strip in front of this segment
+} ledSegment_t;
+
+extern ledSegment_t	ledLayout[LED_SEGMENTS];
+extern int			ledsLayoutTotal;		// LEDs of the layout incl. gaps (set by WS2812layoutUpdate)
+
+#define			ledsPhysical		(ledLayout[0].leds ? ledsLayoutTotal : 2*ledsX+2*ledsY)		// physical leds on stripe
 
 // ----------------------------- definitions -----------------------------
 // warning: change source file if using tim1/8/9/10/11
@@ -71,6 +92,44 @@ extern int		ledsY;
 #define WS2812_PWM_ONE			30
 #define WS2812_PWM_ZERO			15
 
+// 1 = stream the LEDs through a DMA ring of WS2812_RING_LEDS, encoded in the DMA IRQ (memory independent of
+// the strip length, transfer starts at once); 0 = encode the whole strip into one buffer before the DMA
+#ifndef WS2812_STREAMING
+#define WS2812_STREAMING		0
+#endif
+// The ring IRQ runs at priority 1 under the DCMI line IRQ (priority 0, DMA_LINES = 4 lines of 64 us per IRQ), so
+// the refill of a half may wait for WS2812_IRQ_BLOCK_US: three line IRQs back to back, each at most as long as its
+// 256 us period (a longer one loses lines anyway). Half of the ring must be sent in more time than that; 16 LEDs
+// (240 us per half) were shorter than a single line IRQ. '#' shows ws2812underruns.
+#define WS2812_IRQ_BLOCK_US		768
+#define WS2812_RING_LEDS		64					// even; half of it is encoded per IRQ (960 us at 800 kHz)
+#if WS2812_RING_LEDS / 2 * 30 <= WS2812_IRQ_BLOCK_US
+#error "WS2812_RING_LEDS: half of the ring is sent faster than the line IRQs may block its refill"
+#endif
+
+// 1 = one data line (PWM of the timer above); 2, 4 or 8 = the strip split onto that many data lines (ws2812par.h)
+#ifndef WS2812_LANES
+#define WS2812_LANES			1
+#endif
+#if WS2812_LANES != 1 && WS2812_LANES != 2 && WS2812_LANES != 4 && WS2812_LANES != 8
+#error "WS2812_LANES must be 1, 2, 4 or 8"
+#endif
+#if WS2812_LANES > 1 && WS2812_STREAMING
+#error "WS2812_STREAMING is for one data line only"
+#endif
+
+// 1 = APA102 / SK9822 LEDs on SPI (apa102.h) instead of WS2812, with the same colours from ws2812ledRGB
+#ifndef WS2812_APA102
+#define WS2812_APA102			0
+#endif
+#if WS2812_APA102 && (WS2812_LANES > 1 || WS2812_STREAMING)
+#error "WS2812_APA102 has one SPI output only"
+#endif
+
+// gamma * 10 of the LED colours (ws2812gamma)
+#define WS2812_GAMMA_LINEAR		10
+#define WS2812_GAMMA_MAX		30
+
 // number of timer cycles (~1.25s) for the reset pulse
 #define WS2812_RESET_LEN		50
 
@@ -96,10 +155,19 @@ extern rgbValue_t ws2812ledOVR[LEDS_MAXTOTAL];			// overlay color data for all l
 unsigned char ws2812ledHasOVR[LEDS_MAXTOTAL];
 extern volatile uint8_t	ledBusy;					// = 1 while dma is sending data to leds
 extern volatile unsigned long ws2812ovrlayCounter;	// ignore overlay when 0 (decr in system ticker)
+extern unsigned long	ws2812updates;				// calls of WS2812update
+extern unsigned long	ws2812skipped;				// ... without any changed LED (no DMA)
+extern unsigned long	ws2812partial;				// ... with only some LEDs encoded again
+extern unsigned long	ws2812busy;					// ... while the last transfer was running (nothing encoded, sent next time)
+extern uint8_t			ws2812gamma;				// gamma * 10 of the LED colours (10 = linear; overlays are not corrected)
+#if WS2812_STREAMING
+extern unsigned long	ws2812underruns;			// streaming: ring half encoded too late
+#endif
 
 // ----------------------------- functions -----------------------------
 void WS2812init(void);
 void WS2812update(void);
 void WS2812test(void);
+void WS2812layoutUpdate(void);
 
 #endif
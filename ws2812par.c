@@ -0,0 +1,273 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+
+#include <stdio.h>
+#include "string.h"
+#include "stm32f4xx.h"
+#include "ws2812par.h"
+#include "main.h"
+
+#if WS2812_LANES > 1			// else the single data line of ws2812.c
+
+
+short			ws2812parLaneLeds[WS2812_LANES];			// LEDs (incl. gaps) per lane
+short			ws2812parLongest = 0;						// LEDs of the longest lane
+
+static uint8_t	ws2812parBits[WS2812PAR_MAXBITS];			// per bit: lanes to set low after T0H
+static uint16_t	ws2812parMask = WS2812PAR_LANE_MASK;		// source of the set and reset streams
+static uint8_t	ws2812parLane[LEDS_MAXTOTAL];				// lane of every LED of the strip
+static short	ws2812parPos[LEDS_MAXTOTAL];				// its position on the lane
+static short	ws2812parLeds = -1;							// LEDs of the map
+
+typedef struct {
+	int				ledsX;
+	int				ledsY;
+	int				leds;
+	ledSegment_t	layout[LED_SEGMENTS];
+} laneKey_t;
+
+static laneKey_t	ws2812parKey = {.leds = -1};			// strip of the lane map
+
+
+
+// split the strip onto the lanes (see ws2812par.h) if it changed; returns 1 if the split changed (all LEDs black)
+uint8_t WS2812parMap(void)
+{
+	static uint8_t edges[LEDS_MAXTOTAL];
+	ledSegment_t ring [4] = {
+			{LED_EDGE_RIGHT,	100, 0,		ledsY, 0},
+			{LED_EDGE_TOP,		100, 0,		ledsX, 0},
+			{LED_EDGE_LEFT,		0, 100,		ledsY, 0},
+			{LED_EDGE_BOTTOM,	0, 100,		ledsX, 0},
+	};
+	const ledSegment_t *layout = (ledLayout[0].leds != 0) ? ledLayout : ring;
+	short segs = (ledLayout[0].leds != 0) ? LED_SEGMENTS : 4;
+	short edgeLeds[LED_EDGES] = {0};
+	short edgeDone[LED_EDGES] = {0};
+	short leds = ledsPhysical;
+	uint8_t changed;
+	laneKey_t key;
+	short s, k, led, i;
+
+	memset (&key, 0, sizeof (laneKey_t));		// no random padding bytes for memcmp
+	key.ledsX = ledsX;
+	key.ledsY = ledsY;
+	key.leds = leds;
+	memcpy (key.layout, ledLayout, sizeof (ledLayout));
+	if (memcmp (&key, &ws2812parKey, sizeof (laneKey_t)) == 0)
+		return 0;
+	ws2812parKey = key;
+
+	// edge of every LED (a gap belongs to the segment behind it)
+	for (s = 0, led = 0; s < segs && layout[s].leds != 0 && led < leds; s++)
+	{
+		uint8_t edge = layout[s].edge % LED_EDGES;
+
+		for (k = 0; k < layout[s].skip + layout[s].leds && led < leds; k++, led++)
+		{
+			edges[led] = edge;
+			edgeLeds[edge]++;
+		}
+	}
+
+	// lane and position on it; a new layout may give the same split (e.g. other positions on the edges)
+	changed = (led != ws2812parLeds);
+	ws2812parLeds = led;
+	memset (ws2812parLaneLeds, 0, sizeof (ws2812parLaneLeds));
+	ws2812parLongest = 0;
+	for (i = 0; i < led; i++)
+	{
+		uint8_t edge = edges[i];
+		uint8_t lane = edge * WS2812_LANES / LED_EDGES;
+		short pos;
+
+		if (WS2812_LANES > LED_EDGES)			// edge split into WS2812_LANES / LED_EDGES lanes
+			lane += edgeDone[edge]++ * (WS2812_LANES / LED_EDGES) / edgeLeds[edge];
+
+		pos = ws2812parLaneLeds[lane]++;
+		if (ws2812parLaneLeds[lane] > ws2812parLongest)
+			ws2812parLongest = ws2812parLaneLeds[lane];
+		if (ws2812parLane[i] != lane || ws2812parPos[i] != pos)
+		{
+			ws2812parLane[i] = lane;
+			ws2812parPos[i] = pos;
+			changed = 1;
+		}
+	}
+	if (!changed)
+		return 0;
+
+	for (i = 0; i < WS2812PAR_MAXBITS; i++)		// all bits 0 (and the reset pulse)
+		ws2812parBits[i] = WS2812PAR_DATA_MASK;
+
+	return 1;
+}
+
+
+
+
+// write the 24 bits of one LED (G, R, B, MSB first) into its lane
+void WS2812parEncode(short led, uint32_t grb)
+{
+	uint8_t *p = &ws2812parBits[ws2812parPos[led] * 3 * 8];
+	uint8_t bit = WS2812PAR_LANE_BIT(ws2812parLane[led]);
+	uint32_t mask;
+
+	for (mask = 0x800000; mask != 0; mask >>= 1, p++)
+	{
+		if (grb & mask)
+			*p &= ~bit;				// 1: stays high until T1H
+		else
+			*p |= bit;				// 0: low after T0H
+	}
+}
+
+
+
+
+// <halfWords> = 0: byte transfers, <inc> = 0: the same value for all transfers
+static void WS2812parStream(DMA_Stream_TypeDef *stream, uint32_t flags, uint32_t dest, void *src,
+		uint8_t halfWords, uint8_t inc, uint32_t count)
+{
+	DMA_InitTypeDef dma_init =
+	{
+			.DMA_BufferSize 		= count,
+			.DMA_Channel 			= WS2812PAR_DMA_CHANNEL,
+			.DMA_DIR 				= DMA_DIR_MemoryToPeripheral,
+			.DMA_FIFOMode 			= DMA_FIFOMode_Disable,
+			.DMA_FIFOThreshold 		= DMA_FIFOThreshold_HalfFull,
+			.DMA_Memory0BaseAddr 	= (uint32_t) src,
+			.DMA_MemoryBurst 		= DMA_MemoryBurst_Single,
+			.DMA_MemoryDataSize 	= halfWords ? DMA_MemoryDataSize_HalfWord : DMA_MemoryDataSize_Byte,
+			.DMA_MemoryInc 			= inc ? DMA_MemoryInc_Enable : DMA_MemoryInc_Disable,
+			.DMA_Mode 				= DMA_Mode_Normal,
+			.DMA_PeripheralBaseAddr = dest,
+			.DMA_PeripheralBurst 	= DMA_PeripheralBurst_Single,
+			.DMA_PeripheralDataSize = halfWords ? DMA_PeripheralDataSize_HalfWord : DMA_PeripheralDataSize_Byte,
+			.DMA_PeripheralInc 		= DMA_PeripheralInc_Disable,
+			.DMA_Priority 			= DMA_Priority_Medium
+	};
+
+	DMA_Cmd(stream, DISABLE);
+	while (DMA_GetCmdStatus(stream) == ENABLE)
+		; //wait
+	DMA_ClearFlag(stream, flags);			// a stream does not start with flags of the last transfer
+	DMA_Init(stream, &dma_init);
+	DMA_Cmd(stream, ENABLE);
+}
+
+
+
+
+// send all lanes; the caller has set ledBusy
+void WS2812parStart(void)
+{
+	uint32_t bits = ws2812parLongest * 3 * 8;
+
+	TIM_Cmd(WS2812PAR_TIM, DISABLE);
+	TIM_SetCounter(WS2812PAR_TIM, 0);
+
+	if (bits != 0)
+		WS2812parStream(WS2812PAR_DMA_SET, WS2812PAR_SET_FLAGS, (uint32_t)&WS2812PAR_GPIO->BSRRL, &ws2812parMask,
+				1, 0, bits);
+	WS2812parStream(WS2812PAR_DMA_DATA, WS2812PAR_DATA_FLAGS, WS2812PAR_DATA_REG, ws2812parBits,
+			0, 1, bits + WS2812_RESET_LEN);
+	WS2812parStream(WS2812PAR_DMA_RESET, WS2812PAR_RESET_FLAGS, (uint32_t)&WS2812PAR_GPIO->BSRRH, &ws2812parMask,
+			1, 0, bits + WS2812_RESET_LEN);
+
+	TIM_DMACmd(WS2812PAR_TIM, TIM_DMA_CC1 | TIM_DMA_CC2 | TIM_DMA_CC3, ENABLE);
+	TIM_Cmd(WS2812PAR_TIM, ENABLE);
+}
+
+
+
+
+// gets called when the last bit and the reset pulse were sent
+void DMA2_Stream4_IRQHandler(void)
+{
+	DMA_ClearITPendingBit(WS2812PAR_DMA_RESET, DMA_IT_TCIF4);
+
+	TIM_Cmd(WS2812PAR_TIM, DISABLE);
+	TIM_DMACmd(WS2812PAR_TIM, TIM_DMA_CC1 | TIM_DMA_CC2 | TIM_DMA_CC3, DISABLE);
+	DMA_Cmd(WS2812PAR_DMA_SET, DISABLE);
+	DMA_Cmd(WS2812PAR_DMA_DATA, DISABLE);
+	DMA_Cmd(WS2812PAR_DMA_RESET, DISABLE);
+
+	ledBusy = 0;			// get ready for next transfer
+}
+
+
+
+
+void WS2812parInit(void)
+{
+	GPIO_InitTypeDef GPIO_InitStructure;
+	TIM_TimeBaseInitTypeDef timbaseinit;
+	TIM_OCInitTypeDef timocinit;
+	NVIC_InitTypeDef nvic_init;
+
+	// GPIO: one output per lane, low between the frames
+	RCC_AHB1PeriphClockCmd(WS2812PAR_RCC_GPIO, ENABLE);
+	GPIO_ResetBits(WS2812PAR_GPIO, WS2812PAR_LANE_MASK);
+	GPIO_InitStructure.GPIO_Pin = WS2812PAR_LANE_MASK;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_OUT;
+	GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
+	GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
+	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_100MHz;
+	GPIO_Init(WS2812PAR_GPIO, &GPIO_InitStructure);
+
+	// TIMER: period = one bit; CC1..3 = start of the bit, T0H, T1H
+	RCC_APB2PeriphClockCmd(WS2812PAR_RCC_TIM, ENABLE);
+
+	TIM_TimeBaseStructInit(&timbaseinit);
+	timbaseinit.TIM_ClockDivision = 		TIM_CKD_DIV1;
+	timbaseinit.TIM_CounterMode = 			TIM_CounterMode_Up;
+	timbaseinit.TIM_Period = 				WS2812PAR_TIM_FREQ / WS2812_OUT_FREQ - 1;
+	timbaseinit.TIM_Prescaler = 			(uint16_t)(SystemCoreClock / WS2812PAR_TIM_FREQ) - 1; //tim8 runs at the system clock
+	TIM_TimeBaseInit(WS2812PAR_TIM, &timbaseinit);
+
+	TIM_OCStructInit(&timocinit);
+	timocinit.TIM_OCMode = 					TIM_OCMode_Timing;
+	timocinit.TIM_OutputState = 			TIM_OutputState_Disable;
+	timocinit.TIM_Pulse = 					1;
+	TIM_OC1Init(WS2812PAR_TIM, &timocinit);
+	timocinit.TIM_Pulse = 					1 + WS2812PAR_T0H;
+	TIM_OC2Init(WS2812PAR_TIM, &timocinit);
+	timocinit.TIM_Pulse = 					1 + WS2812PAR_T1H;
+	TIM_OC3Init(WS2812PAR_TIM, &timocinit);
+
+	// DMA
+	RCC_AHB1PeriphClockCmd(WS2812PAR_RCC_DMA, ENABLE);
+	DMA_ITConfig(WS2812PAR_DMA_RESET, DMA_IT_TC, ENABLE);
+
+	// NVIC for DMA
+	nvic_init.NVIC_IRQChannel = DMA2_Stream4_IRQn;
+	nvic_init.NVIC_IRQChannelPreemptionPriority = 1;
+	nvic_init.NVIC_IRQChannelSubPriority = 1;
+	nvic_init.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&nvic_init);
+
+	ws2812parKey.leds = -1;
+	ws2812parLeds = -1;
+	WS2812parMap();				// all LEDs black
+
+	printf("LED output: %d lanes, bit buffer %d bytes (%d bytes less than half words)\n", WS2812_LANES,
+			(int)sizeof (ws2812parBits), (int)sizeof (ws2812parBits));
+}
+
+#endif
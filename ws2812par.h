@@ -0,0 +1,95 @@
+/*****************************************************
+ *
+ *	Control program for the PitSchuLight TV-Backlight
+ *	(c) Peter Schulten, Mlheim, Germany
+ *	peter_(at)_pitschu.de
+ *
+ *	Die unvernderte Wiedergabe und Verteilung dieses gesamten Sourcecodes
+ *	in beliebiger Form ist gestattet, sofern obiger Hinweis erhalten bleibt.
+ *
+ * 	Ich stelle diesen Sourcecode kostenlos zur Verfgung und biete daher weder
+ *	Support an noch garantiere ich fr seine Funktionsfhigkeit. Auerdem
+ *	bernehme ich keine Haftung fr die Folgen seiner Nutzung.
+
+ *	Der Sourcecode darf nur zu privaten Zwecken verwendet und modifiziert werden.
+ *	Darber hinaus gehende Verwendung bedarf meiner Zustimmung.
+ */
+
+
+#ifndef WS2812PAR_H
+#define WS2812PAR_H
+
+#include "ws2812.h"
+
+/*
+ * Parallel output of WS2812_LANES strips (WS2812_LANES > 1 in ws2812.h), e.g. one data line per TV edge. Timer 8
+ * runs at the WS2812 bit rate; its compare events trigger three DMA streams to the BSRR register of the data port:
+ *	CC1		all lanes high (start of a bit)
+ *	CC2		lanes with a 0 bit low (after T0H): one byte per bit with the bits of all lanes (bit transposed)
+ *	CC3		all lanes low (after T1H)
+ * So one DMA stream carries the data of all strips and a frame takes the time of the longest lane instead of the
+ * whole strip (312 LEDs: 9.4 ms on one line, 2.9 ms on four lanes with 96/60/96/60 LEDs). The GPIO port is on the
+ * AHB and takes byte writes, so the data stream moves bytes into the reset half of BSRR: the bit buffer is half the
+ * size of the timer value buffer of the single line (a byte wide DMA into a timer register of the APB does not
+ * work, the bridge repeats the byte in all lanes of the bus).
+ *
+ * The strip (ring of ledsX/ledsY or ledLayout) is split at the edges: with 4 lanes each edge has its own lane, with
+ * 2 lanes right+top and left+bottom, with 8 lanes every edge is split in halves. Each lane starts at the first LED
+ * of its part and runs in the direction of the single strip, so a ring is simply cut into pieces and every piece
+ * gets its own data line. A lane shorter than the longest one gets 0 bits behind its last LED.
+ * The default pins PD0..PD3 are free on the Discovery board, so 2 or 4 lanes work there. PD4 (audio reset) and PD5
+ * (USB over-current) follow, and no port of the board has a free byte, so 8 lanes need other hardware; the lanes
+ * are checked against the pins the board uses (WS2812PAR_BOARD_PINS, see hardware.h).
+ */
+#ifndef WS2812PAR_OUT_PORT
+#define WS2812PAR_OUT_PORT		D
+#define WS2812PAR_FIRST_PIN		0					// lane n is pin WS2812PAR_FIRST_PIN + n; all in one byte of the port
+#endif
+#ifndef WS2812PAR_BOARD_PINS
+#define WS2812PAR_BOARD_PINS	CAT(BOARD_PINS_, WS2812PAR_OUT_PORT)
+#endif
+
+#define WS2812PAR_TIM			TIM8				// APB2 timer, DMA requests only (no output pin)
+#define WS2812PAR_RCC_TIM		RCC_APB2Periph_TIM8
+#define WS2812PAR_TIM_FREQ		84000000
+
+#define WS2812PAR_RCC_DMA		RCC_AHB1Periph_DMA2	// only DMA2 can write to the GPIO port
+#define WS2812PAR_DMA_CHANNEL	DMA_Channel_7
+#define WS2812PAR_DMA_SET		DMA2_Stream2		// TIM8_CH1
+#define WS2812PAR_DMA_DATA		DMA2_Stream3		// TIM8_CH2
+#define WS2812PAR_DMA_RESET		DMA2_Stream4		// TIM8_CH3; the last one of a bit, its TC IRQ ends the frame
+#define WS2812PAR_SET_FLAGS		(DMA_FLAG_FEIF2 | DMA_FLAG_DMEIF2 | DMA_FLAG_TEIF2 | DMA_FLAG_HTIF2 | DMA_FLAG_TCIF2)
+#define WS2812PAR_DATA_FLAGS	(DMA_FLAG_FEIF3 | DMA_FLAG_DMEIF3 | DMA_FLAG_TEIF3 | DMA_FLAG_HTIF3 | DMA_FLAG_TCIF3)
+#define WS2812PAR_RESET_FLAGS	(DMA_FLAG_FEIF4 | DMA_FLAG_DMEIF4 | DMA_FLAG_TEIF4 | DMA_FLAG_HTIF4 | DMA_FLAG_TCIF4)
+
+#define WS2812PAR_GPIO			CAT(GPIO, 				WS2812PAR_OUT_PORT)
+#define WS2812PAR_RCC_GPIO		CAT(RCC_AHB1Periph_GPIO, WS2812PAR_OUT_PORT)
+#define WS2812PAR_LANE_MASK		((uint16_t)(((1 << WS2812_LANES) - 1) << WS2812PAR_FIRST_PIN))
+#define WS2812PAR_LANE_BIT(n)	((uint8_t)(1 << (WS2812PAR_FIRST_PIN % 8 + (n))))	// in the data byte
+#define WS2812PAR_DATA_MASK		((uint8_t)(WS2812PAR_LANE_MASK >> (WS2812PAR_FIRST_PIN / 8 * 8)))
+#define WS2812PAR_DATA_REG		((uint32_t)&WS2812PAR_GPIO->BSRRH + WS2812PAR_FIRST_PIN / 8)	// byte of BSRRH
+
+#if WS2812PAR_FIRST_PIN % 8 + WS2812_LANES > 8 && WS2812_LANES > 1
+#error "the lanes must be in one byte of the port"
+#endif
+#if WS2812_LANES > 1 && ((((1 << WS2812_LANES) - 1) << WS2812PAR_FIRST_PIN) & WS2812PAR_BOARD_PINS)
+#error "the lanes drive pins the board uses (WS2812PAR_BOARD_PINS)"
+#endif
+
+// compare values: same pulse widths as the PWM of the single line
+#define WS2812PAR_T0H			(WS2812_PWM_ZERO * (WS2812PAR_TIM_FREQ / WS2812_TIM_FREQ))
+#define WS2812PAR_T1H			(WS2812_PWM_ONE * (WS2812PAR_TIM_FREQ / WS2812_TIM_FREQ))
+
+// one byte per bit of the longest lane (at most the whole strip) + reset pulse
+#define WS2812PAR_MAXBITS		(LEDS_MAXTOTAL * 3 * 8 + WS2812_RESET_LEN)
+
+extern short	ws2812parLaneLeds[WS2812_LANES];	// LEDs (incl. gaps) per lane
+extern short	ws2812parLongest;					// LEDs of the longest lane
+
+// ----------------------------- functions -----------------------------
+void WS2812parInit(void);
+uint8_t WS2812parMap(void);
+void WS2812parEncode(short led, uint32_t grb);
+void WS2812parStart(void);
+
+#endif